@@ -10,5 +10,8 @@
 #define FS_EISDIR      -6
 #define FS_EPERM       -7
 #define FS_EBADF       -8
+#define FS_EINVAL      -9
+#define FS_ENOTEMPTY  -10
+#define FS_EBUSY      -11     // 共享模式下遇到须独占卷的步骤（库内部改为独占重做，不返回给调用方）
 
 #endif
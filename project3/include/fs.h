@@ -3,24 +3,31 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+#include "miniext2.h"     // 对外接口与各层统计结构
 
 // --- 常量与布局 ---
 #define FS_MAGIC        0xEF53u
-#define BLOCK_SIZE      512u
-#define TOTAL_BLOCKS    4611u
+#define BLOCK_SIZE_MIN  512u
+#define BLOCK_SIZE_MAX  4096u   // 栈上块缓冲按此分配
+#define BSIZE           (g_sb.block_size)   // 运行时块大小，以超级块为准
+
+// format 缺省几何（与旧版镜像相同的 2.3MB 卷）
+#define DEF_BLOCK_SIZE  512u
+#define DEF_BLOCKS      4611u
+#define DEF_INODES      256u
 
 #define BLK_BOOT        0
-#define BLK_SUPER       1
-#define BLK_GDESC       2
-#define BLK_BMAP        3
-#define BLK_IMAP        4
-#define BLK_ITBL_START  5
-#define ITBL_BLOCKS     64
-#define BLK_DATA_START  (BLK_ITBL_START + ITBL_BLOCKS)  // 69
-
-#define MAX_INODES      256
+#define BLK_SUPER       1       // 超级块位于字节偏移 block_size 处
+#define BLK_GDESC       2       // 组描述符表起始块，占 gdt_blocks 块
+
+// 每个块组：块位图、inode 位图、inode 表，之后是数据块；0 号组在前面还有引导块/超级块/GDT
+// 旧版（rev 0）镜像：单组，位图在 3/4，inode 表 5..68，数据从 69 开始
+#define LEGACY_ITBL_BLOCKS  64
+
 #define INODE_SIZE      128
 #define NDIRECT         10
+#define NEXT_INODE      3       // inode 内联 extent 个数
 
 // 文件类型/目录项
 #define FT_REG  1
@@ -40,6 +47,8 @@
 #define FS_EISDIR      -6
 #define FS_EPERM       -7
 #define FS_EBADF       -8
+#define FS_EINVAL      -9
+#define FS_ENOTEMPTY  -10
 
 #define NAME_MAX_LEN 56
 
@@ -51,13 +60,58 @@ typedef struct {
     uint32_t block_bitmap_blk, inode_bitmap_blk;
     uint32_t root_ino;
     uint64_t mount_time, write_time;
+    uint32_t state;         // SB_STATE_CLEAN：上次正常卸载；否则挂载时重算空闲计数
+    uint32_t rev;           // SB_REV_GROUPS：下列块组字段有效；否则按旧版单组布局解释
+    uint32_t blocks_per_group, inodes_per_group, groups_count;
+    uint32_t itbl_blocks;   // 每组 inode 表块数
+    uint32_t gdt_blocks;    // 组描述符表块数
+    uint32_t atime_mode;    // 缺省 atime 策略 ATIME_*，0=strict（旧镜像）
+    uint32_t journal_start, journal_blocks;   // 元数据日志区（0 号组数据区开头），0=无日志
 } superblock_t;
+#define SB_STATE_CLEAN  0x434C4E31u   // "CLN1"
+#define SB_STATE_DIRTY  0x44525459u   // "DRTY"
+#define SB_REV_GROUPS   0x47525031u   // "GRP1"
+
+// atime 策略：strict 每次读都更新；relatime 仅当 atime 早于 mtime/ctime 或已过一天；noatime 不更新
+#define ATIME_STRICT    1
+#define ATIME_RELATIME  2
+#define ATIME_NOATIME   3
+
+// 元数据日志：日志区分两半，事务按序号交替写入一半：
+// [描述块×ndesc：头 + count 个目标块号][count 个块映像][提交块（含校验和）]
+#define JNL_DESC_MAGIC    0x4A445331u   // "JDS1"
+#define JNL_COMMIT_MAGIC  0x4A434D31u   // "JCM1"
+typedef struct { uint32_t magic, seq, count, ndesc; } jdesc_hdr_t;
+typedef struct { uint32_t magic, seq, count, csum; } jcommit_t;
 
 typedef struct {
     uint32_t block_bitmap, inode_bitmap, inode_table;
     uint32_t free_blocks_count, free_inodes_count;
 } group_desc_t;
 
+// extent：逻辑块 [lblk, lblk+len) 映射到物理块 [pblk, pblk+len)
+typedef struct {
+    uint32_t lblk, pblk, len;
+} extent_t;
+
+// extent 树节点：头部 + 按 lblk 升序的数组；叶块存 extent，索引块存 (子树起始 lblk, 子块号)
+#define EXT_LEAF_MAGIC  0x45585431u   // "EXT1"
+#define EXT_IDX_MAGIC   0x45584931u   // "EXI1"
+typedef struct {
+    uint32_t magic, count;
+} ext_leaf_hdr_t;
+typedef struct {
+    uint32_t lblk, child;
+} ext_idx_t;
+#define EXT_LEAF_MAX    ((BSIZE - sizeof(ext_leaf_hdr_t)) / sizeof(extent_t))
+#define EXT_LEAF_CAP    ((BLOCK_SIZE_MAX - sizeof(ext_leaf_hdr_t)) / sizeof(extent_t))   // 数组上限
+#define EXT_IDX_MAX     ((BSIZE - sizeof(ext_leaf_hdr_t)) / sizeof(ext_idx_t))
+#define EXT_IDX_CAP     ((BLOCK_SIZE_MAX - sizeof(ext_leaf_hdr_t)) / sizeof(ext_idx_t))
+#define EXT_MAX_DEPTH   8       // 树高上限（512B 块时 8 层远超卷容量）
+
+#define INODE_FL_EXTENTS 0x1u   // 数据块按 extent 映射（否则为直接+间接指针）
+#define INODE_FL_INDEX   0x2u   // 目录带哈希索引，索引数据在 dx_ino
+
 typedef struct {
     uint16_t mode;          // 类型+权限
     uint16_t uid;           // 所有者
@@ -66,9 +120,23 @@ typedef struct {
     uint16_t gid;
     uint16_t links;
     uint32_t blocks;
-    uint32_t direct[NDIRECT];
-    uint32_t indirect1;     // 单级间接
-    uint8_t  _reserve[56];
+    union {
+        struct {            // 块映射格式
+            uint32_t direct[NDIRECT];
+            uint32_t indirect1;     // 单级间接
+        };
+        struct {            // extent 格式（flags & INODE_FL_EXTENTS）
+            uint16_t ext_count;     // inode 内联的 extent 个数
+            uint16_t _ext_pad;
+            extent_t ext[NEXT_INODE];   // ext_root==0 时有效
+            uint32_t ext_root;      // 超过 NEXT_INODE 个时为 extent 树的根块
+        };
+    };
+    uint32_t flags;
+    uint32_t dx_ino;        // INODE_FL_INDEX：存放哈希索引的隐藏 inode
+    uint32_t indirect2;     // 二级间接（块映射格式）
+    uint32_t indirect3;     // 三级间接
+    uint8_t  _reserve[40];
 } inode_t;
 
 typedef struct {
@@ -79,37 +147,152 @@ typedef struct {
 } dirent_t;
 
 // --- 打开文件表 ---
-#define MAX_OPEN 64
+// 间接表缓存：一/二/三级路径上每层保留最近一张表的副本，全局代数变化即作废
 typedef struct {
-    int used;
+    uint32_t  gen;
+    uint32_t  blk[3];       // 各层副本对应的物理块，0=空
+    uint32_t* tbl[3];       // BSIZE 字节，首次使用时分配
+} bmap_cache_t;
+// 打开文件描述：open 时建立，dup 出来的 fd 共用（偏移、预读状态一起共享），最后一个
+// fd 关闭时释放。同一 inode 的所有描述串在该 inode 的缓存项上（见 inode_opens）
+typedef struct ofile {
     uint32_t ino;
     uint32_t offset;
     int writable;
+    int ref;                // 引用本描述的 fd 数
+    bmap_cache_t bmc;
+    uint32_t ra_pos;        // 上次读结束处；下次从这里读即视为顺序
+    uint32_t ra_win;        // 预读窗口（块），0=不预读
+    uint32_t ra_end;        // 已预读到的逻辑块（不含）
+    pthread_mutex_t lock;   // 共享模式下串行同一描述上的读写与 seek
+    struct ofile* inext;    // 同一 inode 的下一个描述
 } ofile_t;
+// 描述符表：按需倍增，空闲槽串成栈，分配与释放都是 O(1)。flags 属于 fd 本身
+#define FD_TABLE_MIN 16
+#define FD_TABLE_MAX (1u<<20)
+#define FD_RDONLY    MX_FD_RDONLY
+typedef struct {
+    ofile_t* of;            // NULL=空闲
+    int flags;              // FD_*
+    int next;               // 空闲时：栈中下一个空闲槽，-1=栈底
+} fdent_t;
 
-// --- 全局状态 ---
-extern superblock_t g_sb;
-extern group_desc_t g_gd;
-extern FILE* g_dev;
-extern ofile_t g_ofile[MAX_OPEN];
-extern uint32_t g_cwd;
+// 全局状态（g_sb、描述符表等）都在当前卷 g_vol 里，见文件末尾“卷上下文”
+extern const uint8_t g_zero_block[BLOCK_SIZE_MAX];
 
 // 登录状态（教学版）
 #define MAX_USER_LEN 16
-extern int  g_uid;                 // 0=root；其它统一当作 1
-extern char g_user[MAX_USER_LEN];  // 当前用户名
+
+// --- 挂载选项（-o a,b,c） ---
+#define DEV_STDIO  0            // fopen 打开，块读写经 fileno 的 pread/pwrite（默认）
+#define DEV_PREAD  1            // 原始 fd + pread/pwrite
+#define DEV_MMAP   2            // 整盘 mmap，块读写为 memcpy，msync 刷盘
+typedef struct {
+    int backend;                // DEV_STDIO / DEV_PREAD / DEV_MMAP
+    int direct;                 // O_DIRECT（仅 DEV_PREAD）
+    int show_stats;             // 退出时打印设备/缓存统计
+    uint32_t commit_secs;       // 元数据定期写回间隔（秒），0=仅 sync/卸载
+    int extents;                // 新建普通文件使用 extent 映射
+    uint32_t ra_kb;             // 顺序预读窗口上限（KB），0=关闭
+    int atime;                  // ATIME_*；0=按超级块中的缺省
+    int delalloc;               // 延迟分配（默认开，nodelalloc 关闭）
+    int aio;                    // AIO_*：缓存刷盘、预读、整块写入的异步引擎
+    uint32_t qd;                // 每线程同时在途的异步请求上限
+    char stats_file[128];       // stats=文件：卸载时把统计追加到该文件
+    char trace_file[128];       // trace=文件：开启操作跟踪，卸载时导出
+    uint32_t trace_buf;         // 跟踪环的项数，0=缺省
+} mount_opts_t;
+#define AIO_OFF      0          // 同步（默认）
+#define AIO_URING    1          // io_uring，内核不支持时退回线程池
+#define AIO_THREADS  2          // 工作线程池 + pread/pwrite
+#define AIO_QD_MAX   256u
+int fs_parse_opts(const char* s);
 
 // --- 设备层 ---
+typedef void (*dev_aio_cb)(void* arg, int res);
+// 块读写一律按偏移 pread/pwrite（stdio 后端也用 fileno），多线程不共享文件读写位置
 int dev_open(const char* path, const char* mode);
 int dev_close();
 int dev_read_block(void* buf, uint32_t blk_no);
 int dev_write_block(const void* buf, uint32_t blk_no);
+int dev_write_meta(const void* buf, uint32_t blk_no);  // 元数据块：有日志时记入当前事务
+int dev_sync();
+const void* dev_peek_block(uint32_t blk_no);           // 只读借用，下次 dev_* 调用前有效（共享模式下是本线程的副本）
+int dev_attach();                                      // g_sb 几何就绪后调用：mmap 映射整卷
+int dev_truncate(uint64_t bytes);                      // 调整镜像大小（format 时建稀疏文件）
+int dev_read_at(void* buf, uint32_t len, uint64_t off); // 按字节偏移读（探测超级块）
+int dev_raw_read(void* buf, uint32_t blk_no);          // 绕过缓存，仅供 cache.c
+int dev_raw_write(const void* buf, uint32_t blk_no);
+int dev_raw_readn(void* buf, uint32_t blk_no, uint32_t cnt);         // cnt 个连续块，一次宿主机调用
+int dev_raw_writen(const void* buf, uint32_t blk_no, uint32_t cnt);
+int dev_readahead(uint32_t blk, uint32_t n);           // 预读进缓存（mmap：madvise）
+// 绕过块缓存的多块读写（cnt 个物理连续块一次宿主机调用），与缓存中的副本保持一致
+int dev_read_blocks(void* buf, uint32_t blk_no, uint32_t cnt);
+int dev_write_blocks(const void* buf, uint32_t blk_no, uint32_t cnt);
+// 同 dev_write_blocks，但异步写出：完成（或失败）时回调，cb 可为 NULL，buf 在此之前不得改动
+int dev_write_blocks_async(const void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg);
+int dev_io(int wr, void* buf, uint32_t blk_no, uint32_t cnt);   // 同步 pread/pwrite（aio.c 用，不计统计）
+
+void dev_get_stats(dev_stats_t* out);
+
+// --- 异步块 I/O（aio.c）：绕过块缓存，同 dev_raw_readn/dev_raw_writen ---
+// 请求提交后立即返回，完成后只在本线程的 dev_aio_poll/dev_aio_drain 里回调（res 为
+// FS_OK/FS_ERR）；aio=off 或 mmap 后端时当场同步完成并回调。返回值只报告参数错误（此时
+// 不回调），I/O 错误经回调和 dev_aio_drain 报告。回调前缓冲不得改动，也不要同时经别的
+// 路径读写同一块。各层在返回前 drain，本线程的队列在两次调用之间总是空的
+int  dev_aio_read(void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg);
+int  dev_aio_write(const void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg);
+int  dev_aio_async();          // 本卷的请求会真正异步执行
+int  dev_aio_poll(int wait);   // 处理本线程已完成的请求，wait=1 时至少等到一个；返回处理个数
+int  dev_aio_drain();          // 等本线程的请求全部完成；自上次 drain 以来有失败返回 FS_ERR
+
+// --- 块缓存（cache.c）：写回、LRU 淘汰，dev_close/dev_sync 时刷盘 ---
+int  bcache_read(void* buf, uint32_t blk);
+int  bcache_write(const void* buf, uint32_t blk);
+const void* bcache_peek(uint32_t blk);
+int  bcache_flush();
+void bcache_invalidate();
+int  bcache_readahead(uint32_t blk, uint32_t n);
+int  bcache_readn(void* buf, uint32_t blk, uint32_t n);          // 缓存副本优先
+int  bcache_writen(const void* buf, uint32_t blk, uint32_t n);   // 写盘并刷新缓存副本
+int  bcache_update(const void* buf, uint32_t blk, uint32_t n);   // 只刷新已缓存的副本并置脏（调用方自己写盘）
+void bcache_written(const void* buf, uint32_t blk, uint32_t n);  // 写盘成功后把仍相同的副本标为干净
+void bcache_get_stats(bcache_stats_t* out);
 
-// --- 位图/分配 ---
-int  bmap_test(uint32_t idx, int is_block);
+// --- 元数据日志（journal.c）：dev_write_meta 的块留在事务映像中，fs_sync 时整批提交 ---
+int  journal_replay();          // 挂载时、读位图之前：重放最新的完整事务，返回块数
+int  journal_enable();
+int  journal_disable();         // 提交 + 检查点 + 清空日志区
+int  journal_active();
+int  journal_log(const void* buf, uint32_t blk);
+const void* journal_peek(uint32_t blk);
+int  journal_read(void* buf, uint32_t blk);           // 块在本事务中：拷出映像并返回 1
+int  journal_update(const void* buf, uint32_t blk);   // 块在本事务中：改写映像并返回 1
+int  journal_need_commit(uint32_t backlog);
+int  journal_commit();          // 写日志 + 一次 fdatasync + 映像写回原位；无日志时即 dev_sync
+void journal_get_stats(journal_stats_t* out);
+
+// --- 位图/分配（位图常驻内存，bitmap_sync 时写回） ---
+// 块组：第 g 组覆盖块 [g*blocks_per_group, +group_len(g))，inode [g*ipg+1, (g+1)*ipg]
+#define GROUP_OF_BLK(b)  ((b) / g_sb.blocks_per_group)
+#define GROUP_OF_INO(i)  (((i)-1) / g_sb.inodes_per_group)
+uint32_t group_len(uint32_t g);
+uint32_t group_meta_end(uint32_t g);   // 组内第一个数据块（绝对块号）
+int  bitmap_load();
+int  bitmap_sync();
+void bitmap_unload();
+void bitmap_count_free(uint32_t* free_blocks, uint32_t* free_inodes);
+void bitmap_count_group(uint32_t g, uint32_t* free_blocks, uint32_t* free_inodes);
+int  bmap_test(uint32_t idx, int is_block);       // idx：块号或 inode 号
 int  bmap_set(uint32_t idx, int is_block, int val);
 int  alloc_block();
-void free_block(uint32_t blk);
+int  alloc_block_goal(uint32_t goal);
+int  alloc_block_run(uint32_t goal, uint32_t want, uint32_t* got);   // 连续一段，返回起始块
+int  block_reserve(uint32_t n);          // 只扣可用计数，不动位图
+void block_unreserve(uint32_t n);
+void free_block(uint32_t blk);        // 有日志时推迟到 bitmap_release_pending
+void bitmap_release_pending();
+uint32_t bitmap_dirty();       // 下次 bitmap_sync 最多要写的位图块数
 int  alloc_inode();
 void free_inode(uint32_t ino);
 
@@ -117,6 +300,28 @@ void free_inode(uint32_t ino);
 int read_inode(uint32_t ino, inode_t* out);
 int write_inode(uint32_t ino, const inode_t* in);
 int inode_truncate(uint32_t ino);
+// inode 缓存：打开文件期间 iget 钉住，关闭时 iput；icache_sync 按表块合并写回
+int  iget(uint32_t ino);
+void iput(uint32_t ino);
+int  icache_sync();
+uint32_t icache_dirty();       // 脏 inode 个数
+void icache_drop();
+void icache_get_stats(icache_stats_t* out);
+// 每个 inode 一把读写锁（在缓存项里，须已 iget）：fs_read 共享、fs_write 独占
+int  inode_lock(uint32_t ino, int excl);
+void inode_unlock(uint32_t ino);
+// 打开描述链（须已 iget，独占卷下调用）。删除仍被打开的文件只摘目录项、记为孤儿，
+// 最后一个描述摘链时由调用方释放 inode
+void inode_open_add(uint32_t ino, ofile_t* of);
+int  inode_open_del(uint32_t ino, ofile_t* of);   // 返回 1：孤儿且已无人打开
+ofile_t* inode_opens(uint32_t ino);                 // 链头，没人打开返回 NULL
+int  inode_orphan(uint32_t ino);                    // 有人打开则记为孤儿返回 1，否则返回 0
+
+// --- extent 映射（extent.c） ---
+int ext_lookup(const inode_t* in, uint32_t lblk, uint32_t* run);   // 返回物理块，*run=从 lblk 起连续块数
+int ext_map_write(inode_t* in, uint32_t lblk, int zero);           // 必要时分配（zero=1 清零新块）
+int ext_map_assign(inode_t* in, uint32_t lblk, uint32_t pblk);     // 映射到调用方已分配的块
+int ext_truncate(inode_t* in);
 
 // --- 目录/路径 ---
 int dir_lookup(uint32_t dir_ino, const char* name, uint32_t* out_ino);
@@ -124,25 +329,156 @@ int dir_add(uint32_t dir_ino, const char* name, uint8_t ftype, uint32_t child_in
 int dir_remove(uint32_t dir_ino, const char* name);
 int namei(const char* path, uint32_t* out_ino);
 
+// 路径分量缓存（dcache.c），含负项
+int  dcache_lookup(uint32_t parent, const char* name, uint32_t* ino);  // 命中返回 1
+void dcache_insert(uint32_t parent, const char* name, uint32_t ino);   // ino=0 记负项
+void dcache_purge_dir(uint32_t dir_ino);
+void dcache_drop();
+void dcache_get_stats(dcache_stats_t* out);
+
 // --- 文件 I/O ---
+#define MAP_ALLOC      1    // 缺块则分配并清零
+#define MAP_OVERWRITE  2    // 缺块则分配，调用方会整块覆盖，不必清零
+int map_bn(inode_t* in, uint32_t bn, int alloc, bmap_cache_t* mc);   // alloc=0/MAP_*，mc 可为 NULL
+int map_bn_assign(inode_t* in, uint32_t bn, uint32_t phys, bmap_cache_t* mc);   // 已映射则返回原块
+int map_bn_for_read(inode_t* in, uint32_t bn);    // 逻辑块 → 物理块（不分配）
+int map_bn_for_write(inode_t* in, uint32_t bn);   // 必要时分配并清零
+int bmap_truncate(inode_t* in);                   // 释放直接/间接块（块映射格式）
+void bmap_cache_release(bmap_cache_t* mc);
 int fs_open(const char* path, const char* mode);
 int fs_close(int fd);
+int fs_close_all();                 // 卸载前关闭所有 fd
+int fs_dup(int fd, int flags);      // 新 fd 共用 fd 的打开文件描述，flags 为新 fd 的 FD_*
+int fs_fdflags(int fd, int flags);  // flags<0 只查询；返回（修改前的）FD_*
+ofile_t* fs_file(int fd);           // fd 对应的描述，无效返回 NULL
 int fs_read(int fd, void* buf, uint32_t len);
 int fs_write(int fd, const void* buf, uint32_t len);
 int fs_seek(int fd, int32_t off);
 
+// --- 延迟分配（delalloc.c）：未映射块的写入先缓冲在内存，close/sync 时成段分配 ---
+int  da_write(uint32_t ino, uint32_t lbn, uint32_t off, const void* src, uint32_t len);
+const void* da_peek(uint32_t ino, uint32_t lbn);   // 缓冲中的块，没有返回 NULL
+int  da_flush(uint32_t ino);
+int  da_flush_all();
+int  da_balance();
+int  da_over();                                    // 缓冲超限，da_balance 会刷盘
+void da_discard(uint32_t ino);                     // 截断/删除时丢弃并退还预留
+void da_drop_all();                                // 卸载时丢弃刷不出去的块，文件长度随之退回
+void da_get_stats(da_stats_t* out);
+
+// --- 卷上下文（volume.c） ---
+// 一个已挂载镜像的全部可变状态。内部各层都经 g_vol 访问“当前卷”，对外接口（api.c）
+// 在入口处切换 g_vol（每线程一个），所以同一进程里可以同时打开多个卷。各层私有的状态
+// 由该层的 *_vol_init 分配、*_vol_free 释放，这里只保存指针。
+//
+// 并发：卷锁是读写锁。fs_read/fs_write/fs_seek 持共享锁并行执行，其余操作（名字空间、
+// open/close、sync、提交）持独占锁。共享模式下同一打开描述由其 lock 串行，同一文件由
+// inode 锁保护（读共享、写独占）；分配器、块缓存、日志、inode 缓存、延迟分配各有一把
+// 内部互斥锁，加锁顺序为 delalloc → 分配器 → inode 缓存 → 日志 → 块缓存。
+// 共享模式下需要独占的步骤（提交、全量刷延迟分配）不在原地做：调用 vol_defer 停下，
+// 由 api.c 换成独占锁再做。
+typedef struct {
+    mx_op_stats_t op[MX_OP_NUM];
+    alloc_stats_t alloc;
+} op_stats_t;
+struct bcache_state; struct journal_state; struct bitmap_state;
+struct icache_state; struct dcache_state; struct da_state; struct aio_state; struct trace_state;
+typedef struct volume {
+    superblock_t  sb;
+    group_desc_t* gdt;              // 组描述符表（groups_count 项）
+    mount_opts_t  mopt;
+    // 设备（dev.c）
+    FILE*    dev;
+    int      fd, direct;            // stdio 后端时 fd 为 fileno(dev)
+    uint8_t* map; size_t maplen;
+    dev_stats_t devstat;
+    op_stats_t  opstat;             // stats.c
+    // 超级块写回状态（fs.c）
+    int sb_dirty, sb_live;
+    uint32_t last_sync;
+    // 打开文件与会话：描述符表只在独占卷时增长、改动，共享模式下只读
+    fdent_t* fdt;
+    uint32_t nfd;                   // 表容量
+    int      fd_free;               // 空闲栈顶，-1=无空闲槽
+    uint32_t cwd;
+    int      uid;                   // 0=root；其它统一当作 1
+    char     user[MAX_USER_LEN];    // 当前用户名
+    uint32_t bmap_gen;              // 间接表副本代数（file.c）
+    struct bcache_state*  bcache;
+    struct journal_state* journal;
+    struct bitmap_state*  bitmap;
+    struct icache_state*  icache;
+    struct dcache_state*  dcache;
+    struct da_state*      delalloc;
+    struct aio_state*     aio;      // 线程池（aio.c），按需启动
+    struct trace_state*   trace;    // 操作跟踪（trace.c），未开启为 NULL
+    pthread_rwlock_t lock;          // 卷锁
+} volume_t;
+extern __thread volume_t* g_vol;
+#define g_sb     (g_vol->sb)
+#define g_gdt    (g_vol->gdt)
+#define g_mopt   (g_vol->mopt)
+#define g_dev    (g_vol->dev)
+#define g_cwd    (g_vol->cwd)
+#define g_uid    (g_vol->uid)
+#define g_user   (g_vol->user)
+
+volume_t* vol_create();             // 缺省挂载选项，尚未打开设备
+int  vol_destroy(volume_t* v);      // 仍挂载则先卸载，返回卸载结果
+void vol_lock(int excl);            // 当前卷加共享/独占锁
+void vol_unlock();
+int  vol_shared();                  // 本线程持共享锁
+int  vol_defer();                   // 共享模式下停在须独占的步骤：记下并返回 FS_EBUSY
+int  vol_deferred();                // 取出并清除上面的记号
+int  bcache_vol_init(volume_t* v);  void bcache_vol_free(volume_t* v);
+int  journal_vol_init(volume_t* v); void journal_vol_free(volume_t* v);
+int  bitmap_vol_init(volume_t* v);  void bitmap_vol_free(volume_t* v);
+int  icache_vol_init(volume_t* v);  void icache_vol_free(volume_t* v);
+int  dcache_vol_init(volume_t* v);  void dcache_vol_free(volume_t* v);
+int  da_vol_init(volume_t* v);      void da_vol_free(volume_t* v);
+int  aio_vol_init(volume_t* v);     void aio_vol_free(volume_t* v);
+
 // 权限检查
 // int perm_can_read(const inode_t* in, int uid);
 // int perm_can_write(const inode_t* in, int uid);
 
 // --- FS 初始化 ---
-int fs_format();
+// 0 表示取缺省值；size 为卷字节数；journal 为日志块数（FORMAT_NO_JOURNAL 不建日志）
+#define FORMAT_NO_JOURNAL  MX_NO_JOURNAL
+int fs_format(const char* img, uint32_t block_size, uint64_t size, uint32_t inodes, uint32_t journal);
 int fs_mount(const char* img);
+int fs_sync();       // 内存元数据写回 + 刷盘
+int fs_unmount();    // fs_sync + 关闭设备
+int sb_write();   // 超级块/组描述符表写回（经整块缓冲，避免越界读写）
+int gd_write();
+void sb_mark_dirty();  // 计数器已改：延迟到 sync/卸载/提交间隔写回
+void fs_maybe_sync();
+int  fs_sync_due();      // fs_maybe_sync 此刻会提交
+int  fs_atime_mode();    // 当前生效的 atime 策略
+int  fs_parse_atime(const char* s);   // "strict"/"relatime"/"noatime" → ATIME_*，未知返回 0
+int  fs_set_atime_default(int mode);  // 写入超级块，之后的挂载沿用
+
+// --- 运行时统计（stats.c）：常开，计数用 relaxed 原子加 ---
+void stat_op(int op, uint64_t t0, int r);   // t0 为 now_ns() 起点；r<0 记为失败（FS_EBUSY 除外）
+void stat_scan(uint32_t words);             // 一次块分配扫描的位图字数
+void stats_collect(mx_stats_t* out);        // 汇总当前卷各层统计
+int  stats_dump(const char* path);          // 追加到文件，带时间戳
+
+// --- 操作跟踪（trace.c）：trace= 时开启，未开启时每个跟踪点只多一次判空 ---
+enum { TR_OPEN, TR_CLOSE, TR_READ, TR_WRITE, TR_SEEK, TR_DUP, TR_MKDIR, TR_UNLINK,   // replay 重放这些
+       TR_NAMEI, TR_ALLOC, TR_DEV_READ, TR_DEV_WRITE, TR_DEV_SYNC, TR_NUM };
+#define TRACE_T0()  (g_vol->trace ? now_ns() : 0)
+#define TRACE(ev, t0, a, b, res, name) do{ if(g_vol->trace) trace_ev((ev), (t0), (a), (b), (res), (name)); }while(0)
+int  trace_start(uint32_t n);               // 环取不小于 n 的 2 的幂项（0=缺省 64K），开始记录
+void trace_stop();
+void trace_ev(int ev, uint64_t t0, int64_t a, int64_t b, int res, const char* name);   // 结束时刻取当前
+int  trace_export(const char* path);        // 写 Chrome trace JSON，按开始时间排序
 
 // --- 工具 ---
 void ts_now(uint32_t* out);
 void human_time(uint32_t t, char* out, size_t n);
 void mode_to_str(uint16_t mode, char out[11]);
+uint64_t now_ns();
 
 // --- 账号/口令（基于 /.users 文本文件） ---
 int users_bootstrap(void);
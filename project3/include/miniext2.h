@@ -0,0 +1,128 @@
+#ifndef MINIEXT2_H
+#define MINIEXT2_H
+// libminiext2 对外接口：每个已挂载的镜像是一个 mx_vol_t，所有调用都显式传入卷；
+// 同一进程可同时挂载多个镜像。返回值 <0 为 errors.h 中的 FS_* 错误码。
+#include <stdint.h>
+#include <stdio.h>
+#include "errors.h"
+
+typedef struct volume mx_vol_t;
+
+// --- 各层统计（-o stats 打印的内容） ---
+// 宿主机 I/O 计数（每次 raw 读写对应一次宿主机读/写调用）与累计耗时
+typedef struct {
+    uint64_t reads, writes, syncs;
+    uint64_t read_blocks, write_blocks; // 上面的读写共传输的块数（字节数 = 块数 × block_size）
+    uint64_t read_ns, write_ns;
+    uint32_t block_size;
+    int backend, direct;        // 当前生效的后端（O_DIRECT 可能被自动关闭）
+    int aio;                    // 实际用到的异步引擎：0=未用 1=io_uring 2=线程池
+    uint64_t async;             // 上面的读写中异步提交的个数（耗时按提交到完成计）
+    uint64_t qd_max;            // 单线程同时在途请求数的峰值
+    uint64_t blk_reads, blk_writes;     // 上层经块接口读/写的块数（不论是否命中缓存或记入日志）
+} dev_stats_t;
+typedef struct {
+    uint64_t hits, misses, evictions, writebacks;
+    uint64_t readahead;         // 预读装入的块数
+} bcache_stats_t;
+typedef struct {
+    uint64_t commits, blocks;   // 提交次数 / 记入日志的块数
+    uint64_t forced;            // 映像表满而在操作中途提交的次数
+    uint64_t replayed;          // 挂载时重放的块数
+} journal_stats_t;
+typedef struct {
+    uint64_t hits, misses, writebacks;   // writebacks = inode 表块写次数
+} icache_stats_t;
+typedef struct {
+    uint64_t hits, neg_hits, misses;
+} dcache_stats_t;
+typedef struct {
+    uint64_t buffered;          // 进入缓冲的块数
+    uint64_t flushed, runs;     // 刷盘写出的块数 / 物理连续段数
+    uint64_t flushes;
+} da_stats_t;
+// 关键操作常开计时：次数、失败次数、累计/最大耗时与 log2 延迟直方图（hist[i] 为 [2^i, 2^(i+1)) ns，
+// 末桶含更长的）。嵌套调用各自计时，如 namei 里包含它调用的 dir_lookup；dir_lookup 只计 dcache 未命中的
+#define MX_HIST 32
+enum { MX_OP_NAMEI, MX_OP_DIR_LOOKUP, MX_OP_ALLOC_BLOCK, MX_OP_READ, MX_OP_WRITE, MX_OP_TRUNCATE, MX_OP_NUM };
+typedef struct {
+    uint64_t calls, fails, total_ns, max_ns;
+    uint64_t hist[MX_HIST];
+} mx_op_stats_t;
+// 块分配器每次分配扫描的位图字数（hist[i] 为 [2^i, 2^(i+1)) 字，0 字计入第 0 桶）
+typedef struct {
+    uint64_t allocs, words, max;
+    uint64_t hist[MX_HIST];
+} alloc_stats_t;
+typedef struct {
+    dev_stats_t dev;
+    bcache_stats_t cache;
+    icache_stats_t icache;
+    dcache_stats_t dcache;
+    journal_stats_t journal;
+    da_stats_t delalloc;
+    mx_op_stats_t op[MX_OP_NUM];
+    alloc_stats_t alloc;
+    int delalloc_on;            // 本次挂载是否启用延迟分配（决定是否打印 delalloc 一行）
+} mx_stats_t;
+
+// 卷参数与本次挂载生效的选项
+typedef struct {
+    uint32_t block_size, blocks, groups, inodes, free_blocks, free_inodes;
+    int atime_default, atime_effective;      // 1=strict 2=relatime 3=noatime，旧镜像缺省为 0
+    uint32_t journal_start, journal_blocks;  // journal_blocks=0 表示无日志
+    int delalloc;                            // 本次挂载是否启用延迟分配
+} mx_info_t;
+
+typedef struct {
+    uint32_t ino, size;
+    uint16_t mode, uid;
+    uint32_t atime, mtime, ctime;
+} mx_stat_t;
+// mx_readdir 逐项回调（含 . 和 ..），返回非 0 提前结束
+typedef int (*mx_dirent_cb)(void* arg, const char* name, int is_dir, const mx_stat_t* st);
+
+// --- 卷 ---
+// opts 为逗号分隔的挂载选项（同命令行 -o），可为 NULL。0 表示取缺省值，journal 为
+// MX_NO_JOURNAL 时不建日志；st 非 NULL 时返回格式化过程的 I/O 统计
+#define MX_NO_JOURNAL 0xFFFFFFFFu
+int  mx_format(const char* img, const char* opts, uint32_t block_size, uint64_t size,
+               uint32_t inodes, uint32_t journal, mx_stats_t* st);
+mx_vol_t* mx_mount(const char* img, const char* opts, int* err);   // 失败返回 NULL，*err 为错误码
+int  mx_unmount(mx_vol_t* v, mx_stats_t* st);        // st 非 NULL 时返回含卸载写回在内的统计
+int  mx_sync(mx_vol_t* v);
+void mx_info(mx_vol_t* v, mx_info_t* out);
+void mx_get_stats(mx_vol_t* v, mx_stats_t* out);
+// 把统计写成文本（即 -o stats 打印的内容）；hist 非 0 时另列各操作的延迟直方图与扫描长度分布
+void mx_stats_print(FILE* f, const mx_stats_t* s, int hist);
+int  mx_set_atime(mx_vol_t* v, const char* mode);   // 写入超级块的缺省 atime 策略
+// 挂载时带 trace=文件 才有跟踪：把目前环里的事件写成 Chrome trace JSON（卸载时也会写到 trace= 的文件），
+// 未开启返回 FS_EINVAL
+int  mx_trace_dump(mx_vol_t* v, const char* path);
+
+// --- 文件（fd 属于各自的卷） ---
+// fd 指向打开文件描述（偏移等）；mx_dup 得到的 fd 与原 fd 共用描述，fd 标志各自独立
+#define MX_FD_RDONLY 0x1        // fd 标志：经此 fd 不可写
+int  mx_open(mx_vol_t* v, const char* path, const char* mode);   // "r" / "w"
+int  mx_close(mx_vol_t* v, int fd);
+int  mx_dup(mx_vol_t* v, int fd, int flags);         // 返回新 fd，flags 为其 MX_FD_*
+int  mx_fdflags(mx_vol_t* v, int fd, int flags);     // 设置 fd 标志（flags<0 只查询），返回原标志
+int  mx_read(mx_vol_t* v, int fd, void* buf, uint32_t len);
+int  mx_write(mx_vol_t* v, int fd, const void* buf, uint32_t len);
+int  mx_seek(mx_vol_t* v, int fd, int32_t off);
+
+// --- 名字空间 ---
+int  mx_mkdir(mx_vol_t* v, const char* path);
+int  mx_unlink(mx_vol_t* v, const char* path);     // 普通文件或空目录；仍打开的文件关闭后才释放
+int  mx_chdir(mx_vol_t* v, const char* path);
+int  mx_chmod(mx_vol_t* v, const char* path, uint32_t mode);
+int  mx_stat(mx_vol_t* v, const char* path, mx_stat_t* out);
+int  mx_readdir(mx_vol_t* v, const char* path, mx_dirent_cb cb, void* arg);   // path 为 NULL 即当前目录
+
+// --- 账号与会话 ---
+int  mx_login(mx_vol_t* v, const char* user, const char* pass);
+int  mx_useradd(mx_vol_t* v, const char* user, const char* pass);
+int  mx_passwd(mx_vol_t* v, const char* user, const char* pass);
+int  mx_whoami(mx_vol_t* v, char* user, uint32_t len);      // 返回 uid
+
+#endif
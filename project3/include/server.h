@@ -0,0 +1,65 @@
+#ifndef MINI_EXT2_SERVER_H
+#define MINI_EXT2_SERVER_H
+// mini_ext2 serve：常驻进程保持卷挂载，经 Unix 域套接字服务本机多个客户端。
+// 线路格式为本机字节序的定长头 + 载荷。客户端可连续发出多个请求而不等应答（流水线），
+// 服务端按到达顺序执行，把一次读入的全部请求的应答合并成一次写回。
+// fd 在连接内编号：OPEN/DUP 由客户端在 arg 里指定新 fd，服务端映射到卷上的真实 fd，
+// 因此 open 之后的 write/close 不必等 open 的应答即可一并发出；连接断开时关闭其余 fd。
+#include <stdint.h>
+#include "miniext2.h"
+
+#define SRV_SOCK_DEFAULT "mini_ext2.sock"
+#define SRV_MSG_MAX      (4u<<20)       // 单个请求/应答载荷上限
+#define SRV_FD_MAX       65536          // 每连接 fd 编号上限
+
+enum {
+    SRV_OPEN=1,     // 载荷=路径，arg=新 fd，flags=1 写
+    SRV_CLOSE,      // fd
+    SRV_READ,       // fd，arg=长度；应答载荷为数据
+    SRV_WRITE,      // fd，载荷=数据
+    SRV_SEEK,       // fd，arg=偏移
+    SRV_DUP,        // fd，arg=新 fd，flags=MX_FD_*
+    SRV_MKDIR,      // 载荷=路径
+    SRV_UNLINK,     // 载荷=路径
+    SRV_READDIR,    // 载荷=路径（空为当前目录）；应答载荷为 srv_dirent_t 序列
+    SRV_STAT,       // 载荷=路径；应答载荷为 mx_stat_t
+    SRV_SYNC,
+    SRV_STATS,      // 应答载荷为 mx_stats_t
+    SRV_STOP,       // 让服务端卸载退出
+};
+
+typedef struct {
+    uint32_t len;               // 载荷字节数
+    uint16_t op, flags;
+    uint32_t tag;               // 原样带回应答
+    int32_t  fd, arg;
+} srv_req_t;
+
+typedef struct {
+    uint32_t len, tag;
+    int32_t  res;               // FS_* 或操作结果
+} srv_resp_t;
+
+typedef struct {
+    mx_stat_t st;
+    uint16_t is_dir, name_len;  // 其后紧跟 name_len 字节的名字（不含 '\0'）
+} srv_dirent_t;
+
+// 服务端：在 path 上监听并服务卷 v，收到 SIGINT/SIGTERM 或 SRV_STOP 后返回（不卸载卷）
+int srv_run(mx_vol_t* v, const char* path);
+
+// --- 客户端 ---
+// 请求先进发送缓冲，在途超过窗口或调用 cl_wait 时才真正发出；应答按请求顺序回调
+typedef struct cl_conn cl_conn_t;
+typedef void (*cl_done_cb)(void* ctx, int res, const void* data, uint32_t len);
+
+cl_conn_t* cl_connect(const char* path);
+void cl_close(cl_conn_t* c);
+int  cl_send(cl_conn_t* c, int op, int flags, int fd, int arg, const void* p, uint32_t len,
+             cl_done_cb cb, void* ctx);
+int  cl_wait(cl_conn_t* c, uint32_t keep);     // 发出缓冲的请求并收应答，直到在途不超过 keep 个
+// 同步调用：应答载荷最多拷出 cap 字节到 out
+int  cl_call(cl_conn_t* c, int op, int flags, int fd, int arg, const void* p, uint32_t len,
+             void* out, uint32_t cap);
+
+#endif
@@ -7,5 +7,7 @@ void ts_now(uint32_t* out);
 void human_time(uint32_t t, char* out, size_t n);
 // "-rw-r--r--" 或 "drwxr-xr-x"
 void mode_to_str(uint16_t mode, char out[11]);
+// 单调时钟（纳秒），用于计时
+uint64_t now_ns();
 
 #endif
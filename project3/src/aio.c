@@ -0,0 +1,320 @@
+// src/aio.c — 设备层的异步块 I/O：请求提交后立即返回，完成后在提交它的线程里回调
+// aio=uring：每个线程一个 io_uring（直接走 io_uring_setup/io_uring_enter 系统调用，不依赖
+// liburing），建不起来（老内核、被 seccomp 禁止）时退回线程池；aio=threads：每卷一个工作
+// 线程池按需启动，用 pread/pwrite 执行。每个线程同时在途的请求不超过 qd，满了先收割一个。
+// 请求和完成队列都是线程私有的，持共享卷锁的多个线程互不干扰。
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "fs.h"
+
+#define AIO_WORKERS  8u             // 线程池上限（不超过 qd）
+
+#define STAT_ADD(v, f, n) __atomic_fetch_add(&(v)->devstat.f, (n), __ATOMIC_RELAXED)
+
+typedef struct aio_req {
+    volume_t* vol;
+    int wr;
+    void* buf; uint32_t blk, cnt;
+    int res;                        // 线程池：FS_OK/FS_ERR；io_uring：传输字节数或 -errno
+    int ring;                       // 经 io_uring 完成（res 需要换算）
+    uint64_t t0;
+    dev_aio_cb cb; void* arg;
+    struct iovec iov;
+    struct aio_q* q;
+    struct aio_req* next;
+} aio_req_t;
+
+// 每线程的提交/完成队列
+typedef struct aio_q {
+    int ring;                       // io_uring fd；-1=尚未建立，-2=不可用
+    void* sq_ptr; void* cq_ptr; struct io_uring_sqe* sqes;
+    size_t sq_len, cq_len, sqe_len;
+    uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+    uint32_t *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    uint32_t inflight, in_ring;
+    pthread_mutex_t lock;           // 线程池的完成队列
+    pthread_cond_t cond;
+    aio_req_t *done, *done_tail;
+    aio_req_t* free;                // 请求空闲链
+} aio_q_t;
+
+static __thread aio_q_t* t_q;
+static __thread int t_err;          // 自上次 drain 以来有请求失败
+static pthread_key_t q_key;
+static pthread_once_t q_once = PTHREAD_ONCE_INIT;
+
+// 每卷的线程池
+struct aio_state {
+    pthread_t th[AIO_WORKERS];
+    uint32_t nth;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    aio_req_t *head, *tail;
+    int stop;
+};
+
+// ===== io_uring =====
+static void ring_close(aio_q_t* q){
+    if(q->sqes && q->sqes!=MAP_FAILED) munmap(q->sqes, q->sqe_len);
+    if(q->cq_ptr && q->cq_ptr!=MAP_FAILED && q->cq_ptr!=q->sq_ptr) munmap(q->cq_ptr, q->cq_len);
+    if(q->sq_ptr && q->sq_ptr!=MAP_FAILED) munmap(q->sq_ptr, q->sq_len);
+    if(q->ring>=0) close(q->ring);
+    q->sqes=NULL; q->cq_ptr=q->sq_ptr=NULL;
+    q->ring=-2;
+}
+
+static int ring_setup(aio_q_t* q){
+    struct io_uring_params p; memset(&p, 0, sizeof(p));
+    q->ring = (int)syscall(__NR_io_uring_setup, AIO_QD_MAX, &p);
+    if(q->ring < 0){ q->ring=-2; return FS_ERR; }
+    q->sq_len = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+    q->cq_len = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single){ if(q->cq_len > q->sq_len) q->sq_len = q->cq_len; q->cq_len = q->sq_len; }
+    q->sq_ptr = mmap(NULL, q->sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, q->ring, IORING_OFF_SQ_RING);
+    if(q->sq_ptr==MAP_FAILED){ ring_close(q); return FS_ERR; }
+    q->cq_ptr = single ? q->sq_ptr :
+        mmap(NULL, q->cq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, q->ring, IORING_OFF_CQ_RING);
+    if(q->cq_ptr==MAP_FAILED){ ring_close(q); return FS_ERR; }
+    q->sqe_len = p.sq_entries*sizeof(struct io_uring_sqe);
+    q->sqes = (struct io_uring_sqe*)mmap(NULL, q->sqe_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, q->ring, IORING_OFF_SQES);
+    if(q->sqes==MAP_FAILED){ ring_close(q); return FS_ERR; }
+    uint8_t* sq=(uint8_t*)q->sq_ptr; uint8_t* cq=(uint8_t*)q->cq_ptr;
+    q->sq_head=(uint32_t*)(sq+p.sq_off.head); q->sq_tail=(uint32_t*)(sq+p.sq_off.tail);
+    q->sq_mask=(uint32_t*)(sq+p.sq_off.ring_mask); q->sq_array=(uint32_t*)(sq+p.sq_off.array);
+    q->cq_head=(uint32_t*)(cq+p.cq_off.head); q->cq_tail=(uint32_t*)(cq+p.cq_off.tail);
+    q->cq_mask=(uint32_t*)(cq+p.cq_off.ring_mask); q->cqes=(struct io_uring_cqe*)(cq+p.cq_off.cqes);
+    return FS_OK;
+}
+
+static int ring_enter(aio_q_t* q, uint32_t submit, uint32_t wait){
+    int n;
+    do n = (int)syscall(__NR_io_uring_enter, q->ring, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    while(n<0 && errno==EINTR);
+    return n;
+}
+
+// 在途数不超过 qd ≤ SQ 项数，SQ 不会满；提交失败时收回这一项
+static int ring_submit(aio_q_t* q, aio_req_t* r){
+    uint32_t tail = *q->sq_tail, idx = tail & *q->sq_mask;
+    struct io_uring_sqe* s = &q->sqes[idx];
+    memset(s, 0, sizeof(*s));
+    s->opcode = r->wr ? IORING_OP_WRITEV : IORING_OP_READV;
+    s->fd = r->vol->fd;
+    s->addr = (uint64_t)(uintptr_t)&r->iov;
+    s->len = 1;
+    s->off = (uint64_t)r->blk * r->vol->sb.block_size;
+    s->user_data = (uint64_t)(uintptr_t)r;
+    q->sq_array[idx] = idx;
+    __atomic_store_n(q->sq_tail, tail+1, __ATOMIC_RELEASE);
+    if(ring_enter(q, 1, 0) == 1) return FS_OK;
+    if(__atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE) == tail) __atomic_store_n(q->sq_tail, tail, __ATOMIC_RELEASE);
+    return FS_ERR;
+}
+
+// ===== 线程池 =====
+static void done_push(aio_q_t* q, aio_req_t* r){
+    pthread_mutex_lock(&q->lock);
+    r->next = NULL;
+    if(q->done_tail) q->done_tail->next = r; else q->done = r;
+    q->done_tail = r;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void* worker(void* arg){
+    struct aio_state* s = (struct aio_state*)arg;
+    pthread_mutex_lock(&s->lock);
+    for(;;){
+        while(!s->head && !s->stop) pthread_cond_wait(&s->cond, &s->lock);
+        if(!s->head) break;
+        aio_req_t* r = s->head;
+        s->head = r->next; if(!s->head) s->tail = NULL;
+        pthread_mutex_unlock(&s->lock);
+        g_vol = r->vol;             // dev_io 经 g_vol 取 fd 与块大小
+        r->res = dev_io(r->wr, r->buf, r->blk, r->cnt);
+        done_push(r->q, r);
+        pthread_mutex_lock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static int pool_submit(aio_req_t* r){
+    struct aio_state* s = r->vol->aio;
+    pthread_mutex_lock(&s->lock);
+    uint32_t want = r->vol->mopt.qd < AIO_WORKERS ? r->vol->mopt.qd : AIO_WORKERS;
+    while(s->nth < want && pthread_create(&s->th[s->nth], NULL, worker, s)==0) s->nth++;
+    int ok = s->nth > 0;
+    if(ok){
+        r->next = NULL;
+        if(s->tail) s->tail->next = r; else s->head = r;
+        s->tail = r;
+        pthread_cond_signal(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok ? FS_OK : FS_ERR;
+}
+
+int aio_vol_init(volume_t* v){
+    if(!(v->aio = calloc(1, sizeof(*v->aio)))) return FS_ERR;
+    pthread_mutex_init(&v->aio->lock, NULL);
+    pthread_cond_init(&v->aio->cond, NULL);
+    return FS_OK;
+}
+void aio_vol_free(volume_t* v){
+    struct aio_state* s = v->aio;
+    if(!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    for(uint32_t i=0;i<s->nth;i++) pthread_join(s->th[i], NULL);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s); v->aio = NULL;
+}
+
+// ===== 每线程队列 =====
+static void q_destroy(void* p){
+    aio_q_t* q = (aio_q_t*)p;
+    if(q->ring >= 0) ring_close(q);
+    while(q->free){ aio_req_t* r = q->free; q->free = r->next; free(r); }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+    free(q);
+}
+static void q_key_init(){ pthread_key_create(&q_key, q_destroy); }
+
+static aio_q_t* get_q(){
+    if(t_q) return t_q;
+    pthread_once(&q_once, q_key_init);
+    aio_q_t* q = (aio_q_t*)calloc(1, sizeof(aio_q_t));
+    if(!q) return NULL;
+    q->ring = -1;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    pthread_setspecific(q_key, q);
+    return t_q = q;
+}
+
+// 完成一个请求：io_uring 的短传输或错误（包括 O_DIRECT 被拒）同步重做一遍，再回调
+static void finish(aio_q_t* q, aio_req_t* r){
+    volume_t* save = g_vol;
+    g_vol = r->vol;
+    if(r->ring) r->res = r->res==(int)r->iov.iov_len ? FS_OK : dev_io(r->wr, r->buf, r->blk, r->cnt);
+    uint64_t dt = now_ns() - r->t0;
+    if(r->wr) STAT_ADD(r->vol, write_ns, dt); else STAT_ADD(r->vol, read_ns, dt);
+    TRACE(r->wr ? TR_DEV_WRITE : TR_DEV_READ, r->t0, r->blk, r->cnt, r->res, NULL);
+    q->inflight--;
+    if(r->res != FS_OK) t_err = 1;
+    dev_aio_cb cb = r->cb; void* arg = r->arg; int res = r->res;
+    r->next = q->free; q->free = r;
+    if(cb) cb(arg, res);
+    g_vol = save;
+}
+
+static int ring_reap(aio_q_t* q, int wait){
+    uint32_t head = *q->cq_head;
+    if(head == __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE)){
+        if(!wait || ring_enter(q, 0, 1) < 0) return 0;
+    }
+    int k = 0;
+    while(head != __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE)){
+        struct io_uring_cqe* c = &q->cqes[head & *q->cq_mask];
+        aio_req_t* r = (aio_req_t*)(uintptr_t)c->user_data;
+        r->res = c->res;
+        __atomic_store_n(q->cq_head, ++head, __ATOMIC_RELEASE);
+        q->in_ring--;
+        finish(q, r);               // 回调里可能再提交，先让出 CQ 项
+        k++;
+    }
+    return k;
+}
+
+static int pool_reap(aio_q_t* q, int wait){
+    pthread_mutex_lock(&q->lock);
+    while(wait && !q->done) pthread_cond_wait(&q->cond, &q->lock);
+    aio_req_t* list = q->done;
+    q->done = q->done_tail = NULL;
+    pthread_mutex_unlock(&q->lock);
+    int k = 0;
+    while(list){ aio_req_t* r = list; list = r->next; finish(q, r); k++; }
+    return k;
+}
+
+int dev_aio_poll(int wait){
+    aio_q_t* q = t_q;
+    if(!q || !q->inflight) return 0;
+    int k = (q->in_ring ? ring_reap(q, 0) : 0) + pool_reap(q, 0);
+    if(k || !wait) return k;
+    return q->in_ring ? ring_reap(q, 1) : pool_reap(q, 1);
+}
+
+int dev_aio_drain(){
+    while(t_q && t_q->inflight) dev_aio_poll(1);
+    int e = t_err; t_err = 0;
+    return e ? FS_ERR : FS_OK;
+}
+
+int dev_aio_async(){ return g_mopt.aio != AIO_OFF && !g_vol->map; }
+
+// ===== 提交 =====
+static int aio_sync(int wr, void* buf, uint32_t blk, uint32_t cnt, dev_aio_cb cb, void* arg){
+    int r = wr ? dev_raw_writen(buf, blk, cnt) : dev_raw_readn(buf, blk, cnt);
+    if(r != FS_OK) t_err = 1;
+    if(cb) cb(arg, r);
+    return FS_OK;
+}
+
+static int submit(int wr, void* buf, uint32_t blk, uint32_t cnt, dev_aio_cb cb, void* arg){
+    if(blk >= g_sb.blocks_count || cnt > g_sb.blocks_count-blk || g_vol->fd < 0) return FS_ERR;
+    aio_q_t* q = dev_aio_async() ? get_q() : NULL;
+    if(!q) return aio_sync(wr, buf, blk, cnt, cb, arg);
+    while(q->inflight >= g_mopt.qd) dev_aio_poll(1);
+    aio_req_t* r = q->free;
+    if(r) q->free = r->next;
+    else if(!(r = (aio_req_t*)malloc(sizeof(aio_req_t)))) return aio_sync(wr, buf, blk, cnt, cb, arg);
+    *r = (aio_req_t){ .vol=g_vol, .wr=wr, .buf=buf, .blk=blk, .cnt=cnt, .cb=cb, .arg=arg, .q=q };
+    r->iov.iov_base = buf; r->iov.iov_len = (size_t)cnt*BSIZE;
+    r->t0 = now_ns();
+    if(wr){ STAT_ADD(g_vol, writes, 1); STAT_ADD(g_vol, write_blocks, cnt); }
+    else  { STAT_ADD(g_vol, reads, 1);  STAT_ADD(g_vol, read_blocks, cnt); }
+    STAT_ADD(g_vol, async, 1);
+    q->inflight++;
+    if(q->inflight > __atomic_load_n(&g_vol->devstat.qd_max, __ATOMIC_RELAXED))
+        __atomic_store_n(&g_vol->devstat.qd_max, q->inflight, __ATOMIC_RELAXED);
+
+    // O_DIRECT 要求缓冲对齐：未对齐的交给线程池（dev_io 会经中转缓冲）
+    int aligned = !g_vol->direct || !((uintptr_t)buf & 4095u);
+    if(g_mopt.aio == AIO_URING && aligned){
+        if(q->ring == -1) ring_setup(q);
+        if(q->ring >= 0 && ring_submit(q, r) == FS_OK){
+            r->ring = 1; q->in_ring++;
+            __atomic_store_n(&g_vol->devstat.aio, AIO_URING, __ATOMIC_RELAXED);
+            return FS_OK;
+        }
+    }
+    if(pool_submit(r) == FS_OK){
+        __atomic_store_n(&g_vol->devstat.aio, AIO_THREADS, __ATOMIC_RELAXED);
+        return FS_OK;
+    }
+    r->res = dev_io(wr, buf, blk, cnt);     // 连工作线程都起不来：当场做完，照常排进完成队列
+    done_push(q, r);
+    return FS_OK;
+}
+
+int dev_aio_read(void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg){
+    return submit(0, buf, blk_no, cnt, cb, arg);
+}
+int dev_aio_write(const void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg){
+    return submit(1, (void*)buf, blk_no, cnt, cb, arg);
+}
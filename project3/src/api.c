@@ -0,0 +1,243 @@
+// src/api.c — libminiext2 对外接口（include/miniext2.h）
+// 每个入口先把 g_vol（线程局部）切到调用方的卷再调用各层；会改动状态的调用结束时检查
+// 提交点，与命令行每条命令之后做的事一样。
+// 并发：mx_read/mx_write/mx_seek 持共享卷锁，多个线程可同时读写；其余入口持独占锁。
+// 共享模式下写到一半需要独占（见 vol_defer）时，放掉共享锁、换独占锁把剩下的写完；
+// 到了提交点或延迟分配超限时同样短暂独占一次。
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+#define ENTER(v)  do{ if(!(v)) return FS_EINVAL; g_vol=(v); }while(0)
+// 独占卷执行 expr 并返回其结果
+#define EXCL(v, expr)  do{ ENTER(v); vol_lock(1); int r_=(expr); vol_unlock(); return r_; }while(0)
+
+static int leave(int r){ fs_maybe_sync(); return r; }
+
+static int maint_due(){ return fs_sync_due() || (g_mopt.delalloc && da_over()); }
+static void maint(){
+    vol_lock(1);
+    if(g_mopt.delalloc) da_balance();
+    fs_maybe_sync();
+    vol_unlock();
+}
+
+static void get_stats(mx_stats_t* out){ stats_collect(out); }
+
+// path 拆成父目录 inode 与最后一个分量；无 '/' 时父目录为当前目录
+static int split_parent(const char* path, uint32_t* parent, char name[NAME_MAX_LEN]){
+    const char* slash=strrchr(path,'/');
+    if(!slash){ *parent=g_cwd; strncpy(name,path,NAME_MAX_LEN-1); name[NAME_MAX_LEN-1]='\0'; return FS_OK; }
+    char pbuf[256]; size_t n=(size_t)(slash-path);
+    if(n>=sizeof(pbuf)) return FS_EINVAL;
+    memcpy(pbuf,path,n); pbuf[n]='\0'; if(!*pbuf) strcpy(pbuf,"/");
+    if(namei(pbuf,parent)!=FS_OK) return FS_ENOENT;
+    strncpy(name,slash+1,NAME_MAX_LEN-1); name[NAME_MAX_LEN-1]='\0';
+    return FS_OK;
+}
+
+static void fill_stat(uint32_t ino, const inode_t* in, mx_stat_t* st){
+    st->ino=ino; st->size=in->size; st->mode=in->mode; st->uid=in->uid;
+    st->atime=in->atime; st->mtime=in->mtime; st->ctime=in->ctime;
+}
+
+// ===== 卷 =====
+int mx_format(const char* img, const char* opts, uint32_t block_size, uint64_t size,
+              uint32_t inodes, uint32_t journal, mx_stats_t* st){
+    volume_t* v=vol_create();
+    if(!v) return FS_ERR;
+    g_vol=v;
+    int r = fs_parse_opts(opts)==FS_OK ? fs_format(img, block_size, size, inodes, journal) : FS_EINVAL;
+    if(st) get_stats(st);
+    vol_destroy(v);
+    return r;
+}
+
+mx_vol_t* mx_mount(const char* img, const char* opts, int* err){
+    volume_t* v=vol_create();
+    int r = v ? FS_OK : FS_ERR;
+    if(v){
+        g_vol=v;
+        if(fs_parse_opts(opts)!=FS_OK) r=FS_EINVAL;
+        else if(fs_mount(img)!=FS_OK) r=FS_ERR;
+        if(r!=FS_OK){ vol_destroy(v); v=NULL; }
+    }
+    if(err) *err=r;
+    return v;
+}
+
+int mx_unmount(mx_vol_t* v, mx_stats_t* st){
+    ENTER(v);
+    if(!st) return vol_destroy(v);
+    vol_lock(1);
+    int r=fs_unmount();
+    get_stats(st);
+    vol_unlock();
+    return vol_destroy(v)==FS_OK ? r : FS_ERR;
+}
+int mx_sync(mx_vol_t* v){ EXCL(v, fs_sync()); }
+
+void mx_info(mx_vol_t* v, mx_info_t* out){
+    if(!v || !out) return;
+    g_vol=v;
+    vol_lock(1);
+    out->block_size=g_sb.block_size; out->blocks=g_sb.blocks_count; out->groups=g_sb.groups_count;
+    out->inodes=g_sb.inodes_count; out->free_blocks=g_sb.free_blocks; out->free_inodes=g_sb.free_inodes;
+    out->atime_default=(int)g_sb.atime_mode; out->atime_effective=fs_atime_mode();
+    out->journal_start=g_sb.journal_start; out->journal_blocks=g_sb.journal_blocks;
+    out->delalloc=g_mopt.delalloc;
+    vol_unlock();
+}
+
+void mx_get_stats(mx_vol_t* v, mx_stats_t* out){
+    if(!v || !out) return;
+    g_vol=v;
+    vol_lock(1);
+    get_stats(out);
+    vol_unlock();
+}
+
+static int trace_dump(const char* path){ return g_vol->trace ? trace_export(path) : FS_EINVAL; }
+int mx_trace_dump(mx_vol_t* v, const char* path){ EXCL(v, trace_dump(path)); }
+
+static int set_atime(const char* mode){
+    int m=fs_parse_atime(mode);
+    return m ? leave(fs_set_atime_default(m)) : FS_EINVAL;
+}
+int mx_set_atime(mx_vol_t* v, const char* mode){ EXCL(v, set_atime(mode)); }
+
+// ===== 文件 =====
+int mx_open(mx_vol_t* v, const char* path, const char* mode){ EXCL(v, leave(fs_open(path, mode))); }
+int mx_close(mx_vol_t* v, int fd){ EXCL(v, fs_close(fd)); }
+int mx_dup(mx_vol_t* v, int fd, int flags){ EXCL(v, fs_dup(fd, flags)); }
+int mx_fdflags(mx_vol_t* v, int fd, int flags){ EXCL(v, fs_fdflags(fd, flags)); }
+
+int mx_read(mx_vol_t* v, int fd, void* buf, uint32_t len){
+    ENTER(v);
+    vol_lock(0);
+    int r=fs_read(fd, buf, len), due=maint_due();
+    vol_unlock();
+    if(due) maint();
+    return r;
+}
+int mx_write(mx_vol_t* v, int fd, const void* buf, uint32_t len){
+    ENTER(v);
+    vol_lock(0);
+    int r=fs_write(fd, buf, len), busy=vol_deferred(), due=!busy && maint_due();
+    vol_unlock();
+    if(busy){
+        // 已写的部分留在原处（偏移已前移），剩下的独占重做；独占的 fs_write 自己会检查提交点
+        uint32_t done = r>0 ? (uint32_t)r : 0;
+        vol_lock(1);
+        int r2=fs_write(fd, (const uint8_t*)buf+done, len-done);
+        vol_unlock();
+        r = r2<0 ? (done ? (int)done : r2) : (int)(done+(uint32_t)r2);
+    }else if(due) maint();
+    return r;
+}
+int mx_seek(mx_vol_t* v, int fd, int32_t off){
+    ENTER(v);
+    vol_lock(0);
+    int r=fs_seek(fd, off);
+    vol_unlock();
+    return r;
+}
+
+// ===== 名字空间 =====
+static int do_mkdir(const char* path){
+    uint32_t parent; char name[NAME_MAX_LEN];
+    int r=split_parent(path, &parent, name); if(r!=FS_OK) return r;
+    int ino=alloc_inode(); if(ino<0) return FS_ENOSPC;
+    inode_t in={0}; in.mode=MODE_DIR; in.links=2; in.uid=(uint16_t)g_uid;
+    ts_now(&in.ctime); ts_now(&in.mtime); ts_now(&in.atime);
+    write_inode((uint32_t)ino,&in);
+    dir_add((uint32_t)ino, ".", FT_DIR, (uint32_t)ino);
+    dir_add((uint32_t)ino, "..", FT_DIR, parent);
+    return leave(dir_add(parent,name,FT_DIR,(uint32_t)ino)==FS_OK ? FS_OK : FS_ERR);
+}
+static int mkdir_traced(const char* path){
+    uint64_t t0=TRACE_T0(); int r=do_mkdir(path);
+    TRACE(TR_MKDIR, t0, 0, 0, r, path);
+    return r;
+}
+int mx_mkdir(mx_vol_t* v, const char* path){ EXCL(v, mkdir_traced(path)); }
+
+static int do_unlink(const char* path){
+    uint32_t ino; if(namei(path,&ino)!=FS_OK) return FS_ENOENT;
+    inode_t in; if(read_inode(ino,&in)!=FS_OK) return FS_ERR;
+    if((in.mode & 0170000)==0040000 && in.size>2*sizeof(dirent_t)) return FS_ENOTEMPTY;
+    uint32_t parent; char name[NAME_MAX_LEN];
+    int r=split_parent(path, &parent, name); if(r!=FS_OK) return r;
+    if(!inode_orphan(ino)){ inode_truncate(ino); free_inode(ino); }   // 仍被打开：最后关闭时释放
+    dir_remove(parent, name);
+    return leave(FS_OK);
+}
+static int unlink_traced(const char* path){
+    uint64_t t0=TRACE_T0(); int r=do_unlink(path);
+    TRACE(TR_UNLINK, t0, 0, 0, r, path);
+    return r;
+}
+int mx_unlink(mx_vol_t* v, const char* path){ EXCL(v, unlink_traced(path)); }
+
+static int do_chdir(const char* path){
+    uint32_t ino; if(namei(path,&ino)!=FS_OK) return FS_ENOENT;
+    g_cwd=ino;
+    return FS_OK;
+}
+int mx_chdir(mx_vol_t* v, const char* path){ EXCL(v, do_chdir(path)); }
+
+static int do_chmod(const char* path, uint32_t mode){
+    uint32_t ino; if(namei(path,&ino)!=FS_OK) return FS_ENOENT;
+    inode_t in; if(read_inode(ino,&in)!=FS_OK) return FS_ERR;
+    if(g_uid!=0 && in.uid!=g_uid) return FS_EPERM;
+    in.mode = (uint16_t)((in.mode & 0170000) | (mode & 0777));
+    ts_now(&in.ctime);
+    return leave(write_inode(ino,&in));
+}
+int mx_chmod(mx_vol_t* v, const char* path, uint32_t mode){ EXCL(v, do_chmod(path, mode)); }
+
+static int do_stat(const char* path, mx_stat_t* out){
+    uint32_t ino; if(namei(path,&ino)!=FS_OK) return FS_ENOENT;
+    inode_t in; if(read_inode(ino,&in)!=FS_OK) return FS_ERR;
+    if(out) fill_stat(ino, &in, out);
+    return FS_OK;
+}
+int mx_stat(mx_vol_t* v, const char* path, mx_stat_t* out){ EXCL(v, do_stat(path, out)); }
+
+// 回调在独占卷锁内执行，不能再调用本卷的 mx_* 函数
+static int do_readdir(const char* path, mx_dirent_cb cb, void* arg){
+    uint32_t ino;
+    if(path && *path){ if(namei(path,&ino)!=FS_OK) return FS_ENOENT; }
+    else ino = g_cwd;
+    inode_t din;
+    if(read_inode(ino,&din)!=FS_OK) return FS_ERR;
+    if((din.mode & 0170000) != 0040000) return FS_ENOTDIR;
+
+    uint32_t n = din.size/sizeof(dirent_t);
+    uint8_t blk[BLOCK_SIZE_MAX];
+    dirent_t de;
+    for(uint32_t i=0;i<n;i++){
+        uint32_t bn=(i*sizeof(dirent_t))/BSIZE, off=(i*sizeof(dirent_t))%BSIZE;
+        int phys=map_bn_for_read(&din, bn);
+        if(phys<0) continue;
+        if(dev_read_block(blk,(uint32_t)phys)!=FS_OK) continue;
+        memcpy(&de, blk+off, sizeof(de));
+        if(de.ino==0) continue;
+        inode_t child; if(read_inode(de.ino,&child)!=FS_OK) continue;
+        mx_stat_t st; fill_stat(de.ino, &child, &st);
+        if(cb && cb(arg, de.name, de.file_type==FT_DIR, &st)) break;
+    }
+    return FS_OK;
+}
+int mx_readdir(mx_vol_t* v, const char* path, mx_dirent_cb cb, void* arg){ EXCL(v, do_readdir(path, cb, arg)); }
+
+// ===== 账号与会话 =====
+int mx_login(mx_vol_t* v, const char* user, const char* pass){ EXCL(v, leave(users_login(user, pass))); }
+int mx_useradd(mx_vol_t* v, const char* user, const char* pass){ EXCL(v, leave(users_add(user, pass))); }
+int mx_passwd(mx_vol_t* v, const char* user, const char* pass){ EXCL(v, leave(users_change_password(user, pass))); }
+
+static int whoami(char* user, uint32_t len){
+    if(user && len){ strncpy(user, g_user, len-1); user[len-1]='\0'; }
+    return g_uid;
+}
+int mx_whoami(mx_vol_t* v, char* user, uint32_t len){ EXCL(v, whoami(user, len)); }
@@ -1,68 +1,320 @@
 #include <string.h>
+#include <stdlib.h>
 #include "fs.h"
 
-static int bitop(uint8_t* bm, uint32_t idx, int set, int val){
-    uint32_t byte = idx>>3, bit=idx&7;
-    if(set){
-        if(val) bm[byte]|=(1u<<bit); else bm[byte]&=~(1u<<bit);
-        return 0;
-    }else{
-        return (bm[byte]>>bit)&1u;
+// 每个块组一个块位图块 + 一个 inode 位图块，挂载时全部读入内存，按 64 位字保存；
+// 分配只改内存并把该组置脏，由 bitmap_sync（fs_sync / 卸载）写回脏组。位序与磁盘一致：
+// 第 i 位 = 字节 i>>3 的第 i&7 位（小端主机上即字 i>>6 的第 i&63 位）。
+// 组内位号：块为 blk - g*blocks_per_group；inode 为 (ino-1)%inodes_per_group + 1
+// （第 0 位不用，单组时与旧版“位号即 inode 号”一致）。
+// 分配器锁保护位图、游标、预留与待释放表，以及超级块/组描述符里的空闲计数：
+// 持共享卷锁写不同文件的线程会同时分配。对外函数加锁后调用同名的 *_l 版本。
+#define BM_BLK_DIRTY 1u
+#define BM_INO_DIRTY 2u
+
+struct bitmap_state {
+    uint64_t *blk, *ino;        // groups_count 段，每段 words 个字
+    uint8_t  *dirty;            // 每组 BM_*_DIRTY
+    uint32_t words;
+    int loaded;
+    uint32_t blk_cursor, ino_cursor;    // next-fit：从上次分配处继续找（绝对块号 / inode 号）
+    uint32_t reserved;          // 延迟分配预留的块数：普通分配不得动用
+    uint32_t* pending;          // 有日志时本事务释放的块：提交前不清位、不复用
+    uint32_t npending, cap_pending;
+    uint32_t scan;              // 本次分配扫描过的位图字数（统计用）
+    pthread_mutex_t lock;
+};
+#define bm (*g_vol->bitmap)
+
+int bitmap_vol_init(volume_t* v){
+    if(!(v->bitmap=calloc(1, sizeof(*v->bitmap)))) return FS_ERR;
+    pthread_mutex_init(&v->bitmap->lock, NULL);
+    return FS_OK;
+}
+void bitmap_vol_free(volume_t* v){
+    if(v->bitmap) pthread_mutex_destroy(&v->bitmap->lock);
+    free(v->bitmap); v->bitmap=NULL;
+}
+
+static inline uint64_t* bbits(uint32_t g){ return bm.blk + (size_t)g*bm.words; }
+static inline uint64_t* ibits(uint32_t g){ return bm.ino + (size_t)g*bm.words; }
+
+uint32_t group_len(uint32_t g){
+    uint32_t left = g_sb.blocks_count - g*g_sb.blocks_per_group;
+    return left < g_sb.blocks_per_group ? left : g_sb.blocks_per_group;
+}
+uint32_t group_meta_end(uint32_t g){ return g_gdt[g].inode_table + g_sb.itbl_blocks; }
+
+void bitmap_unload(){
+    free(bm.blk); free(bm.ino); free(bm.dirty); free(bm.pending);
+    pthread_mutex_t keep=bm.lock;
+    memset(&bm, 0, sizeof(bm));
+    bm.lock=keep;
+}
+
+int bitmap_load(){
+    bitmap_unload();
+    uint32_t ng=g_sb.groups_count;
+    bm.words = BSIZE*8u/64u;
+    bm.blk = calloc((size_t)ng*bm.words, sizeof(uint64_t));
+    bm.ino = calloc((size_t)ng*bm.words, sizeof(uint64_t));
+    bm.dirty = calloc(ng, 1);
+    if(!bm.blk || !bm.ino || !bm.dirty){ bitmap_unload(); return FS_ERR; }
+    for(uint32_t g=0; g<ng; g++){
+        if(dev_read_block(bbits(g), g_gdt[g].block_bitmap)!=FS_OK ||
+           dev_read_block(ibits(g), g_gdt[g].inode_bitmap)!=FS_OK){ bitmap_unload(); return FS_ERR; }
     }
+    bm.blk_cursor=group_meta_end(0); bm.ino_cursor=1;
+    bm.loaded=1;
+    return FS_OK;
+}
+int bitmap_sync(){
+    if(!bm.loaded) return FS_OK;
+    for(uint32_t g=0; g<g_sb.groups_count; g++){
+        if(!bm.dirty[g]) continue;
+        if((bm.dirty[g]&BM_BLK_DIRTY) && dev_write_meta(bbits(g), g_gdt[g].block_bitmap)!=FS_OK) return FS_ERR;
+        if((bm.dirty[g]&BM_INO_DIRTY) && dev_write_meta(ibits(g), g_gdt[g].inode_bitmap)!=FS_OK) return FS_ERR;
+        bm.dirty[g]=0;
+    }
+    return FS_OK;
 }
 
-int bmap_test(uint32_t idx, int is_block){
-    uint8_t buf[BLOCK_SIZE];
-    dev_read_block(buf, is_block? g_sb.block_bitmap_blk : g_sb.inode_bitmap_blk);
-    return bitop(buf, idx, 0, 0);
-}
-int bmap_set(uint32_t idx, int is_block, int val){
-    uint8_t buf[BLOCK_SIZE];
-    dev_read_block(buf, is_block? g_sb.block_bitmap_blk : g_sb.inode_bitmap_blk);
-    bitop(buf, idx, 1, val);
-    return dev_write_block(buf, is_block? g_sb.block_bitmap_blk : g_sb.inode_bitmap_blk);
-}
-
-int alloc_block(){
-    uint8_t bm[BLOCK_SIZE];
-    if(dev_read_block(bm, g_sb.block_bitmap_blk)!=FS_OK) return FS_ERR;
-    for(uint32_t i=BLK_DATA_START;i<TOTAL_BLOCKS;i++){
-        if(!((bm[i>>3]>>(i&7))&1u)){
-            bm[i>>3] |= (1u<<(i&7));
-            if(dev_write_block(bm, g_sb.block_bitmap_blk)!=FS_OK) return FS_ERR;
-            g_sb.free_blocks--; dev_write_block(&g_sb, BLK_SUPER);
-            g_gd.free_blocks_count--; dev_write_block(&g_gd, BLK_GDESC);
-            return (int)i;
+static uint32_t bitmap_dirty_l(){
+    if(!bm.loaded) return 0;
+    uint32_t n=0;
+    for(uint32_t g=0; g<g_sb.groups_count; g++) n += !!(bm.dirty[g]&BM_BLK_DIRTY) + !!(bm.dirty[g]&BM_INO_DIRTY);
+    // 待释放的块还会弄脏它们所在组的块位图
+    uint32_t p = bm.npending < g_sb.groups_count ? bm.npending : g_sb.groups_count;
+    return n + p;
+}
+
+static inline int  bit_get(const uint64_t* w, uint32_t i){ return (int)((w[i>>6]>>(i&63))&1u); }
+static inline void bit_put(uint64_t* w, uint32_t i, int v){
+    if(v) w[i>>6] |= (1ull<<(i&63)); else w[i>>6] &= ~(1ull<<(i&63));
+}
+
+// 用 popcount 统计已用位数（挂载时校验空闲计数）
+static uint32_t count_ones(const uint64_t* w, uint32_t lo, uint32_t hi){
+    uint32_t n=0, i=lo;
+    for(; i<hi && (i&63); i++) n += (uint32_t)bit_get(w, i);
+    for(; i+64<=hi; i+=64)     n += (uint32_t)__builtin_popcountll(w[i>>6]);
+    for(; i<hi; i++)           n += (uint32_t)bit_get(w, i);
+    return n;
+}
+void bitmap_count_group(uint32_t g, uint32_t* free_blocks, uint32_t* free_inodes){
+    uint32_t len=group_len(g), ipg=g_sb.inodes_per_group;
+    if(free_blocks) *free_blocks = len - count_ones(bbits(g), 0, len);
+    if(free_inodes) *free_inodes = ipg - count_ones(ibits(g), 1, ipg+1);
+}
+void bitmap_count_free(uint32_t* free_blocks, uint32_t* free_inodes){
+    uint32_t fb=0, fi=0;
+    for(uint32_t g=0; g<g_sb.groups_count; g++){
+        uint32_t b, i; bitmap_count_group(g, &b, &i); fb+=b; fi+=i;
+    }
+    if(free_blocks) *free_blocks=fb;
+    if(free_inodes) *free_inodes=fi;
+}
+
+// 在 [from, to) 内找第一个 0 位：整字取反后用 ctz 定位
+static int64_t scan_zero(const uint64_t* w, uint32_t from, uint32_t to){
+    while(from<to){
+        uint32_t wi=from>>6;
+        bm.scan++;
+        uint64_t free = ~w[wi] & (~0ull << (from&63));
+        if(free){
+            uint32_t i=(wi<<6) + (uint32_t)__builtin_ctzll(free);
+            return i<to ? (int64_t)i : -1;
         }
+        from=(wi+1)<<6;
+    }
+    return -1;
+}
+// 从 start 找到 hi，再回绕 [lo, start)
+static int64_t find_zero(const uint64_t* w, uint32_t lo, uint32_t hi, uint32_t start){
+    if(start<lo || start>=hi) start=lo;
+    int64_t r=scan_zero(w, start, hi);
+    return r>=0 ? r : scan_zero(w, lo, start);
+}
+
+// 块号 / inode 号 → (组, 组内位号)；越界返回 -1
+static int locate(uint32_t idx, int is_block, uint32_t* bit){
+    if(is_block){
+        if(idx>=g_sb.blocks_count) return -1;
+        uint32_t g=GROUP_OF_BLK(idx);
+        if(g>=g_sb.groups_count || idx-g*g_sb.blocks_per_group>=group_len(g)) return -1;
+        *bit=idx-g*g_sb.blocks_per_group;
+        return (int)g;
+    }
+    if(idx==0 || idx>g_sb.inodes_count) return -1;
+    *bit=(idx-1)%g_sb.inodes_per_group+1;
+    return (int)GROUP_OF_INO(idx);
+}
+
+static int bmap_test_l(uint32_t idx, int is_block){
+    uint32_t bit; int g=locate(idx, is_block, &bit);
+    if(g<0 || !bm.loaded) return 1;
+    return bit_get(is_block? bbits((uint32_t)g) : ibits((uint32_t)g), bit);
+}
+static int bmap_set_l(uint32_t idx, int is_block, int val){
+    uint32_t bit; int g=locate(idx, is_block, &bit);
+    if(g<0 || !bm.loaded) return FS_ERR;
+    if(is_block){ bit_put(bbits((uint32_t)g), bit, val); bm.dirty[g]|=BM_BLK_DIRTY; }
+    else        { bit_put(ibits((uint32_t)g), bit, val); bm.dirty[g]|=BM_INO_DIRTY; }
+    return FS_OK;
+}
+
+
+// 预留只是计数：空闲块数扣掉预留量后仍够才成功，位图不变
+static int block_reserve_l(uint32_t n){
+    if(!bm.loaded) return FS_ERR;
+    if(g_sb.free_blocks < bm.reserved || g_sb.free_blocks - bm.reserved < n) return FS_ENOSPC;
+    bm.reserved += n;
+    return FS_OK;
+}
+static void block_unreserve_l(uint32_t n){ bm.reserved = n < bm.reserved ? bm.reserved - n : 0; }
+
+// 优先分配 goal（通常是文件上一块的物理后继），以便 extent 连续增长；goal=0 用 next-fit 游标。
+// 先在 goal 所在组内回绕查找，再依次看后面的组；空闲计数为 0 的组直接跳过
+static int alloc_block_goal_l(uint32_t goal){
+    if(!bm.loaded) return FS_ERR;
+    if(g_sb.free_blocks <= bm.reserved) return FS_ENOSPC;
+    uint32_t start = (goal && goal<g_sb.blocks_count) ? goal : bm.blk_cursor;
+    if(start>=g_sb.blocks_count) start=0;
+    uint32_t ng=g_sb.groups_count, g0=GROUP_OF_BLK(start);
+    for(uint32_t k=0; k<ng; k++){
+        uint32_t g=(g0+k)%ng, base=g*g_sb.blocks_per_group;
+        if(!g_gdt[g].free_blocks_count) continue;
+        int64_t i=find_zero(bbits(g), group_meta_end(g)-base, group_len(g), k? 0 : start-base);
+        if(i<0) continue;
+        bit_put(bbits(g), (uint32_t)i, 1); bm.dirty[g]|=BM_BLK_DIRTY;
+        uint32_t blk=base+(uint32_t)i;
+        bm.blk_cursor=blk+1;
+        g_sb.free_blocks--; g_gdt[g].free_blocks_count--; sb_mark_dirty();
+        return (int)blk;
     }
     return FS_ENOSPC;
 }
-void free_block(uint32_t blk){
-    if(blk<BLK_DATA_START || blk>=TOTAL_BLOCKS) return;
-    if(bmap_test(blk,1)==0) return;
-    bmap_set(blk,1,0);
-    g_sb.free_blocks++; dev_write_block(&g_sb, BLK_SUPER);
-    g_gd.free_blocks_count++; dev_write_block(&g_gd, BLK_GDESC);
-}
-
-int alloc_inode(){
-    uint8_t bm[BLOCK_SIZE];
-    if(dev_read_block(bm, g_sb.inode_bitmap_blk)!=FS_OK) return FS_ERR;
-    for(uint32_t i=1;i<=MAX_INODES;i++){
-        if(!((bm[i>>3]>>(i&7))&1u)){
-            bm[i>>3] |= (1u<<(i&7));
-            if(dev_write_block(bm, g_sb.inode_bitmap_blk)!=FS_OK) return FS_ERR;
-            g_sb.free_inodes--; dev_write_block(&g_sb, BLK_SUPER);
-            g_gd.free_inodes_count--; dev_write_block(&g_gd, BLK_GDESC);
-            return (int)i;
+
+// 在 [from, to) 内找第一个 1 位，没有则返回 to
+static uint32_t scan_one(const uint64_t* w, uint32_t from, uint32_t to){
+    while(from<to){
+        uint32_t wi=from>>6;
+        bm.scan++;
+        uint64_t used = w[wi] & (~0ull << (from&63));
+        if(used){
+            uint32_t i=(wi<<6) + (uint32_t)__builtin_ctzll(used);
+            return i<to ? i : to;
         }
+        from=(wi+1)<<6;
+    }
+    return to;
+}
+
+// 一次分配一段连续块（延迟分配刷盘用）：从 goal 起找第一段长度 >= want 的空闲区，
+// 找遍各组都没有就取见到的最长一段。返回起始块号，*got 为实际块数（1..want）。
+// 一段不跨组；调用方应先 block_unreserve 掉自己的预留
+static int alloc_block_run_l(uint32_t goal, uint32_t want, uint32_t* got){
+    if(!bm.loaded || !want) return FS_ERR;
+    if(g_sb.free_blocks <= bm.reserved) return FS_ENOSPC;
+    if(want > g_sb.free_blocks - bm.reserved) want = g_sb.free_blocks - bm.reserved;
+    uint32_t start = (goal && goal<g_sb.blocks_count) ? goal : bm.blk_cursor;
+    if(start>=g_sb.blocks_count) start=0;
+    uint32_t ng=g_sb.groups_count, g0=GROUP_OF_BLK(start);
+    uint32_t best_g=0, best_i=0, best_n=0;
+    for(uint32_t k=0; k<=ng && best_n<want; k++){       // k==ng：回到起始组看 start 之前的部分
+        uint32_t g=(g0+k)%ng, base=g*g_sb.blocks_per_group;
+        if(!g_gdt[g].free_blocks_count) continue;
+        uint32_t from=group_meta_end(g)-base, to=group_len(g);
+        if(k==0 && start-base>from) from=start-base;
+        if(k==ng){ if(start-base<to) to=start-base; }
+        while(from<to && best_n<want){
+            int64_t i=scan_zero(bbits(g), from, to); if(i<0) break;
+            uint32_t lim = to-(uint32_t)i > want ? (uint32_t)i+want : to;
+            uint32_t j=scan_one(bbits(g), (uint32_t)i, lim);
+            if(j-(uint32_t)i > best_n){ best_g=g; best_i=(uint32_t)i; best_n=j-(uint32_t)i; }
+            from=j;
+        }
+    }
+    if(!best_n) return FS_ENOSPC;
+    for(uint32_t i=0;i<best_n;i++) bit_put(bbits(best_g), best_i+i, 1);
+    bm.dirty[best_g]|=BM_BLK_DIRTY;
+    uint32_t blk=best_g*g_sb.blocks_per_group+best_i;
+    bm.blk_cursor=blk+best_n;
+    g_sb.free_blocks-=best_n; g_gdt[best_g].free_blocks_count-=best_n; sb_mark_dirty();
+    *got=best_n;
+    return (int)blk;
+}
+
+// 有日志时，本事务释放的块若立刻复用为数据块并写回原位，崩溃后重放上一事务
+// 会看到它仍是原来的目录块/间接表却内容已变。所以先记下，提交前再统一清位
+static void release_block(uint32_t blk){
+    uint32_t bit; int g=locate(blk, 1, &bit);
+    if(g<0 || !bit_get(bbits((uint32_t)g), bit)) return;
+    bit_put(bbits((uint32_t)g), bit, 0); bm.dirty[g]|=BM_BLK_DIRTY;
+    g_sb.free_blocks++; g_gdt[g].free_blocks_count++; sb_mark_dirty();
+}
+static void bitmap_release_pending_l(){
+    for(uint32_t i=0;i<bm.npending;i++) release_block(bm.pending[i]);
+    bm.npending=0;
+}
+
+static void free_block_l(uint32_t blk){
+    uint32_t bit; int g=locate(blk, 1, &bit);
+    if(g<0 || !bm.loaded || blk<group_meta_end((uint32_t)g)) return;
+    if(!bit_get(bbits((uint32_t)g), bit)) return;
+    if(journal_active()){
+        if(bm.npending==bm.cap_pending){
+            uint32_t nc=bm.cap_pending? bm.cap_pending*2 : 256;
+            uint32_t* p=(uint32_t*)realloc(bm.pending, nc*sizeof(uint32_t));
+            if(!p){ release_block(blk); return; }
+            bm.pending=p; bm.cap_pending=nc;
+        }
+        bm.pending[bm.npending++]=blk;
+        return;
+    }
+    release_block(blk);
+}
+
+static int alloc_inode_l(){
+    if(!bm.loaded) return FS_ERR;
+    uint32_t ipg=g_sb.inodes_per_group, ng=g_sb.groups_count;
+    uint32_t cur=(bm.ino_cursor && bm.ino_cursor<=g_sb.inodes_count) ? bm.ino_cursor : 1;
+    uint32_t g0=GROUP_OF_INO(cur);
+    for(uint32_t k=0; k<ng; k++){
+        uint32_t g=(g0+k)%ng;
+        if(!g_gdt[g].free_inodes_count) continue;
+        int64_t i=find_zero(ibits(g), 1, ipg+1, k? 1 : (cur-1)%ipg+1);
+        if(i<0) continue;
+        bit_put(ibits(g), (uint32_t)i, 1); bm.dirty[g]|=BM_INO_DIRTY;
+        uint32_t ino=g*ipg+(uint32_t)i;
+        bm.ino_cursor=ino+1;
+        g_sb.free_inodes--; g_gdt[g].free_inodes_count--; sb_mark_dirty();
+        return (int)ino;
     }
     return FS_ENOSPC;
 }
-void free_inode(uint32_t ino){
-    if(ino==0 || ino>MAX_INODES) return;
-    if(bmap_test(ino,0)==0) return;
-    bmap_set(ino,0,0);
-    g_sb.free_inodes++; dev_write_block(&g_sb, BLK_SUPER);
-    g_gd.free_inodes_count++; dev_write_block(&g_gd, BLK_GDESC);
+static void free_inode_l(uint32_t ino){
+    uint32_t bit; int g=locate(ino, 0, &bit);
+    if(g<0 || !bm.loaded) return;
+    if(!bit_get(ibits((uint32_t)g), bit)) return;
+    bit_put(ibits((uint32_t)g), bit, 0); bm.dirty[g]|=BM_INO_DIRTY;
+    g_sb.free_inodes++; g_gdt[g].free_inodes_count++; sb_mark_dirty();
 }
+
+// ---- 对外接口：持分配器锁调用 *_l ----
+#define LOCKED(expr) do{ pthread_mutex_lock(&bm.lock); expr; pthread_mutex_unlock(&bm.lock); }while(0)
+uint32_t bitmap_dirty(){ uint32_t n; LOCKED(n=bitmap_dirty_l()); return n; }
+int bmap_test(uint32_t idx, int is_block){ int r; LOCKED(r=bmap_test_l(idx, is_block)); return r; }
+int bmap_set(uint32_t idx, int is_block, int val){ int r; LOCKED(r=bmap_set_l(idx, is_block, val)); return r; }
+int block_reserve(uint32_t n){ int r; LOCKED(r=block_reserve_l(n)); return r; }
+void block_unreserve(uint32_t n){ LOCKED(block_unreserve_l(n)); }
+// 块分配计时（含等锁）并记下扫描长度
+#define ALLOC(expr, goal, want) do{ uint64_t t0_=now_ns(); LOCKED(bm.scan=0; r=(expr); stat_scan(bm.scan)); \
+    stat_op(MX_OP_ALLOC_BLOCK, t0_, r); TRACE(TR_ALLOC, t0_, goal, want, r, NULL); }while(0)
+int alloc_block(){ int r; ALLOC(alloc_block_goal_l(0), 0, 1); return r; }
+int alloc_block_goal(uint32_t goal){ int r; ALLOC(alloc_block_goal_l(goal), goal, 1); return r; }
+int alloc_block_run(uint32_t goal, uint32_t want, uint32_t* got){ int r; ALLOC(alloc_block_run_l(goal, want, got), goal, want); return r; }
+void bitmap_release_pending(){ LOCKED(bitmap_release_pending_l()); }
+void free_block(uint32_t blk){ LOCKED(free_block_l(blk)); }
+int alloc_inode(){ int r; LOCKED(r=alloc_inode_l()); return r; }
+void free_inode(uint32_t ino){ LOCKED(free_inode_l(ino)); }
@@ -0,0 +1,293 @@
+// src/cache.c — 设备层之下的块缓冲缓存：哈希查找 + LRU 淘汰 + 写回
+// 一把互斥锁保护整个缓存。单块读缺失、淘汰写回在锁内做；多块直读/直写与预读的宿主机
+// I/O 放在锁外，持共享卷锁的线程读写不同文件时不会在这里排队。
+// 刷盘和预读经 dev_aio_*：aio 打开时多个请求同时在途，关闭时就是逐个同步读写。
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+// 缓存按字节定容：缓冲个数 = BC_BYTES / 块大小（512B 块 2048 个，4KB 块 256 个）
+#define BC_BYTES   (1u<<20)
+#define BC_MAXBUF  (BC_BYTES/BLOCK_SIZE_MIN)
+#define BC_NHASH   1024u   // 哈希桶个数（2 的幂）
+
+typedef struct buf {
+    uint32_t blk;
+    int valid, dirty;
+    struct buf* hnext;          // 哈希链
+    struct buf* prev;           // LRU 双链（lru.next = 最近使用）
+    struct buf* next;
+    uint8_t* data;              // 指向 arena 中的一块
+} buf_t;
+
+#define BC_RA_BYTES  (128u<<10)      // 预读一次宿主机读取的上限
+
+typedef struct {
+    buf_t  pool[BC_MAXBUF];
+    uint32_t nbuf;
+    buf_t* hash[BC_NHASH];
+    buf_t  lru;                 // 哨兵
+    int    inited;
+    bcache_stats_t st;
+} bcache_t;
+
+// 每卷一份；整块按 4KB 对齐分配，arena 在最前面，O_DIRECT 可直接读写缓冲
+struct bcache_state {
+    uint8_t  arena[BC_BYTES];
+    buf_t*   dirty[BC_MAXBUF];  // bcache_flush 排序用
+    bcache_t c;
+    pthread_mutex_t lock;
+};
+#define bc     (g_vol->bcache->c)
+#define arena  (g_vol->bcache->arena)
+#define LOCK()   pthread_mutex_lock(&g_vol->bcache->lock)
+#define UNLOCK() pthread_mutex_unlock(&g_vol->bcache->lock)
+
+int bcache_vol_init(volume_t* v){
+    void* p=NULL;
+    if(posix_memalign(&p, 4096, sizeof(struct bcache_state))!=0) return FS_ERR;
+    memset(p, 0, sizeof(struct bcache_state));
+    v->bcache=(struct bcache_state*)p;
+    pthread_mutex_init(&v->bcache->lock, NULL);
+    return FS_OK;
+}
+void bcache_vol_free(volume_t* v){
+    if(v->bcache) pthread_mutex_destroy(&v->bcache->lock);
+    free(v->bcache); v->bcache=NULL;
+}
+
+static inline uint32_t bhash(uint32_t blk){ return (blk * 2654435761u) & (BC_NHASH-1); }
+
+static void lru_unlink(buf_t* b){ b->prev->next=b->next; b->next->prev=b->prev; }
+static void lru_push_front(buf_t* b){
+    b->next=bc.lru.next; b->prev=&bc.lru;
+    bc.lru.next->prev=b; bc.lru.next=b;
+}
+
+static void hash_remove(buf_t* b){
+    buf_t** pp=&bc.hash[bhash(b->blk)];
+    while(*pp && *pp!=b) pp=&(*pp)->hnext;
+    if(*pp) *pp=b->hnext;
+    b->hnext=NULL;
+}
+
+// 按当前卷的块大小切分 arena；卸载时 bcache_invalidate 清掉 inited，下次挂载重新切分
+static void bcache_init(){
+    memset(&bc,0,sizeof(bc));
+    bc.lru.next=bc.lru.prev=&bc.lru;
+    bc.nbuf=BC_BYTES/BSIZE;
+    for(uint32_t i=0;i<bc.nbuf;i++){ bc.pool[i].data=arena+(size_t)i*BSIZE; lru_push_front(&bc.pool[i]); }
+    bc.inited=1;
+}
+
+static buf_t* lookup(uint32_t blk){
+    for(buf_t* b=bc.hash[bhash(blk)]; b; b=b->hnext)
+        if(b->valid && b->blk==blk) return b;
+    return NULL;
+}
+
+// 取 LRU 尾部作为牺牲块；脏块先写回
+static buf_t* victim(){
+    buf_t* b=bc.lru.prev;
+    if(b->valid){
+        if(b->dirty){
+            if(dev_raw_write(b->data, b->blk)!=FS_OK) return NULL;
+            b->dirty=0; bc.st.writebacks++;
+        }
+        hash_remove(b); b->valid=0; bc.st.evictions++;
+    }
+    return b;
+}
+
+static buf_t* install(buf_t* b, uint32_t blk){
+    b->blk=blk; b->valid=1; b->dirty=0;
+    uint32_t h=bhash(blk); b->hnext=bc.hash[h]; bc.hash[h]=b;
+    return b;
+}
+
+static buf_t* bget(uint32_t blk){
+    if(!bc.inited) bcache_init();
+    buf_t* b=lookup(blk);
+    if(b){ bc.st.hits++; }
+    else{
+        bc.st.misses++;
+        if(!(b=victim())) return NULL;
+        if(dev_raw_read(b->data, blk)!=FS_OK) return NULL;
+        install(b, blk);
+    }
+    lru_unlink(b); lru_push_front(b);
+    return b;
+}
+
+int bcache_read(void* buf, uint32_t blk){
+    LOCK();
+    buf_t* b=bget(blk);
+    if(b) memcpy(buf, b->data, BSIZE);
+    UNLOCK();
+    return b ? FS_OK : FS_ERR;
+}
+
+// 直接借出缓存块的只读指针（下一次 dev_* 调用前有效；仅在独占卷时使用）
+const void* bcache_peek(uint32_t blk){
+    LOCK();
+    buf_t* b=bget(blk);
+    UNLOCK();
+    return b ? b->data : NULL;
+}
+
+int bcache_write(const void* buf, uint32_t blk){
+    LOCK();
+    if(!bc.inited) bcache_init();
+    buf_t* b=lookup(blk);
+    if(b){ bc.st.hits++; }
+    else{
+        // 整块覆盖写，无需先读盘
+        bc.st.misses++;
+        if(!(b=victim())){ UNLOCK(); return FS_ERR; }
+        install(b, blk);
+    }
+    memcpy(b->data, buf, BSIZE);
+    b->dirty=1;
+    lru_unlink(b); lru_push_front(b);
+    UNLOCK();
+    return FS_OK;
+}
+
+// 预读：缓存里没有的连续块合成一次读请求，读完后逐块装入（干净块，放在 LRU 前端）。
+// 请求异步执行时 bcache_readahead 只负责提交，装入发生在调用方之后的 dev_aio_drain 里
+// （fs_read 读完本次数据再收割，预读与本次读重叠）；期间被别人装入的块以缓存里的为准
+typedef struct { uint32_t blk, n; uint8_t* data; } ra_req_t;
+
+static void ra_done(void* arg, int res){
+    ra_req_t* q=(ra_req_t*)arg;
+    if(res==FS_OK){
+        LOCK();
+        for(uint32_t k=0; k<q->n; k++){
+            if(lookup(q->blk+k)) continue;
+            buf_t* b=victim(); if(!b) break;
+            install(b, q->blk+k);
+            memcpy(b->data, q->data+(size_t)k*BSIZE, BSIZE);
+            lru_unlink(b); lru_push_front(b);
+            bc.st.readahead++;
+        }
+        UNLOCK();
+    }
+    free(q->data); free(q);
+}
+
+int bcache_readahead(uint32_t blk, uint32_t n){
+    uint32_t max=BC_RA_BYTES/BSIZE;
+    int r=FS_OK;
+    LOCK();
+    if(!bc.inited) bcache_init();
+    for(uint32_t i=0; i<n; ){
+        if(lookup(blk+i)){ i++; continue; }
+        uint32_t j=i+1;
+        while(j<n && j-i<max && !lookup(blk+j)) j++;
+        UNLOCK();
+        ra_req_t* q=(ra_req_t*)malloc(sizeof(ra_req_t)); void* p=NULL;
+        if(!q || posix_memalign(&p, 4096, (size_t)(j-i)*BSIZE)!=0){ free(q); return FS_ERR; }
+        *q=(ra_req_t){ blk+i, j-i, (uint8_t*)p };
+        if(dev_aio_read(q->data, q->blk, q->n, ra_done, q)!=FS_OK){ free(p); free(q); r=FS_ERR; }
+        LOCK();
+        i=j;
+    }
+    UNLOCK();
+    return r;
+}
+
+// 多块直读：缓存副本（可能比盘上新）在锁内拷出，其余的连续段在锁外各一次读盘。
+// 这些块若此刻不在缓存里，盘上就是最新的：同一文件的写者被 inode 锁挡在外面
+int bcache_readn(void* buf, uint32_t blk, uint32_t n){
+    uint8_t hit[8192]; uint32_t nhit=0;
+    if(n>sizeof(hit)){         // 超长请求拆开，标记数组放在栈上
+        for(uint32_t i=0;i<n;i+=(uint32_t)sizeof(hit)){
+            uint32_t k = n-i < sizeof(hit) ? n-i : (uint32_t)sizeof(hit);
+            if(bcache_readn((uint8_t*)buf+(size_t)i*BSIZE, blk+i, k)!=FS_OK) return FS_ERR;
+        }
+        return FS_OK;
+    }
+    LOCK();
+    if(!bc.inited) bcache_init();
+    for(uint32_t i=0;i<n;i++){
+        buf_t* b=lookup(blk+i);
+        hit[i] = b!=NULL;
+        if(b){ memcpy((uint8_t*)buf+(size_t)i*BSIZE, b->data, BSIZE); bc.st.hits++; nhit++; }
+    }
+    UNLOCK();
+    if(nhit==0) return dev_raw_readn(buf, blk, n);
+    for(uint32_t i=0;i<n;){
+        if(hit[i]){ i++; continue; }
+        uint32_t j=i+1; while(j<n && !hit[j]) j++;
+        if(dev_raw_readn((uint8_t*)buf+(size_t)i*BSIZE, blk+i, j-i)!=FS_OK) return FS_ERR;
+        i=j;
+    }
+    return FS_OK;
+}
+// 多块直写之前：已缓存的副本在锁内换成新内容并置脏（免得它稍后被淘汰时用旧内容覆盖，
+// 写盘失败时刷盘还会再写一次）；返回是否有副本在缓存里
+int bcache_update(const void* buf, uint32_t blk, uint32_t n){
+    int hit=0;
+    LOCK();
+    if(!bc.inited) bcache_init();
+    for(uint32_t i=0;i<n;i++){
+        buf_t* b=lookup(blk+i); if(!b) continue;
+        memcpy(b->data, (const uint8_t*)buf+(size_t)i*BSIZE, BSIZE);
+        b->dirty=1; hit=1;
+    }
+    UNLOCK();
+    return hit;
+}
+// 写盘成功后：内容仍与 buf 相同的副本才标为干净（在途期间可能又被改过）
+void bcache_written(const void* buf, uint32_t blk, uint32_t n){
+    LOCK();
+    for(uint32_t i=0; bc.inited && i<n; i++){
+        buf_t* b=lookup(blk+i);
+        if(b && b->dirty && !memcmp(b->data, (const uint8_t*)buf+(size_t)i*BSIZE, BSIZE)) b->dirty=0;
+    }
+    UNLOCK();
+}
+// 多块直写：在锁外写盘，不把新块装入缓存
+int bcache_writen(const void* buf, uint32_t blk, uint32_t n){
+    int hit=bcache_update(buf, blk, n);
+    if(dev_raw_writen(buf, blk, n)!=FS_OK) return FS_ERR;
+    if(hit) bcache_written(buf, blk, n);
+    return FS_OK;
+}
+
+static int cmp_buf(const void* a, const void* b){
+    uint32_t x=(*(buf_t* const*)a)->blk, y=(*(buf_t* const*)b)->blk;
+    return (x>y)-(x<y);
+}
+
+// 按块号升序写回全部脏块，尽量让宿主机 I/O 顺序化；异步时最多 qd 个同时在途。
+// 回调在持锁的本线程里执行。先收割本线程别的在途请求（预读回调要加缓存锁）
+static void wb_done(void* arg, int res){
+    buf_t* b=(buf_t*)arg;
+    if(res==FS_OK){ b->dirty=0; bc.st.writebacks++; }
+}
+int bcache_flush(){
+    int rc=dev_aio_drain();
+    LOCK();
+    if(!bc.inited){ UNLOCK(); return rc; }
+    buf_t** dirty=g_vol->bcache->dirty; uint32_t n=0;
+    for(uint32_t i=0;i<bc.nbuf;i++) if(bc.pool[i].valid && bc.pool[i].dirty) dirty[n++]=&bc.pool[i];
+    qsort(dirty, n, sizeof(dirty[0]), cmp_buf);
+    for(uint32_t i=0;i<n;i++)
+        if(dev_aio_write(dirty[i]->data, dirty[i]->blk, 1, wb_done, dirty[i])!=FS_OK) rc=FS_ERR;
+    if(dev_aio_drain()!=FS_OK) rc=FS_ERR;
+    UNLOCK();
+    return rc;
+}
+
+void bcache_invalidate(){
+    LOCK();
+    if(bc.inited){
+        bcache_stats_t keep=bc.st;
+        memset(&bc,0,sizeof(bc));
+        bc.st=keep;
+    }
+    UNLOCK();
+}
+
+void bcache_get_stats(bcache_stats_t* out){ if(out){ LOCK(); *out=bc.st; UNLOCK(); } }
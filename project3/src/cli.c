@@ -1,198 +1,567 @@
+// src/cli.c — 命令行前端：只经 libminiext2 的 mx_* 接口操作 disk.img
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include "fs.h"
+#include <unistd.h>
+#include "miniext2.h"
+#include "util.h"
+#include "server.h"
 
-static void cmd_ls(const char* path){
-    uint32_t ino;
-    if(path && *path){ if(namei(path,&ino)!=FS_OK){ puts("ls: no such file/dir"); return; } }
-    else ino = g_cwd;
-
-    inode_t din;
-    if(read_inode(ino,&din)!=FS_OK){ puts("ls: read inode fail"); return; }
-    if((din.mode & 0170000) != 0040000){ puts("ls: not a directory"); return; }
-
-    printf("mode       uid  type name                                               size      ctime                mtime                atime\n");
-    uint32_t n = din.size/sizeof(dirent_t);
-    uint8_t blk[BLOCK_SIZE];
-    dirent_t de;
-
-    for(uint32_t i=0;i<n;i++){
-        uint32_t bn=(i*sizeof(dirent_t))/BLOCK_SIZE, off=(i*sizeof(dirent_t))%BLOCK_SIZE;
-        if(din.direct[bn]==0) continue;
-        if(dev_read_block(blk,din.direct[bn])!=FS_OK) continue;
-        memcpy(&de, blk+off, sizeof(de));
-        if(de.ino==0) continue;
+static mx_vol_t* g_v = NULL;       // 当前挂载的 disk.img
+static const char* g_opts = NULL;  // -o 挂载选项
+static int g_show_stats = 0;       // -o 中含 stats：退出时打印各层统计
 
-        inode_t child; if(read_inode(de.ino,&child)!=FS_OK) continue;
-        char ms[11], ct[20], mt[20], at[20];
-        mode_to_str(child.mode, ms);
-        human_time(child.ctime, ct, sizeof ct);
-        human_time(child.mtime, mt, sizeof mt);
-        human_time(child.atime, at, sizeof at);
-
-        printf("%-10s %-3u  %-4s %-50s %-8u %-19s %-19s %-19s\n",
-               ms, (unsigned)child.uid, (de.file_type==FT_DIR?"dir":"file"),
-               de.name, child.size, ct, mt, at);
+static int ls_ent(void* arg, const char* name, int is_dir, const mx_stat_t* st){
+    int* first=(int*)arg;
+    if(*first){
+        printf("mode       uid  type name                                               size      ctime                mtime                atime\n");
+        *first=0;
     }
+    char ms[11], ct[20], mt[20], at[20];
+    mode_to_str(st->mode, ms);
+    human_time(st->ctime, ct, sizeof ct);
+    human_time(st->mtime, mt, sizeof mt);
+    human_time(st->atime, at, sizeof at);
+    printf("%-10s %-3u  %-4s %-50s %-8u %-19s %-19s %-19s\n",
+           ms, (unsigned)st->uid, (is_dir?"dir":"file"), name, st->size, ct, mt, at);
+    return 0;
+}
+static void say_ls(int r){
+    if(r==FS_ENOENT) puts("ls: no such file/dir");
+    else if(r==FS_ENOTDIR) puts("ls: not a directory");
+    else if(r!=FS_OK) puts("ls: read inode fail");
+}
+static void cmd_ls(const char* path){
+    int first=1;
+    say_ls(mx_readdir(g_v, path, ls_ent, &first));
 }
 
-static void cmd_format(){ puts(fs_format()==FS_OK? "[OK] formatted":"[ERR] format fail"); }
-static void cmd_mount(){ puts(fs_mount("disk.img")==FS_OK? "[OK] mounted":"[ERR] mount fail"); }
+// 容量参数：支持 K/M/G 后缀
+static uint64_t parse_size(const char* s){
+    char* end; uint64_t v=strtoull(s, &end, 10);
+    switch(*end){ case 'G': case 'g': v<<=10; /* fallthrough */
+                  case 'M': case 'm': v<<=10; /* fallthrough */
+                  case 'K': case 'k': v<<=10; }
+    return v;
+}
 
-static void cmd_mkdir(const char* path){
-    uint32_t parent; const char* slash=strrchr(path,'/'); char name[NAME_MAX_LEN];
-    if(!slash){ parent=g_cwd; strncpy(name,path,NAME_MAX_LEN-1); name[NAME_MAX_LEN-1]='\0'; }
-    else{
-        char pbuf[256]; size_t n=(size_t)(slash-path); if(n>=sizeof(pbuf)){ puts("mkdir: path too long"); return; }
-        memcpy(pbuf,path,n); pbuf[n]='\0'; if(!*pbuf) strcpy(pbuf,"/");
-        if(namei(pbuf,&parent)!=FS_OK){ puts("mkdir: parent missing"); return; }
-        strncpy(name,slash+1,NAME_MAX_LEN-1); name[NAME_MAX_LEN-1]='\0';
+// format [-b 块大小] [-s 卷大小] [-i inode 数] [-j 日志块数]，缺省为 512B × 4611 块、256 个 inode
+static int cmd_format(int ac, char** av){
+    uint32_t bs=0, inodes=0, journal=0; uint64_t size=0;
+    for(int i=1;i+1<ac;i+=2){
+        if(strcmp(av[i],"-b")==0)      bs=(uint32_t)parse_size(av[i+1]);
+        else if(strcmp(av[i],"-s")==0) size=parse_size(av[i+1]);
+        else if(strcmp(av[i],"-i")==0) inodes=(uint32_t)parse_size(av[i+1]);
+        else if(strcmp(av[i],"-j")==0){ journal=(uint32_t)parse_size(av[i+1]); if(!journal) journal=MX_NO_JOURNAL; }
     }
-    int ino=alloc_inode(); if(ino<0){ puts("mkdir: no inode"); return; }
-    inode_t in={0}; in.mode=MODE_DIR; in.links=2; in.uid=(uint16_t)g_uid;
-    ts_now(&in.ctime); ts_now(&in.mtime); ts_now(&in.atime);
-    write_inode((uint32_t)ino,&in);
-    dir_add((uint32_t)ino, ".", FT_DIR, (uint32_t)ino);
-    dir_add((uint32_t)ino, "..", FT_DIR, parent);
-    puts(dir_add(parent,name,FT_DIR,(uint32_t)ino)==FS_OK? "[OK]" : "mkdir: dir_add fail");
+    mx_stats_t st;
+    int r=mx_format("disk.img", g_opts, bs, size, inodes, journal, &st);
+    if(r==FS_EINVAL) return r;      // 选项有误，解析时已报告
+    puts(r==FS_OK? "[OK] formatted":"[ERR] format fail");
+    if(g_show_stats){ st.delalloc_on=0; mx_stats_print(stdout, &st, 0); }
+    return r;
+}
+static void cmd_mount(){
+    mx_vol_t* v=mx_mount("disk.img", g_opts, NULL);
+    puts(v? "[OK] mounted":"[ERR] mount fail");
+    mx_unmount(v, NULL);
+}
+
+static void say_mkdir(int r){
+    if(r==FS_OK) puts("[OK]");
+    else if(r==FS_EINVAL) puts("mkdir: path too long");
+    else if(r==FS_ENOENT) puts("mkdir: parent missing");
+    else if(r==FS_ENOSPC) puts("mkdir: no inode");
+    else puts("mkdir: dir_add fail");
 }
+static void cmd_mkdir(const char* path){ say_mkdir(mx_mkdir(g_v, path)); }
 
 static void cmd_create(const char* path){
-    int fd=fs_open(path,"w"); if(fd>=0){ fs_close(fd); puts("[OK]"); } else puts("[ERR]");
+    int fd=mx_open(g_v,path,"w"); if(fd>=0){ mx_close(g_v,fd); puts("[OK]"); } else puts("[ERR]");
 }
 
 static void cmd_open(const char* path, const char* m){
-    int fd=fs_open(path,m); if(fd<0) puts("[ERR]"); else printf("fd=%d\n",fd);
+    int fd=mx_open(g_v,path,m); if(fd<0) puts("[ERR]"); else printf("fd=%d\n",fd);
+}
+static void cmd_write_fd(int fd, const char* s){ int n=mx_write(g_v,fd,s,(uint32_t)strlen(s)); printf("wrote=%d\n", n); }
+static void cmd_read_fd (int fd, int n){ char* b=(char*)malloc((size_t)n+1); int r=mx_read(g_v,fd,b,(uint32_t)n); b[(r<0)?0:r]='\0'; printf("read=%d: %s\n", r, b); free(b); }
+static void cmd_dup(int fd, const char* m){
+    int nfd=mx_dup(g_v,fd,(m && strcmp(m,"r")==0) ? MX_FD_RDONLY : 0); if(nfd<0) puts("[ERR]"); else printf("fd=%d\n",nfd);
 }
-static void cmd_write_fd(int fd, const char* s){ int n=fs_write(fd,s,(uint32_t)strlen(s)); printf("wrote=%d\n", n); }
-static void cmd_read_fd (int fd, int n){ char* b=(char*)malloc((size_t)n+1); int r=fs_read(fd,b,(uint32_t)n); b[(r<0)?0:r]='\0'; printf("read=%d: %s\n", r, b); free(b); }
-static void cmd_close(int fd){ puts(fs_close(fd)==FS_OK? "close=OK":"close=ERR"); }
-static void cmd_cd(const char* path){ uint32_t ino; puts(namei(path,&ino)==FS_OK? (g_cwd=ino,"[OK]") : "[ERR]"); }
-static void cmd_seek(int fd, int off){ puts(fs_seek(fd,off)==FS_OK? "seek=OK":"seek=ERR"); }
+static void cmd_close(int fd){ puts(mx_close(g_v,fd)==FS_OK? "close=OK":"close=ERR"); }
+static void cmd_cd(const char* path){ puts(mx_chdir(g_v,path)==FS_OK? "[OK]" : "[ERR]"); }
+static void cmd_seek(int fd, int off){ puts(mx_seek(g_v,fd,off)==FS_OK? "seek=OK":"seek=ERR"); }
 
 // 一次性命令（便于测试）
-static void cmd_writef(const char* path, const char* s){ int fd=fs_open(path,"w"); if(fd<0){ puts("writef: open fail"); return; } int n=fs_write(fd,s,(uint32_t)strlen(s)); fs_close(fd); printf("wrote=%d\n", n); }
+static void cmd_writef(const char* path, const char* s){ int fd=mx_open(g_v,path,"w"); if(fd<0){ puts("writef: open fail"); return; } int n=mx_write(g_v,fd,s,(uint32_t)strlen(s)); mx_close(g_v,fd); printf("wrote=%d\n", n); }
 
 static void cmd_readf(const char* path, int n){
-    int fd = fs_open(path,"r");
+    int fd = mx_open(g_v,path,"r");
     if(fd < 0){ puts("readf: open fail"); return; }
     char* b = (char*)malloc((size_t)n+1);
-    int r = fs_read(fd, b, (uint32_t)n);
-    if(r < 0) { printf("read=%d\n", r); fs_close(fd); free(b); return; }
+    int r = mx_read(g_v,fd, b, (uint32_t)n);
+    if(r < 0) { printf("read=%d\n", r); mx_close(g_v,fd); free(b); return; }
     b[r] = '\0';
     printf("read=%d: %s\n", r, b);
     free(b);
-    fs_close(fd);
+    mx_close(g_v,fd);
 }
 
 static void cmd_writefile(const char* fs_path, const char* host_path){
     FILE* f = fopen(host_path,"rb");
     if(!f){ printf("writefile: cannot open %s\n", host_path); return; }
-    int fd = fs_open(fs_path,"w");
+    int fd = mx_open(g_v,fs_path,"w");
     if(fd < 0){ puts("writefile: open fail"); fclose(f); return; }
 
-    char buf[BLOCK_SIZE];
+    static char buf[1024*1024];    // 大块写入：整块部分走对齐直写
     int total = 0;
     for(;;){
         size_t n = fread(buf,1,sizeof(buf),f);
         if(n==0) break;
-        int w = fs_write(fd, buf, (uint32_t)n);
+        int w = mx_write(g_v,fd, buf, (uint32_t)n);
         if(w<0){ printf("writefile: fs_write=%d\n", w); break; }
         total += w;
         if(n < sizeof(buf)) break;
     }
-    fs_close(fd);
+    mx_close(g_v,fd);
     fclose(f);
     printf("wrotefile=%d bytes\n", total);
 }
 
-// delete：文件/空目录
-static void cmd_delete(const char* path){
-    uint32_t ino; if(namei(path,&ino)!=FS_OK){ puts("delete: noent"); return; }
-    inode_t in; read_inode(ino,&in);
-    if((in.mode & 0170000)==0040000){ // dir
-        if(in.size>2*sizeof(dirent_t)){ puts("delete: dir not empty"); return; }
+// 把文件系统里的文件导出到宿主机（顺序读，走预读）
+static void cmd_readfile(const char* fs_path, const char* host_path){
+    int fd = mx_open(g_v,fs_path,"r");
+    if(fd < 0){ puts("readfile: open fail"); return; }
+    FILE* f = fopen(host_path,"wb");
+    if(!f){ printf("readfile: cannot open %s\n", host_path); mx_close(g_v,fd); return; }
+
+    static char buf[1024*1024];
+    long long total = 0;
+    for(;;){
+        int n = mx_read(g_v,fd, buf, sizeof(buf));
+        if(n<0){ printf("readfile: fs_read=%d\n", n); break; }
+        if(n==0) break;
+        if(fwrite(buf,1,(size_t)n,f)!=(size_t)n){ puts("readfile: host write fail"); break; }
+        total += n;
     }
-    inode_truncate(ino); free_inode(ino);
-    // 从父目录移除
-    const char* s=strrchr(path,'/'); const char* nm=s? s+1 : path; uint32_t p;
-    if(s){ char parent[256]; size_t n=(size_t)(s-path); memcpy(parent,path,n); parent[n]='\0'; if(!*parent) strcpy(parent,"/"); namei(parent,&p); }
-    else p=g_cwd;
-    dir_remove(p,nm); puts("[OK]");
+    fclose(f);
+    mx_close(g_v,fd);
+    printf("readfile=%lld bytes\n", total);
+}
+
+// tune：显示卷参数；tune atime=strict|relatime|noatime 修改超级块中的缺省 atime 策略
+static void cmd_tune(int ac, char** av){
+    static const char* amode[]={"strict","strict","relatime","noatime"};
+    for(int i=1;i<ac;i++){
+        if(strncmp(av[i],"atime=",6)==0){
+            if(mx_set_atime(g_v, av[i]+6)!=FS_OK){ printf("tune: bad atime mode %s\n", av[i]+6); return; }
+        }else{ printf("tune: unknown setting %s\n", av[i]); return; }
+    }
+    mx_info_t in; mx_info(g_v, &in);
+    printf("block_size=%u blocks=%u groups=%u inodes=%u free_blocks=%u free_inodes=%u\n",
+           in.block_size, in.blocks, in.groups, in.inodes, in.free_blocks, in.free_inodes);
+    printf("atime default=%s effective=%s\n", amode[in.atime_default], amode[in.atime_effective]);
+    if(in.journal_blocks) printf("journal start=%u blocks=%u\n", in.journal_start, in.journal_blocks);
+    else puts("journal none");
+}
+
+// delete：文件/空目录
+static void say_delete(int r){
+    if(r==FS_ENOENT) puts("delete: noent");
+    else if(r==FS_ENOTEMPTY) puts("delete: dir not empty");
+    else puts("[OK]");
 }
+static void cmd_delete(const char* path){ say_delete(mx_unlink(g_v, path)); }
 
 // chmod：读写保护
 static void cmd_chmod(const char* oct, const char* path){
-    uint32_t ino; if(namei(path,&ino)!=FS_OK){ puts("chmod: noent"); return; }
-    inode_t in; read_inode(ino,&in);
-    if(g_uid!=0 && in.uid!=g_uid){ puts("chmod: EPERM"); return; }
     unsigned m=0; sscanf(oct, "%o", &m);
-    in.mode = (uint16_t)((in.mode & 0170000) | (m & 0777));
-    ts_now(&in.ctime); write_inode(ino,&in); puts("[OK]");
+    int r=mx_chmod(g_v, path, m);
+    if(r==FS_ENOENT) puts("chmod: noent");
+    else if(r==FS_EPERM) puts("chmod: EPERM");
+    else puts("[OK]");
 }
 
 // 账号
-static void cmd_login(const char* u, const char* p){ puts(users_login(u,p)==FS_OK? "[OK]":"[ERR] login"); }
+static void cmd_login(const char* u, const char* p){ puts(mx_login(g_v,u,p)==FS_OK? "[OK]":"[ERR] login"); }
 static void cmd_password(const char* name, const char* pass){
-    puts(users_change_password(name, pass)==FS_OK ? "[OK]" : "[ERR] password");
+    puts(mx_passwd(g_v, name, pass)==FS_OK ? "[OK]" : "[ERR] password");
+}
+
+// ======= 客户端模式（-S）：命令经 mini_ext2 serve 在常驻挂载上执行 =======
+// 请求只进发送缓冲，结果在应答回来时按请求顺序打印，所以批处理脚本的多条命令一次往返发出。
+// 连接内的 fd 由本端分配（最小空闲号），open 之后的 write/close 不必等 open 的应答。
+// 回调执行时命令行缓冲可能已被下一行覆盖，回调里只能用字面量与自带的上下文。
+static cl_conn_t* g_c = NULL;
+static const char* g_sock = NULL;   // -S 指定的服务端套接字
+static uint8_t g_rfd[SRV_FD_MAX/8];
+
+static int rfd_get(){
+    for(int i=0;i<SRV_FD_MAX;i++) if(!(g_rfd[i>>3] & (1u<<(i&7)))){ g_rfd[i>>3] |= (uint8_t)(1u<<(i&7)); return i; }
+    return -1;
+}
+static void rfd_put(int fd){ if(fd>=0 && fd<SRV_FD_MAX) g_rfd[fd>>3] &= (uint8_t)~(1u<<(fd&7)); }
+// 本地直接打印的消息排在已发出请求的结果之后
+static void rsay(const char* s){ cl_wait(g_c, 0); puts(s); }
+static void rsend(int op, int flags, int fd, int arg, const void* p, uint32_t len, cl_done_cb cb, void* ctx){
+    cl_send(g_c, op, flags, fd, arg, p, len, cb, ctx);
+}
+static void rpath(int op, const char* path, cl_done_cb cb, void* ctx){
+    rsend(op, 0, -1, 0, path, path ? (uint32_t)strlen(path) : 0, cb, ctx);
+}
+
+#define RCB(name) static void name(void* ctx, int res, const void* data, uint32_t len)
+RCB(r_msg){ const char* const* m=(const char* const*)ctx; puts(res==FS_OK ? m[0] : m[1]); }
+static const char* const m_close[]={ "close=OK", "close=ERR" };
+static const char* const m_seek[] ={ "seek=OK", "seek=ERR" };
+static const char* const m_sync[] ={ "[OK]", "[ERR] sync" };
+static const char* const m_stop[] ={ "[OK] server stopping", "[ERR] stop" };
+RCB(r_mkdir){ say_mkdir(res); }
+RCB(r_delete){ say_delete(res); }
+RCB(r_ls){
+    int first=1;
+    for(uint32_t off=0; res==FS_OK && off+sizeof(srv_dirent_t)<=len; ){
+        srv_dirent_t e; memcpy(&e, (const uint8_t*)data+off, sizeof e);
+        char name[256]; uint32_t n = e.name_len<sizeof(name) ? e.name_len : sizeof(name)-1;
+        memcpy(name, (const uint8_t*)data+off+sizeof e, n); name[n]='\0';
+        ls_ent(&first, name, e.is_dir, &e.st);
+        off += (uint32_t)sizeof e+e.name_len;
+    }
+    say_ls(res);
+}
+RCB(r_open){ int fd=(int)(intptr_t)ctx; if(res<0){ rfd_put(fd); puts("[ERR]"); } else printf("fd=%d\n", fd); }
+RCB(r_wrote){ printf("wrote=%d\n", res); }
+RCB(r_read){ printf("read=%d: %.*s\n", res, res>0 ? (int)len : 0, (const char*)data); }
+RCB(r_create){ puts(res>=0 ? "[OK]" : "[ERR]"); }
+RCB(r_stats){
+    if(res!=FS_OK || len!=sizeof(mx_stats_t)){ puts("[ERR] stats"); return; }
+    mx_stats_t st; memcpy(&st, data, sizeof st);
+    mx_stats_print(stdout, &st, ctx!=NULL);
+}
+
+// 多请求命令（writef/readf/writefile/readfile）的共享状态，在最后一个请求（close）的回调里释放
+typedef struct { const char* cmd; int failed, eof; long long total; FILE* f; } rjob_t;
+static rjob_t* rjob(const char* cmd){ rjob_t* j=(rjob_t*)calloc(1, sizeof(rjob_t)); if(j) j->cmd=cmd; return j; }
+RCB(rj_open){ rjob_t* j=(rjob_t*)ctx; if(res<0){ j->failed=1; printf("%s: open fail\n", j->cmd); } }
+RCB(rj_free){ free(ctx); }
+RCB(rj_writef){ if(!((rjob_t*)ctx)->failed) printf("wrote=%d\n", res); }
+RCB(rj_readf){
+    if(((rjob_t*)ctx)->failed) return;
+    if(res<0) printf("read=%d\n", res);
+    else printf("read=%d: %.*s\n", res, (int)len, (const char*)data);
+}
+RCB(rj_wrote){
+    rjob_t* j=(rjob_t*)ctx;
+    if(j->failed) return;
+    if(res<0){ printf("writefile: fs_write=%d\n", res); j->failed=2; }
+    else j->total+=res;
+}
+RCB(rj_wrotefile){ rjob_t* j=(rjob_t*)ctx; if(j->failed!=1) printf("wrotefile=%lld bytes\n", j->total); free(j); }
+RCB(rj_chunk){
+    rjob_t* j=(rjob_t*)ctx;
+    if(j->failed || j->eof) return;
+    if(res<0){ printf("readfile: fs_read=%d\n", res); j->failed=2; }
+    else if(res==0) j->eof=1;
+    else if(fwrite(data, 1, len, j->f)!=len){ puts("readfile: host write fail"); j->failed=2; }
+    else j->total+=res;
+}
+RCB(rj_readfile){
+    rjob_t* j=(rjob_t*)ctx;
+    fclose(j->f);
+    if(j->failed!=1) printf("readfile=%lld bytes\n", j->total);
+    free(j);
+}
+
+// open 与之后的请求一起发出；close 一发出本端 fd 即可复用（服务端按顺序执行）
+static int ropen(const char* path, int wr, cl_done_cb cb, void* ctx){
+    int fd=rfd_get();
+    if(fd<0){ rsay("[ERR] too many open fds"); return -1; }
+    rsend(SRV_OPEN, wr, -1, fd, path, (uint32_t)strlen(path), cb, ctx ? ctx : (void*)(intptr_t)fd);
+    return fd;
+}
+static void rclose(int fd, cl_done_cb cb, void* ctx){ rsend(SRV_CLOSE, 0, fd, 0, NULL, 0, cb, ctx); rfd_put(fd); }
+
+static void rcmd_compound(const char* cmd, const char* path, int wr, const void* p, uint32_t n){
+    rjob_t* j=rjob(cmd);
+    if(!j){ rsay("[ERR] out of memory"); return; }
+    int fd=ropen(path, wr, rj_open, j);
+    if(fd<0){ free(j); return; }
+    if(wr) rsend(SRV_WRITE, 0, fd, 0, p, n, rj_writef, j);
+    else   rsend(SRV_READ, 0, fd, (int)n, NULL, 0, rj_readf, j);
+    rclose(fd, rj_free, j);
+}
+
+static void rcmd_writefile(const char* fs_path, const char* host_path){
+    FILE* f=fopen(host_path, "rb");
+    if(!f){ cl_wait(g_c, 0); printf("writefile: cannot open %s\n", host_path); return; }
+    rjob_t* j=rjob("writefile");
+    int fd = j ? ropen(fs_path, 1, rj_open, j) : -1;
+    if(fd<0){ free(j); fclose(f); return; }
+    static char buf[1024*1024];
+    for(size_t n; !j->failed && (n=fread(buf, 1, sizeof(buf), f))>0; )
+        rsend(SRV_WRITE, 0, fd, 0, buf, (uint32_t)n, rj_wrote, j);
+    fclose(f);
+    rclose(fd, rj_wrotefile, j);
+}
+
+// 读不知道文件多长：保持几个 1MB 的读在途，读到 0 字节为止
+static void rcmd_readfile(const char* fs_path, const char* host_path){
+    FILE* f=fopen(host_path, "wb");
+    if(!f){ cl_wait(g_c, 0); printf("readfile: cannot open %s\n", host_path); return; }
+    rjob_t* j=rjob("readfile");
+    int fd = j ? ropen(fs_path, 0, rj_open, j) : -1;
+    if(fd<0){ free(j); fclose(f); return; }
+    j->f=f;
+    while(!j->failed && !j->eof){
+        rsend(SRV_READ, 0, fd, 1024*1024, NULL, 0, rj_chunk, j);
+        cl_wait(g_c, 4);
+    }
+    rclose(fd, rj_readfile, j);
+}
+
+static int rdispatch(int argc, char** argv){
+    if(strcmp(argv[0],"ls")==0)                    rpath(SRV_READDIR, argc>=2 ? argv[1] : NULL, r_ls, NULL);
+    else if(strcmp(argv[0],"mkdir")==0 && argc>=2) rpath(SRV_MKDIR, argv[1], r_mkdir, NULL);
+    else if(strcmp(argv[0],"delete")==0 && argc>=2) rpath(SRV_UNLINK, argv[1], r_delete, NULL);
+    else if(strcmp(argv[0],"create")==0 && argc>=2){
+        int fd=ropen(argv[1], 1, r_create, NULL);
+        if(fd>=0) rclose(fd, NULL, NULL);
+    }
+    else if(strcmp(argv[0],"open")==0 && argc>=2)  ropen(argv[1], argc>=3 && strcmp(argv[2],"w")==0, r_open, NULL);
+    else if(strcmp(argv[0],"write")==0 && argc>=3) rsend(SRV_WRITE, 0, atoi(argv[1]), 0, argv[2], (uint32_t)strlen(argv[2]), r_wrote, NULL);
+    else if(strcmp(argv[0],"read")==0 && argc>=3)  rsend(SRV_READ, 0, atoi(argv[1]), atoi(argv[2]), NULL, 0, r_read, NULL);
+    else if(strcmp(argv[0],"seek")==0 && argc>=3)  rsend(SRV_SEEK, 0, atoi(argv[1]), atoi(argv[2]), NULL, 0, r_msg, (void*)m_seek);
+    else if(strcmp(argv[0],"close")==0 && argc>=2) rclose(atoi(argv[1]), r_msg, (void*)m_close);
+    else if(strcmp(argv[0],"dup")==0 && argc>=2){
+        int fd=rfd_get();
+        if(fd<0) rsay("[ERR] too many open fds");
+        else rsend(SRV_DUP, (argc>=3 && strcmp(argv[2],"r")==0) ? MX_FD_RDONLY : 0, atoi(argv[1]), fd, NULL, 0, r_open, (void*)(intptr_t)fd);
+    }
+    else if(strcmp(argv[0],"writef")==0 && argc>=3) rcmd_compound("writef", argv[1], 1, argv[2], (uint32_t)strlen(argv[2]));
+    else if(strcmp(argv[0],"readf")==0 && argc>=3)  rcmd_compound("readf", argv[1], 0, NULL, (uint32_t)atoi(argv[2]));
+    else if(strcmp(argv[0],"writefile")==0 && argc>=3) rcmd_writefile(argv[1], argv[2]);
+    else if(strcmp(argv[0],"readfile")==0 && argc>=3)  rcmd_readfile(argv[1], argv[2]);
+    else if(strcmp(argv[0],"stats")==0)            rsend(SRV_STATS, 0, -1, 0, NULL, 0, r_stats, (argc>=2 && strcmp(argv[1],"hist")==0) ? (void*)1 : NULL);
+    else if(strcmp(argv[0],"sync")==0)             rsend(SRV_SYNC, 0, -1, 0, NULL, 0, r_msg, (void*)m_sync);
+    else if(strcmp(argv[0],"stop")==0)             rsend(SRV_STOP, 0, -1, 0, NULL, 0, r_msg, (void*)m_stop);
+    else return -1;
+    return 0;
+}
+
+// ======= 命令分发（argv[0] 为命令名；返回 -1 表示未知命令/参数不足） =======
+static int dispatch(int argc, char** argv){
+    if(strcmp(argv[0],"login")==0 && argc>=3)      cmd_login(argv[1],argv[2]);
+    else if(strcmp(argv[0],"password")==0 && argc>=3) cmd_password(argv[1],argv[2]);
+    else if(strcmp(argv[0],"ls")==0)               cmd_ls(argc>=2?argv[1]:NULL);
+    else if(strcmp(argv[0],"mkdir")==0 && argc>=2) cmd_mkdir(argv[1]);
+    else if(strcmp(argv[0],"create")==0 && argc>=2)cmd_create(argv[1]);
+    else if(strcmp(argv[0],"open")==0 && argc>=2)  cmd_open(argv[1], argc>=3?argv[2]:"r");
+    else if(strcmp(argv[0],"write")==0 && argc>=3) cmd_write_fd(atoi(argv[1]), argv[2]);
+    else if(strcmp(argv[0],"read")==0 && argc>=3)  cmd_read_fd(atoi(argv[1]), atoi(argv[2]));
+    else if(strcmp(argv[0],"dup")==0 && argc>=2)   cmd_dup(atoi(argv[1]), argc>=3?argv[2]:NULL);
+    else if(strcmp(argv[0],"close")==0 && argc>=2) cmd_close(atoi(argv[1]));
+    else if(strcmp(argv[0],"cd")==0 && argc>=2)    cmd_cd(argv[1]);
+    else if(strcmp(argv[0],"seek")==0 && argc>=3)  cmd_seek(atoi(argv[1]), atoi(argv[2]));
+    else if(strcmp(argv[0],"writef")==0 && argc>=3)cmd_writef(argv[1], argv[2]);
+    else if(strcmp(argv[0],"readf")==0 && argc>=3) cmd_readf(argv[1], atoi(argv[2]));
+    else if(strcmp(argv[0],"writefile")==0 && argc>=3) cmd_writefile(argv[1], argv[2]);
+    else if(strcmp(argv[0],"readfile")==0 && argc>=3)  cmd_readfile(argv[1], argv[2]);
+    else if(strcmp(argv[0],"chmod")==0 && argc>=3) cmd_chmod(argv[1], argv[2]);
+    else if(strcmp(argv[0],"delete")==0 && argc>=2) cmd_delete(argv[1]);
+    else if(strcmp(argv[0],"sync")==0)             puts(mx_sync(g_v)==FS_OK? "[OK]":"[ERR] sync");
+    else if(strcmp(argv[0],"stats")==0){
+        mx_stats_t st; mx_get_stats(g_v, &st);
+        mx_stats_print(stdout, &st, argc>=2 && strcmp(argv[1],"hist")==0);
+    }
+    else if(strcmp(argv[0],"tune")==0)             cmd_tune(argc, argv);
+    else if(strcmp(argv[0],"useradd")==0 && argc>=3){
+        int r = mx_useradd(g_v, argv[1], argv[2]);
+        puts(r==FS_OK ? "[OK]" : "[ERR] useradd");
+    }
+    // 调试查看当前身份
+    else if(strcmp(argv[0],"whoami")==0){
+        char user[32]; int uid=mx_whoami(g_v, user, sizeof user);
+        printf("%s (uid=%d)\n", user, uid);
+    }
+    else return -1;
+    return 0;
+}
+
+// ======= 交互/批处理模式：一次挂载，多条命令 =======
+static int g_timing = 0;        // -t 或 shell 内 "time on"：每条命令后打印耗时
+
+// 按空白切分一行；支持 "..." 与 '...' 引号（不处理转义）
+static int split_args(char* line, char** av, int max){
+    int n=0; char* p=line;
+    while(*p && n<max){
+        while(*p==' '||*p=='\t'||*p=='\r'||*p=='\n') p++;
+        if(!*p) break;
+        if(*p=='"' || *p=='\''){
+            char q=*p++; av[n++]=p;
+            while(*p && *p!=q) p++;
+        }else{
+            av[n++]=p;
+            while(*p && *p!=' ' && *p!='\t' && *p!='\r' && *p!='\n') p++;
+        }
+        if(*p) *p++='\0';
+    }
+    return n;
+}
+
+// 返回 1 表示应退出循环
+static int run_line(char* line){
+    char* av[16];
+    int ac=split_args(line, av, 16);
+    if(ac==0 || av[0][0]=='#') return 0;
+    if(strcmp(av[0],"exit")==0 || strcmp(av[0],"quit")==0) return 1;
+    if(strcmp(av[0],"time")==0){
+        if(g_c) cl_wait(g_c, 0);
+        if(ac>=2) g_timing = strcmp(av[1],"on")==0;
+        printf("time=%s\n", g_timing? "on":"off");
+        return 0;
+    }
+
+    uint64_t t0=now_ns();
+    if(g_c){
+        if(rdispatch(ac, av)<0) rsay("[ERR] unknown or bad args (or not available with -S)");
+        if(g_timing) cl_wait(g_c, 0);       // 计时到结果回来为止
+    }
+    else if(strcmp(av[0],"format")==0){
+        // 先卸载，格式化后重新挂载继续（已打开的 fd 随之失效）
+        mx_unmount(g_v, NULL);
+        cmd_format(ac, av);
+        if(!(g_v=mx_mount("disk.img", g_opts, NULL))){ puts("[ERR] remount fail"); return 1; }
+    }
+    else if(strcmp(av[0],"mount")==0) puts("[OK] mounted");
+    else if(dispatch(ac, av)<0) puts("[ERR] unknown or bad args");
+    if(g_timing) printf("[time] %s %.3f ms\n", av[0], (now_ns()-t0)/1e6);
+    return 0;
+}
+
+static int repl(FILE* in, int interactive){
+    char line[4096];
+    for(;;){
+        if(interactive && g_c){ printf("mini_ext2@%s> ", g_sock); fflush(stdout); }
+        else if(interactive){ char user[32]; mx_whoami(g_v, user, sizeof user); printf("mini_ext2:%s> ", user); fflush(stdout); }
+        if(!fgets(line, sizeof(line), in)) break;
+        if(run_line(line)) break;
+        if(interactive && g_c) cl_wait(g_c, 0);
+        fflush(stdout);
+    }
+    if(interactive) putchar('\n');
+    return 0;
+}
+
+// 多个 -o 依次拼接；含 stats 一项时退出前打印统计
+static char g_optbuf[512];
+static void add_opts(const char* o){
+    size_t n=strlen(g_optbuf);
+    snprintf(g_optbuf+n, sizeof(g_optbuf)-n, "%s%s", n? ",":"", o);
+    g_opts=g_optbuf;
+    char buf[256]; strncpy(buf, o, sizeof(buf)-1); buf[sizeof(buf)-1]='\0';
+    for(char* tok=strtok(buf, ","); tok; tok=strtok(NULL, ",")) if(strcmp(tok,"stats")==0) g_show_stats=1;
+}
+
+// serve [sock]：挂载 disk.img 后常驻，直到 Ctrl-C / SIGTERM 或客户端发 stop
+static int cmd_serve(const char* sock){
+    int err;
+    mx_vol_t* v=mx_mount("disk.img", g_opts, &err);
+    if(!v){
+        if(err!=FS_EINVAL) puts("[ERR] auto-mount disk.img fail (run format first)");
+        return 1;
+    }
+    printf("[OK] serving disk.img on %s\n", sock); fflush(stdout);
+    int r=srv_run(v, sock);
+    if(r==FS_EBUSY) printf("[ERR] %s: another server is running\n", sock);
+    else if(r!=FS_OK) printf("[ERR] cannot listen on %s\n", sock);
+    mx_stats_t st;
+    mx_unmount(v, &st);
+    if(g_show_stats) mx_stats_print(stdout, &st, 0);
+    return r==FS_OK ? 0 : 1;
+}
+
+// -S：不挂载，命令发给 serve；-o stats 打印的是服务端卷的累计统计
+static int client_main(int argc, char** argv, FILE* script){
+    if(!(g_c=cl_connect(g_sock))){ printf("[ERR] cannot connect to %s (start mini_ext2 serve first)\n", g_sock); return 1; }
+    if(strcmp(argv[1],"format")==0 || strcmp(argv[1],"mount")==0) rsay("[ERR] not available with -S");
+    else if(strcmp(argv[1],"shell")==0) repl(stdin, isatty(STDIN_FILENO));
+    else if(script){ repl(script, 0); if(script!=stdin) fclose(script); }
+    else{
+        uint64_t t0=now_ns();
+        if(rdispatch(argc-1, argv+1)<0) rsay("[ERR] unknown or bad args (or not available with -S)");
+        cl_wait(g_c, 0);
+        if(g_timing) printf("[time] %s %.3f ms\n", argv[1], (now_ns()-t0)/1e6);
+    }
+    cl_wait(g_c, 0);
+    if(g_show_stats){
+        mx_stats_t st;
+        if(cl_call(g_c, SRV_STATS, 0, -1, 0, NULL, 0, &st, sizeof st)==FS_OK) mx_stats_print(stdout, &st, 0);
+    }
+    cl_close(g_c);
+    return 0;
 }
 
 int main(int argc, char** argv){
+    // 全局选项：mini_ext2 [-o dev=pread,direct,stats] [-t] [-S sock] <cmd> ...
+    for(;;){
+        if(argc>=3 && strcmp(argv[1],"-o")==0){
+            add_opts(argv[2]);
+            argv += 2; argc -= 2;
+        }else if(argc>=3 && strcmp(argv[1],"-S")==0){
+            g_sock = argv[2]; argv += 2; argc -= 2;
+        }else if(argc>=2 && strcmp(argv[1],"-t")==0){
+            g_timing = 1; argv++; argc--;
+        }else break;
+    }
     if(argc<2){
         puts("Usage:\n"
-             "  mini_ext2 format | mount\n"
+             "  mini_ext2 [-o dev=stdio|dev=pread|direct|mmap,noatime,stats] [-t] <cmd> ...\n"
+             "  mini_ext2 format [-b bsize] [-s size[K|M|G]] [-i inodes] [-j journal_blocks] | mount\n"
+             "  mini_ext2 shell | batch <script>      (one mount, many commands)\n"
+             "  mini_ext2 serve [sock]                (keep disk.img mounted, serve clients over a Unix socket)\n"
+             "  mini_ext2 -S <sock> <cmd> | shell | batch <script> | stop   (run commands on a server)\n"
              "  mini_ext2 login <user> <pass> | password <old> <new>\n"
              "  mini_ext2 ls [path]\n"
              "  mini_ext2 mkdir <path> | create <path> | delete <path>\n"
              "  mini_ext2 open <path> [r|w] | write <fd> <str> | read <fd> <n> | seek <fd> <off> | close <fd>\n"
+             "  mini_ext2 dup <fd> [r]\n"
              "  mini_ext2 writef <path> <str> | readf <path> <n> | writefile <fs_path> <host_path>\n"
-             "  mini_ext2 chmod <oct> <path> | cd <path>");
+             "  mini_ext2 readfile <fs_path> <host_path>\n"
+             "  mini_ext2 chmod <oct> <path> | cd <path> | sync | stats [hist]\n"
+             "  mini_ext2 tune [atime=strict|relatime|noatime]");
         return 0;
     }
 
-    if(strcmp(argv[1],"format")==0){ cmd_format(); return 0; }
-    if(strcmp(argv[1],"mount")==0){ cmd_mount();  return 0; }
-    if(fs_mount("disk.img")!=FS_OK){ puts("[ERR] auto-mount disk.img fail (run format first)"); return 1; }
-
-    if(strcmp(argv[1],"login")==0 && argc>=4)      cmd_login(argv[2],argv[3]);
-    else if(strcmp(argv[1],"password")==0 && argc>=4) cmd_password(argv[2],argv[3]);
-    else if(strcmp(argv[1],"ls")==0)               cmd_ls(argc>=3?argv[2]:NULL);
-    else if(strcmp(argv[1],"mkdir")==0 && argc>=3) cmd_mkdir(argv[2]);
-    else if(strcmp(argv[1],"create")==0 && argc>=3)cmd_create(argv[2]);
-    else if(strcmp(argv[1],"open")==0 && argc>=3)  cmd_open(argv[2], argc>=4?argv[3]:"r");
-    else if(strcmp(argv[1],"write")==0 && argc>=4) cmd_write_fd(atoi(argv[2]), argv[3]);
-    else if(strcmp(argv[1],"read")==0 && argc>=4)  cmd_read_fd(atoi(argv[2]), atoi(argv[3]));
-    else if(strcmp(argv[1],"close")==0 && argc>=3) cmd_close(atoi(argv[2]));
-    else if(strcmp(argv[1],"cd")==0 && argc>=3)    cmd_cd(argv[2]);
-    else if(strcmp(argv[1],"seek")==0 && argc>=4)  cmd_seek(atoi(argv[2]), atoi(argv[3]));
-    else if(strcmp(argv[1],"writef")==0 && argc>=4)cmd_writef(argv[2], argv[3]);
-    else if(strcmp(argv[1],"readf")==0 && argc>=4) cmd_readf(argv[2], atoi(argv[3]));
-    else if(strcmp(argv[1],"writefile")==0 && argc>=4) cmd_writefile(argv[2], argv[3]);
-    else if(strcmp(argv[1],"chmod")==0 && argc>=4) cmd_chmod(argv[2], argv[3]);
-    else if(strcmp(argv[1],"delete")==0 && argc>=3) cmd_delete(argv[2]);
-    else if(strcmp(argv[1],"login")==0 && argc>=4){
-        int r = users_login(argv[2], argv[3]);
-        puts(r==FS_OK ? "[OK]" : "[ERR] login");
-    }
-    else if(strcmp(argv[1],"useradd")==0 && argc>=4){
-        int r = users_add(argv[2], argv[3]);
-        puts(r==FS_OK ? "[OK]" : "[ERR] useradd");
+    if(strcmp(argv[1],"serve")==0) return cmd_serve(argc>=3 ? argv[2] : SRV_SOCK_DEFAULT);
+    if(strcmp(argv[1],"format")==0 && !g_sock) return cmd_format(argc-1, argv+1)==FS_EINVAL ? 1 : 0;
+    if(strcmp(argv[1],"mount")==0 && !g_sock){ cmd_mount();  return 0; }
+
+    FILE* script = NULL;
+    if(strcmp(argv[1],"batch")==0){
+        if(argc<3){ puts("batch: missing script"); return 1; }
+        if(!(script = (strcmp(argv[2],"-")==0) ? stdin : fopen(argv[2],"r"))){
+            printf("batch: cannot open %s\n", argv[2]); return 1;
+        }
     }
-    else if(strcmp(argv[1],"password")==0 && argc>=4){
-        int r = users_change_password(argv[2], argv[3]);
-        puts(r==FS_OK ? "[OK]" : "[ERR] password");
-    } 
-    // 调试查看当前身份
-    else if(strcmp(argv[1],"whoami")==0){
-        printf("%s (uid=%d)\n", g_user, g_uid);
+
+    if(g_sock) return client_main(argc, argv, script);
+
+    int err;
+    if(!(g_v=mx_mount("disk.img", g_opts, &err))){
+        if(err!=FS_EINVAL) puts("[ERR] auto-mount disk.img fail (run format first)");
+        return 1;
+    }
+
+    if(strcmp(argv[1],"shell")==0) repl(stdin, isatty(STDIN_FILENO));
+    else if(script){ repl(script, 0); if(script!=stdin) fclose(script); }
+    else{
+        uint64_t t0=now_ns();
+        if(dispatch(argc-1, argv+1)<0) puts("[ERR] unknown or bad args");
+        if(g_timing) printf("[time] %s %.3f ms\n", argv[1], (now_ns()-t0)/1e6);
     }
-    else if(strcmp(argv[1],"chmod")==0 && argc>=4){ /* 你现有的 chmod 实现保持 */ }
-    else if(strcmp(argv[1],"writef")==0 && argc>=4){ cmd_writef(argv[2], argv[3]); }
-    else if(strcmp(argv[1],"readf")==0  && argc>=4){ cmd_readf(argv[2], atoi(argv[3])); }
-    else if(strcmp(argv[1],"writefile")==0 && argc>=4){ cmd_writefile(argv[2], argv[3]); }
-    else puts("[ERR] unknown or bad args");
 
-    dev_close();
+    mx_stats_t st;
+    mx_unmount(g_v, &st);
+    if(g_show_stats) mx_stats_print(stdout, &st, 0);
     return 0;
 }
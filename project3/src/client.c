@@ -0,0 +1,159 @@
+// src/client.c — mini_ext2 serve 的客户端连接（协议见 server.h）
+// 请求追加到发送缓冲即返回，回调在收到应答时按请求顺序执行。收发用 poll 交替进行：
+// 一边发一边收，双方套接字缓冲都满时也不会互相等死。
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+#define CL_WINDOW  64           // 在途请求上限，超过就先收应答
+#define CL_OUT_MAX (1u<<20)     // 发送缓冲积压上限，超过就先发出
+
+typedef struct { uint32_t tag; cl_done_cb cb; void* ctx; } pend_t;
+
+struct cl_conn {
+    int sock;
+    uint32_t tag;
+    uint8_t *out, *in;
+    uint32_t out_len, out_off, out_cap, in_len, in_cap;
+    pend_t* q;                  // 在途请求，环形队列
+    uint32_t qcap, qhead, qn;
+};
+
+static int reserve(uint8_t** b, uint32_t* cap, uint32_t need){
+    if(need<=*cap) return 0;
+    uint32_t n = *cap ? *cap : 65536;
+    while(n<need) n*=2;
+    uint8_t* p=(uint8_t*)realloc(*b, n);
+    if(!p) return -1;
+    *b=p; *cap=n;
+    return 0;
+}
+
+cl_conn_t* cl_connect(const char* path){
+    struct sockaddr_un a;
+    memset(&a, 0, sizeof a);
+    a.sun_family=AF_UNIX;
+    if(strlen(path)>=sizeof(a.sun_path)) return NULL;
+    strcpy(a.sun_path, path);
+    int s=socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if(s<0) return NULL;
+    if(connect(s, (struct sockaddr*)&a, sizeof a)<0){ close(s); return NULL; }
+    cl_conn_t* c=(cl_conn_t*)calloc(1, sizeof(cl_conn_t));
+    if(!c){ close(s); return NULL; }
+    c->sock=s;
+    return c;
+}
+
+// 连接断开：在途请求全部以 FS_ERR 回调
+static int fail_all(cl_conn_t* c){
+    if(c->sock>=0){ close(c->sock); c->sock=-1; }
+    while(c->qn){
+        pend_t p=c->q[c->qhead];
+        c->qhead=(c->qhead+1)%c->qcap; c->qn--;
+        if(p.cb) p.cb(p.ctx, FS_ERR, NULL, 0);
+    }
+    c->out_len=c->out_off=c->in_len=0;
+    return FS_ERR;
+}
+
+void cl_close(cl_conn_t* c){
+    if(!c) return;
+    cl_wait(c, 0);
+    fail_all(c);
+    free(c->out); free(c->in); free(c->q);
+    free(c);
+}
+
+// 处理收缓冲里完整的应答
+static int reap(cl_conn_t* c){
+    uint32_t pos=0;
+    srv_resp_t h;
+    while(c->in_len-pos>=sizeof h){
+        memcpy(&h, c->in+pos, sizeof h);
+        if(h.len>SRV_MSG_MAX || !c->qn || h.tag!=c->q[c->qhead].tag) return -1;
+        if(c->in_len-pos<sizeof h+h.len){
+            if(reserve(&c->in, &c->in_cap, (uint32_t)sizeof h+h.len)) return -1;
+            break;
+        }
+        pend_t p=c->q[c->qhead];
+        c->qhead=(c->qhead+1)%c->qcap; c->qn--;
+        if(p.cb) p.cb(p.ctx, h.res, c->in+pos+sizeof h, h.len);
+        pos+=(uint32_t)sizeof h+h.len;
+    }
+    memmove(c->in, c->in+pos, c->in_len-pos);
+    c->in_len-=pos;
+    return 0;
+}
+
+// 发完发送缓冲，并收应答直到在途不超过 keep 个
+static int pump(cl_conn_t* c, uint32_t keep){
+    while(c->out_off<c->out_len || c->qn>keep){
+        if(c->sock<0) return FS_ERR;
+        struct pollfd pf={ c->sock, (short)((c->qn ? POLLIN : 0) | (c->out_off<c->out_len ? POLLOUT : 0)), 0 };
+        if(poll(&pf, 1, -1)<0){ if(errno==EINTR) continue; return fail_all(c); }
+        if(pf.revents & POLLIN){
+            if(reserve(&c->in, &c->in_cap, c->in_len+65536)) return fail_all(c);
+            ssize_t n=read(c->sock, c->in+c->in_len, c->in_cap-c->in_len);
+            if(n<0 && errno==EINTR) continue;
+            if(n<=0) return fail_all(c);
+            c->in_len+=(uint32_t)n;
+            if(reap(c)) return fail_all(c);
+        }else if(pf.revents & (POLLERR|POLLHUP|POLLNVAL)) return fail_all(c);
+        if(pf.revents & POLLOUT){
+            ssize_t n=send(c->sock, c->out+c->out_off, c->out_len-c->out_off, MSG_NOSIGNAL|MSG_DONTWAIT);
+            if(n<0 && errno!=EAGAIN && errno!=EINTR) return fail_all(c);
+            if(n>0) c->out_off+=(uint32_t)n;
+        }
+    }
+    c->out_len=c->out_off=0;
+    return FS_OK;
+}
+
+int cl_wait(cl_conn_t* c, uint32_t keep){ return pump(c, keep); }
+
+int cl_send(cl_conn_t* c, int op, int flags, int fd, int arg, const void* p, uint32_t len,
+            cl_done_cb cb, void* ctx){
+    if(c->sock<0 || len>SRV_MSG_MAX){ if(cb) cb(ctx, c->sock<0 ? FS_ERR : FS_EINVAL, NULL, 0); return FS_ERR; }
+    if(c->qn==c->qcap){
+        uint32_t n = c->qcap ? c->qcap*2 : CL_WINDOW*2;
+        pend_t* q=(pend_t*)malloc(n*sizeof(pend_t));
+        if(!q){ if(cb) cb(ctx, FS_ERR, NULL, 0); return FS_ERR; }
+        for(uint32_t i=0;i<c->qn;i++) q[i]=c->q[(c->qhead+i)%c->qcap];
+        free(c->q);
+        c->q=q; c->qcap=n; c->qhead=0;
+    }
+    if(reserve(&c->out, &c->out_cap, c->out_len+(uint32_t)sizeof(srv_req_t)+len)){
+        if(cb) cb(ctx, FS_ERR, NULL, 0);
+        return FS_ERR;
+    }
+    srv_req_t h={ len, (uint16_t)op, (uint16_t)flags, ++c->tag, fd, arg };
+    memcpy(c->out+c->out_len, &h, sizeof h);
+    if(len) memcpy(c->out+c->out_len+sizeof h, p, len);
+    c->out_len+=(uint32_t)sizeof h+len;
+    c->q[(c->qhead+c->qn)%c->qcap]=(pend_t){ h.tag, cb, ctx };
+    c->qn++;
+    if(c->out_len-c->out_off>=CL_OUT_MAX) return pump(c, CL_WINDOW);
+    if(c->qn>CL_WINDOW) return pump(c, CL_WINDOW/2);
+    return FS_OK;
+}
+
+typedef struct { void* out; uint32_t cap; int res; } call_t;
+static void call_done(void* ctx, int res, const void* data, uint32_t len){
+    call_t* x=(call_t*)ctx;
+    x->res=res;
+    if(x->out && len) memcpy(x->out, data, len<x->cap ? len : x->cap);
+}
+
+int cl_call(cl_conn_t* c, int op, int flags, int fd, int arg, const void* p, uint32_t len,
+            void* out, uint32_t cap){
+    call_t x={ out, cap, FS_ERR };
+    cl_send(c, op, flags, fd, arg, p, len, call_done, &x);
+    cl_wait(c, 0);
+    return x.res;
+}
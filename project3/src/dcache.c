@@ -0,0 +1,62 @@
+// src/dcache.c — 路径分量缓存：(父目录 ino, 名字) → ino，ino==0 表示“不存在”（负项）
+// 直接映射哈希表，冲突即替换。dir_add/dir_remove 负责维护，卸载时清空。
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+#define DC_NENT 1024u   // 2 的幂
+
+typedef struct {
+    uint32_t parent, ino;
+    int valid;
+    char name[NAME_MAX_LEN];
+} dent_t;
+
+struct dcache_state {
+    dent_t ent[DC_NENT];
+    dcache_stats_t st;
+};
+#define dc (*g_vol->dcache)
+
+int dcache_vol_init(volume_t* v){ return (v->dcache=calloc(1, sizeof(*v->dcache))) ? FS_OK : FS_ERR; }
+void dcache_vol_free(volume_t* v){ free(v->dcache); v->dcache=NULL; }
+
+static uint32_t dc_slot(uint32_t parent, const char* name){
+    uint32_t h=2166136261u ^ parent;        // FNV-1a，父目录号作种子
+    for(int i=0;i<NAME_MAX_LEN && name[i];i++){ h^=(uint8_t)name[i]; h*=16777619u; }
+    return h & (DC_NENT-1);
+}
+
+// 命中返回 1（*ino==0 为负项），未命中返回 0
+int dcache_lookup(uint32_t parent, const char* name, uint32_t* ino){
+    dent_t* e=&dc.ent[dc_slot(parent,name)];
+    if(e->valid && e->parent==parent && strncmp(e->name,name,NAME_MAX_LEN)==0){
+        if(e->ino) dc.st.hits++; else dc.st.neg_hits++;
+        *ino=e->ino;
+        return 1;
+    }
+    dc.st.misses++;
+    return 0;
+}
+
+void dcache_insert(uint32_t parent, const char* name, uint32_t ino){
+    dent_t* e=&dc.ent[dc_slot(parent,name)];
+    e->parent=parent; e->ino=ino; e->valid=1;
+    strncpy(e->name, name, NAME_MAX_LEN-1); e->name[NAME_MAX_LEN-1]='\0';
+}
+
+// 目录被删除后其 ino 可能被复用：丢掉以它为父目录的所有项，以及指向它的正项
+void dcache_purge_dir(uint32_t dir_ino){
+    for(uint32_t i=0;i<DC_NENT;i++){
+        dent_t* e=&dc.ent[i];
+        if(e->valid && (e->parent==dir_ino || e->ino==dir_ino)) e->valid=0;
+    }
+}
+
+void dcache_drop(){
+    dcache_stats_t keep=dc.st;
+    memset(&dc, 0, sizeof(dc));
+    dc.st=keep;
+}
+
+void dcache_get_stats(dcache_stats_t* out){ if(out) *out=dc.st; }
@@ -0,0 +1,246 @@
+// src/delalloc.c — 延迟分配：fs_write 写到尚未映射的逻辑块时，数据先留在内存（每 inode 一组，
+// 按逻辑块号升序），只按块数预留空间、不动位图；到 close / sync / 缓冲超限时才按逻辑块顺序
+// 成段分配物理块（alloc_block_run），一段一次写出。多次小追加因此落在连续的物理块上。
+// 已映射的块不经过这里，照常走块缓存；缓冲中的块一定尚未映射。
+// aio 打开时每段拼进各自的缓冲异步写出，多段（包括 da_flush_all 里多个 inode 的）同时在途。
+// 持共享卷锁时只有 da_write/da_peek 会进来（各自加锁），刷盘与丢弃都在独占卷时做；
+// 一个 inode 的缓冲块只由持该 inode 写锁的线程改动。
+// 刷盘失败（空间不足、I/O 错误）时没写出去的块留在缓冲里，之后的 sync/close 重试并继续报错。
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+#define DA_MAX_INODES  64
+#define DA_MAX_BYTES   (4u<<20)         // 缓冲总量上限，超过则全部刷盘
+#define DA_STAGE       (256u<<10)       // 刷盘时一段最多拼这么多字节一次写出
+
+typedef struct { uint32_t lbn; uint8_t* data; } da_blk_t;
+typedef struct {
+    uint32_t ino;               // 0=空槽
+    uint32_t n, cap;            // blk[0..n) 按 lbn 升序
+    da_blk_t* blk;
+    uint32_t resv;              // 已预留块数（数据块 + 间接表/extent 块余量）
+} da_inode_t;
+
+struct da_state {
+    uint8_t stage[DA_STAGE];    // 刷盘时拼段
+    da_inode_t ino[DA_MAX_INODES];
+    uint64_t bytes;
+    uint32_t victim;
+    da_stats_t st;
+    pthread_mutex_t lock;
+};
+#define da        (g_vol->delalloc->ino)
+#define da_bytes  (g_vol->delalloc->bytes)
+#define da_victim (g_vol->delalloc->victim)
+#define da_st     (g_vol->delalloc->st)
+#define da_stage  (g_vol->delalloc->stage)
+
+int da_vol_init(volume_t* v){
+    void* p=NULL;
+    if(posix_memalign(&p, 4096, sizeof(struct da_state))!=0) return FS_ERR;
+    memset(p, 0, sizeof(struct da_state));
+    v->delalloc=(struct da_state*)p;
+    pthread_mutex_init(&v->delalloc->lock, NULL);
+    return FS_OK;
+}
+void da_vol_free(volume_t* v){
+    if(v->delalloc) pthread_mutex_destroy(&v->delalloc->lock);
+    free(v->delalloc); v->delalloc=NULL;
+}
+#define LOCK()   pthread_mutex_lock(&g_vol->delalloc->lock)
+#define UNLOCK() pthread_mutex_unlock(&g_vol->delalloc->lock)
+
+// n 个数据块最坏还要多少映射块，取两种映射的较大者：
+// 间接映射每 BSIZE/4 个一张表，再加二、三级的根；extent 按每块各成一项、叶和索引都半满分裂算，
+// 再加从叶到根一路分裂和树长高的节点
+static uint32_t da_need(uint32_t n){
+    uint32_t ind = n/(BSIZE/4u) + 3u;
+    uint32_t leaf = n/(EXT_LEAF_MAX/2u);
+    uint32_t ext = leaf + leaf/(EXT_IDX_MAX/2u) + EXT_MAX_DEPTH + 1u;
+    return n + (ind > ext ? ind : ext);
+}
+
+static da_inode_t* da_find(uint32_t ino){
+    for(int i=0;i<DA_MAX_INODES;i++) if(da[i].ino==ino) return &da[i];
+    return NULL;
+}
+
+// 二分：lbn 所在或应插入的位置
+static uint32_t da_pos(const da_inode_t* d, uint32_t lbn){
+    uint32_t lo=0, hi=d->n;
+    while(lo<hi){ uint32_t mid=(lo+hi)/2; if(d->blk[mid].lbn<lbn) lo=mid+1; else hi=mid; }
+    return lo;
+}
+
+static void da_release(da_inode_t* d){
+    for(uint32_t i=0;i<d->n;i++) free(d->blk[i].data);
+    free(d->blk);
+    da_bytes -= (uint64_t)d->n * BSIZE;
+    block_unreserve(d->resv);
+    memset(d, 0, sizeof(*d));
+}
+
+static int da_write_l(uint32_t ino, uint32_t lbn, uint32_t off, const void* src, uint32_t len){
+    da_inode_t* d = da_find(ino);
+    if(!d){
+        if(!(d = da_find(0))){              // 槽满：轮流挑一个别的 inode 刷掉（要独占卷）
+            if(vol_shared()) return vol_defer();
+            d = &da[da_victim++ % DA_MAX_INODES];
+            int r = da_flush(d->ino); if(r != FS_OK) return r;
+        }
+        d->ino = ino;
+    }
+    uint32_t k = da_pos(d, lbn);
+    if(k < d->n && d->blk[k].lbn == lbn){
+        memcpy(d->blk[k].data + off, src, len);
+        return FS_OK;
+    }
+
+    uint32_t need = da_need(d->n + 1);
+    if(need > d->resv){
+        int r = block_reserve(need - d->resv); if(r != FS_OK) return r;
+        d->resv = need;
+    }
+    if(d->n == d->cap){
+        uint32_t ncap = d->cap ? d->cap*2 : 16;
+        da_blk_t* nb = (da_blk_t*)realloc(d->blk, ncap*sizeof(da_blk_t));
+        if(!nb) return FS_ERR;
+        d->blk = nb; d->cap = ncap;
+    }
+    uint8_t* data = (uint8_t*)malloc(BSIZE);
+    if(!data) return FS_ERR;
+    memset(data, 0, BSIZE);
+    memcpy(data + off, src, len);
+    memmove(&d->blk[k+1], &d->blk[k], (d->n-k)*sizeof(da_blk_t));
+    d->blk[k] = (da_blk_t){ lbn, data };
+    d->n++;
+    da_bytes += BSIZE;
+    da_st.buffered++;
+    return FS_OK;
+}
+
+int da_write(uint32_t ino, uint32_t lbn, uint32_t off, const void* src, uint32_t len){
+    LOCK();
+    int r = da_write_l(ino, lbn, off, src, len);
+    UNLOCK();
+    return r;
+}
+
+const void* da_peek(uint32_t ino, uint32_t lbn){
+    LOCK();
+    da_inode_t* d = da_find(ino);
+    const void* p = NULL;
+    if(d && d->n){
+        uint32_t k = da_pos(d, lbn);
+        if(k < d->n && d->blk[k].lbn == lbn) p = d->blk[k].data;
+    }
+    UNLOCK();
+    return p;
+}
+
+void da_discard(uint32_t ino){
+    da_inode_t* d = ino ? da_find(ino) : NULL;
+    if(d) da_release(d);
+}
+
+static void stage_done(void* arg, int res){ (void)res; free(arg); }
+
+// 一段拼好的缓冲：异步时各段各自分配（写完释放），否则共用 da_stage
+static uint8_t* stage_get(uint32_t n){
+    void* p = NULL;
+    if(!dev_aio_async()) return da_stage;
+    if(posix_memalign(&p, 4096, (size_t)n*BSIZE) == 0) return (uint8_t*)p;
+    while(dev_aio_poll(1) > 0);     // 分配失败时退回 da_stage：先等之前的段写完（错误留给 drain）
+    return da_stage;
+}
+
+// 不等写盘完成，调用方 dev_aio_drain
+static int da_flush_one(uint32_t ino){
+    da_inode_t* d = ino ? da_find(ino) : NULL;
+    if(!d) return FS_OK;
+    if(!d->n){ da_release(d); return FS_OK; }
+    inode_t in;
+    if(read_inode(ino, &in) != FS_OK) return FS_ERR;
+
+    block_unreserve(d->resv); d->resv = 0;   // 下面的分配就用这部分空间
+    uint32_t max = DA_STAGE / BSIZE;
+    int r = FS_OK;
+    uint32_t i = 0;
+    while(i<d->n && r==FS_OK){
+        // 逻辑连续的一段，尽量分到一段物理连续块；第一块以前一逻辑块的物理后继为目标
+        uint32_t want = 1;
+        while(i+want < d->n && want < max && d->blk[i+want].lbn == d->blk[i].lbn + want) want++;
+        int prev = d->blk[i].lbn ? map_bn(&in, d->blk[i].lbn - 1, 0, NULL) : -1;
+        uint32_t got = 0;
+        int start = alloc_block_run(prev >= 0 ? (uint32_t)prev + 1 : 0, want, &got);
+        if(start < 0){ r = start; break; }
+        uint8_t* stage = stage_get(got);
+
+        // 先建好映射（缺的间接表此时才分配，排在数据段之后），再把整段一次写出
+        uint32_t used = got;                // 本段消耗的缓冲块数
+        for(uint32_t k=0; k<got; k++){
+            uint32_t pb = (uint32_t)start + k;
+            int p = map_bn_assign(&in, d->blk[i+k].lbn, pb, NULL);
+            if(p < 0){ for(uint32_t j=k; j<got; j++) free_block((uint32_t)start + j); got = used = k; r = p; break; }
+            if((uint32_t)p != pb){
+                // 已有映射：这块写到原处，段在此截断，余下的块不在本段写出范围内才能退还
+                for(uint32_t j=k; j<got; j++) free_block((uint32_t)start + j);
+                got = k;
+                if(dev_write_block(d->blk[i+k].data, (uint32_t)p) == FS_OK) used = k+1;
+                else{ used = k; r = FS_ERR; }
+                break;
+            }
+            memcpy(stage + (size_t)k*BSIZE, d->blk[i+k].data, BSIZE);
+        }
+        if(stage == da_stage){ if(got && dev_write_blocks(stage, (uint32_t)start, got) != FS_OK) r = FS_ERR; }
+        else if(!got) free(stage);
+        else if(dev_write_blocks_async(stage, (uint32_t)start, got, stage_done, stage) != FS_OK){ free(stage); r = FS_ERR; }
+        da_st.flushed += got; da_st.runs += got ? 1 : 0;
+        i += used;
+    }
+    if(write_inode(ino, &in) != FS_OK) r = FS_ERR;
+    da_st.flushes++;
+    if(i == d->n){ da_release(d); return r; }
+
+    // 没刷完：已写出的块移出缓冲，其余留待下次，重新按剩下的块预留（不够就不留，后续写入会被拒绝）
+    for(uint32_t k=0;k<i;k++) free(d->blk[k].data);
+    memmove(d->blk, d->blk + i, (d->n - i)*sizeof(da_blk_t));
+    d->n -= i;
+    da_bytes -= (uint64_t)i * BSIZE;
+    if(block_reserve(da_need(d->n)) == FS_OK) d->resv = da_need(d->n);
+    return r;
+}
+
+int da_flush(uint32_t ino){
+    int r = da_flush_one(ino);
+    return dev_aio_drain() == FS_OK ? r : FS_ERR;
+}
+
+int da_flush_all(){
+    int r = FS_OK;
+    for(int i=0;i<DA_MAX_INODES;i++)
+        if(da[i].ino && da_flush_one(da[i].ino) != FS_OK) r = FS_ERR;
+    return dev_aio_drain() == FS_OK ? r : FS_ERR;
+}
+
+// 卸载时仍刷不出去的块只能丢弃（卸载已报错）：文件长度退回到第一个丢失的块，
+// 不留一段 size 之内却读不出来的尾巴
+void da_drop_all(){
+    for(int i=0;i<DA_MAX_INODES;i++){
+        da_inode_t* d = &da[i];
+        if(!d->ino) continue;
+        inode_t in;
+        if(d->n && read_inode(d->ino, &in) == FS_OK && in.size > d->blk[0].lbn * BSIZE){
+            in.size = d->blk[0].lbn * BSIZE;
+            write_inode(d->ino, &in);
+        }
+        da_release(d);
+    }
+}
+
+// fs_write 结束时调用：缓冲总量超限就全部刷盘
+int da_balance(){ return da_over() ? da_flush_all() : FS_OK; }
+int da_over(){ LOCK(); int r = da_bytes > DA_MAX_BYTES; UNLOCK(); return r; }
+
+void da_get_stats(da_stats_t* out){ if(out){ LOCK(); *out = da_st; UNLOCK(); } }
@@ -1,33 +1,280 @@
+#define _GNU_SOURCE
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "fs.h"
 
-superblock_t g_sb;
-group_desc_t g_gd;
-FILE* g_dev = NULL;
-ofile_t g_ofile[MAX_OPEN] = {0};
-uint32_t g_cwd = 1;
+const uint8_t g_zero_block[BLOCK_SIZE_MAX];
 
-int  g_uid = 0;                 // 初始 root
-char g_user[MAX_USER_LEN] = "root";
+#define g_devstat (g_vol->devstat)
+// 计数可能被持共享卷锁的多个线程同时累加
+#define STAT_ADD(f, n) __atomic_fetch_add(&g_devstat.f, (n), __ATOMIC_RELAXED)
+
+// 块读写都按偏移走 pread/pwrite，没有共享的文件读写位置，多个线程可同时读写设备。
+// stdio 后端只用 FILE* 打开/关闭，块 I/O 同样经 fileno；pread 后端可选 O_DIRECT
+// （调用方缓冲未对齐时经栈上的对齐中转缓冲）
+#define DIO_ALIGN 4096u
+#define g_fd      (g_vol->fd)
+#define g_direct  (g_vol->direct)
+
+// mmap 后端：整个镜像映射进内存，块读写即 memcpy，刷盘用 msync。
+// 映射长度取决于超级块里的卷大小，所以在 dev_attach 中才建立
+#define g_map     (g_vol->map)
+#define g_maplen  (g_vol->maplen)
+
+static int dev_is_open(){ return g_dev!=NULL || g_fd>=0; }
+// 块号越界或设备未打开
+#define DEV_BAD(b) (!dev_is_open() || (b)>=g_sb.blocks_count)
+
+static int open_flags(const char* mode){
+    int fl = O_RDWR;
+    if(mode && mode[0]=='w') fl |= O_CREAT|O_TRUNC;
+    return fl;
+}
 
 int dev_open(const char* path, const char* mode){
-    if(g_dev) return FS_OK;
-    g_dev = fopen(path, mode);
-    return g_dev ? FS_OK : FS_ERR;
+    if(dev_is_open()) return FS_OK;
+    if(g_mopt.backend==DEV_STDIO){
+        g_dev = fopen(path, mode);
+        if(!g_dev) return FS_ERR;
+        g_fd = fileno(g_dev); g_direct = 0;
+        return FS_OK;
+    }
+    int fl = open_flags(mode);
+    g_direct = 0;
+    if(g_mopt.backend==DEV_MMAP){
+        g_fd = open(path, fl, 0644);
+        return g_fd>=0 ? FS_OK : FS_ERR;
+    }
+    if(g_mopt.direct){
+        g_fd = open(path, fl|O_DIRECT, 0644);
+        if(g_fd>=0) g_direct = 1;
+        // tmpfs 等不支持 O_DIRECT：退回普通 pread/pwrite
+    }
+    if(g_fd<0) g_fd = open(path, fl, 0644);
+    return g_fd>=0 ? FS_OK : FS_ERR;
+}
+// g_sb 的块大小/块数确定后调用：mmap 后端按卷大小映射（镜像不足则补齐）
+int dev_attach(){
+    if(!dev_is_open() || g_mopt.backend!=DEV_MMAP || g_map) return FS_OK;
+    g_maplen = (size_t)g_sb.blocks_count*BSIZE;
+    off_t cur = lseek(g_fd, 0, SEEK_END);
+    if(cur < (off_t)g_maplen && ftruncate(g_fd, (off_t)g_maplen)!=0) return FS_ERR;
+    void* p = mmap(NULL, g_maplen, PROT_READ|PROT_WRITE, MAP_SHARED, g_fd, 0);
+    if(p==MAP_FAILED) return FS_ERR;
+    g_map=(uint8_t*)p;
+    return FS_OK;
+}
+
+// format 用：把镜像截断/扩展到 bytes，未写过的部分是文件空洞，不占宿主机空间
+int dev_truncate(uint64_t bytes){
+    if(!dev_is_open() || g_map) return FS_ERR;
+    return ftruncate(g_fd, (off_t)bytes)==0 ? FS_OK : FS_ERR;
+}
+
+// 按字节偏移读，不经缓存（挂载前还不知道块大小，用于探测超级块）
+int dev_read_at(void* buf, uint32_t len, uint64_t off){
+    if(!dev_is_open()) return FS_ERR;
+    if(!g_direct) return pread(g_fd, buf, len, (off_t)off)==(ssize_t)len ? FS_OK : FS_ERR;
+    // O_DIRECT：按对齐单位读进中转缓冲再截取
+    uint64_t a=off & ~(uint64_t)(DIO_ALIGN-1);
+    if(off-a+len > DIO_ALIGN) return FS_ERR;
+    uint8_t bounce[DIO_ALIGN] __attribute__((aligned(DIO_ALIGN)));
+    ssize_t n=pread(g_fd, bounce, DIO_ALIGN, (off_t)a);
+    if(n<0 || (uint64_t)n < off-a+len) return FS_ERR;
+    memcpy(buf, bounce+(off-a), len);
+    return FS_OK;
 }
+
 int dev_close(){
-    if(!g_dev) return FS_OK;
-    int r=fclose(g_dev); g_dev=NULL; return r==0?FS_OK:FS_ERR;
+    if(!dev_is_open()) return FS_OK;
+    int r0=bcache_flush(); bcache_invalidate();
+    int r;
+    if(g_map){
+        if(msync(g_map, g_maplen, MS_SYNC)!=0) r0=FS_ERR;
+        munmap(g_map, g_maplen); g_map=NULL; g_maplen=0;
+    }
+    if(g_dev){ r=fclose(g_dev); g_dev=NULL; }
+    else r=close(g_fd);
+    g_fd=-1;
+    return (r==0 && r0==FS_OK)?FS_OK:FS_ERR;
+}
+// 把缓存脏块写回并刷到宿主机磁盘（日志提交依赖这里的 fdatasync）
+int dev_sync(){
+    if(!dev_is_open()) return FS_OK;
+    int r=bcache_flush();
+    STAT_ADD(syncs, 1);
+    uint64_t t0=TRACE_T0();
+    if(g_map ? msync(g_map, g_maplen, MS_SYNC)!=0 : fdatasync(g_fd)!=0) r=FS_ERR;
+    TRACE(TR_DEV_SYNC, t0, 0, 0, r, NULL);
+    return r;
+}
+
+// O_DIRECT 下设备扇区大于块大小时 pread 返回 EINVAL：关掉 O_DIRECT 后重试
+static int direct_fallback(){
+    if(!g_direct || errno!=EINVAL) return 0;
+    int fl=fcntl(g_fd, F_GETFL);
+    if(fl<0 || fcntl(g_fd, F_SETFL, fl & ~O_DIRECT)<0) return 0;
+    g_direct=0;
+    return 1;
+}
+
+// 一次 pread/pwrite 传 cnt 个连续块；短读写时接着传剩下的部分。
+// O_DIRECT 要求缓冲对齐：调用方缓冲未对齐时逐块经中转缓冲
+static int fd_read(void* buf, uint32_t blk_no, uint32_t cnt){
+    uint8_t* p=(uint8_t*)buf;
+    uint8_t tmp[BLOCK_SIZE_MAX] __attribute__((aligned(DIO_ALIGN)));
+    for(uint32_t i=0; i<cnt; ){
+        int bounce = g_direct && ((uintptr_t)p & (DIO_ALIGN-1));
+        size_t len = bounce ? BSIZE : (size_t)(cnt-i)*BSIZE;
+        ssize_t n=pread(g_fd, bounce? (void*)tmp : (void*)p, len, (off_t)(blk_no+i)*BSIZE);
+        if(n<0 && direct_fallback()) continue;
+        if(n<=0 || n%BSIZE) return FS_ERR;
+        if(bounce) memcpy(p, tmp, BSIZE);
+        i+=(uint32_t)(n/BSIZE); p+=n;
+    }
+    return FS_OK;
+}
+static int fd_write(const void* buf, uint32_t blk_no, uint32_t cnt){
+    const uint8_t* p=(const uint8_t*)buf;
+    uint8_t tmp[BLOCK_SIZE_MAX] __attribute__((aligned(DIO_ALIGN)));
+    for(uint32_t i=0; i<cnt; ){
+        int bounce = g_direct && ((uintptr_t)p & (DIO_ALIGN-1));
+        size_t len = bounce ? BSIZE : (size_t)(cnt-i)*BSIZE;
+        if(bounce) memcpy(tmp, p, BSIZE);
+        ssize_t n=pwrite(g_fd, bounce? (const void*)tmp : (const void*)p, len, (off_t)(blk_no+i)*BSIZE);
+        if(n<0 && direct_fallback()) continue;
+        if(n<=0 || n%BSIZE) return FS_ERR;
+        i+=(uint32_t)(n/BSIZE); p+=n;
+    }
+    return FS_OK;
+}
+
+int dev_io(int wr, void* buf, uint32_t blk_no, uint32_t cnt){
+    return wr ? fd_write(buf, blk_no, cnt) : fd_read(buf, blk_no, cnt);
+}
+
+// ---- 直接访问宿主文件（仅供缓存层使用）：cnt 个连续块算一次宿主机读/写 ----
+int dev_raw_readn(void* buf, uint32_t blk_no, uint32_t cnt){
+    if(DEV_BAD(blk_no) || cnt > g_sb.blocks_count-blk_no) return FS_ERR;
+    uint64_t t0=now_ns(); int r=FS_OK; size_t len=(size_t)cnt*BSIZE;
+    if(g_map) memcpy(buf, g_map+(size_t)blk_no*BSIZE, len);
+    else r=fd_read(buf, blk_no, cnt);
+    STAT_ADD(reads, 1); STAT_ADD(read_blocks, cnt); STAT_ADD(read_ns, now_ns()-t0);
+    TRACE(TR_DEV_READ, t0, blk_no, cnt, r, NULL);
+    return r;
 }
+int dev_raw_writen(const void* buf, uint32_t blk_no, uint32_t cnt){
+    if(DEV_BAD(blk_no) || cnt > g_sb.blocks_count-blk_no) return FS_ERR;
+    uint64_t t0=now_ns(); int r=FS_OK; size_t len=(size_t)cnt*BSIZE;
+    if(g_map) memcpy(g_map+(size_t)blk_no*BSIZE, buf, len);
+    else r=fd_write(buf, blk_no, cnt);
+    STAT_ADD(writes, 1); STAT_ADD(write_blocks, cnt); STAT_ADD(write_ns, now_ns()-t0);
+    TRACE(TR_DEV_WRITE, t0, blk_no, cnt, r, NULL);
+    return r;
+}
+int dev_raw_read(void* buf, uint32_t blk_no){ return dev_raw_readn(buf, blk_no, 1); }
+int dev_raw_write(const void* buf, uint32_t blk_no){ return dev_raw_writen(buf, blk_no, 1); }
+
+// ---- 对上层的块接口：经过块缓存；mmap 模式直接 memcpy 映射区 ----
+// 本事务里改过的元数据块以日志中的映像为准（提交前不会写到缓存/原位置）
 int dev_read_block(void* buf, uint32_t blk_no){
-    if(!g_dev || blk_no>=TOTAL_BLOCKS) return FS_ERR;
-    if(fseek(g_dev, (long)blk_no*BLOCK_SIZE, SEEK_SET)!=0) return FS_ERR;
-    return fread(buf,1,BLOCK_SIZE,g_dev)==BLOCK_SIZE?FS_OK:FS_ERR;
+    if(DEV_BAD(blk_no)) return FS_ERR;
+    STAT_ADD(blk_reads, 1);
+    if(journal_read(buf, blk_no)) return FS_OK;
+    if(g_map){ memcpy(buf, g_map+(size_t)blk_no*BSIZE, BSIZE); return FS_OK; }
+    return bcache_read(buf, blk_no);
 }
 int dev_write_block(const void* buf, uint32_t blk_no){
-    if(!g_dev || blk_no>=TOTAL_BLOCKS) return FS_ERR;
-    if(fseek(g_dev, (long)blk_no*BLOCK_SIZE, SEEK_SET)!=0) return FS_ERR;
-    if(fwrite(buf,1,BLOCK_SIZE,g_dev)!=BLOCK_SIZE) return FS_ERR;
-    fflush(g_dev);
+    if(DEV_BAD(blk_no)) return FS_ERR;
+    STAT_ADD(blk_writes, 1);
+    if(journal_update(buf, blk_no)) return FS_OK;
+    if(g_map){ memcpy(g_map+(size_t)blk_no*BSIZE, buf, BSIZE); return FS_OK; }
+    return bcache_write(buf, blk_no);
+}
+// 元数据块写：有日志时记入当前事务，否则同 dev_write_block
+int dev_write_meta(const void* buf, uint32_t blk_no){
+    if(DEV_BAD(blk_no)) return FS_ERR;
+    if(journal_active()){ STAT_ADD(blk_writes, 1); return journal_log(buf, blk_no); }
+    return dev_write_block(buf, blk_no);
+}
+// 借出块内容的只读指针，省去拷进栈缓冲的整块 memcpy。
+// 指针只在下一次 dev_* 调用之前有效（缓存块可能被淘汰），调用方不得跨调用保存。
+// 共享模式下别的线程随时可能淘汰缓存块、提交日志，改为拷进本线程的缓冲
+static __thread uint8_t t_peek[BLOCK_SIZE_MAX];
+const void* dev_peek_block(uint32_t blk_no){
+    if(DEV_BAD(blk_no)) return NULL;
+    STAT_ADD(blk_reads, 1);
+    if(vol_shared()){
+        if(journal_read(t_peek, blk_no)) return t_peek;
+        if(g_map) return g_map+(size_t)blk_no*BSIZE;
+        return bcache_read(t_peek, blk_no)==FS_OK ? t_peek : NULL;
+    }
+    const void* j=journal_peek(blk_no);
+    if(j) return j;
+    if(g_map) return g_map+(size_t)blk_no*BSIZE;
+    return bcache_peek(blk_no);
+}
+
+// 顺序预读 [blk, blk+n)：缓存里没有的连续段各用一次宿主机读取装入缓存；
+// mmap 模式没有块缓存，交给内核预读映射页
+int dev_readahead(uint32_t blk, uint32_t n){
+    if(DEV_BAD(blk) || n==0) return FS_ERR;
+    if(n > g_sb.blocks_count-blk) n = g_sb.blocks_count-blk;
+    if(g_map){
+        size_t off=(size_t)blk*BSIZE, a=off & ~(size_t)(DIO_ALIGN-1);
+        return madvise(g_map+a, off-a+(size_t)n*BSIZE, MADV_WILLNEED)==0 ? FS_OK : FS_ERR;
+    }
+    return bcache_readahead(blk, n);
+}
+
+// 整块对齐的大读写：mmap 直接 memcpy，否则一次 pread/pwrite 传整段，
+// 读时缓存中的副本（可能未写回）优先，写后同步刷新缓存副本
+int dev_read_blocks(void* buf, uint32_t blk_no, uint32_t cnt){
+    if(DEV_BAD(blk_no) || cnt > g_sb.blocks_count-blk_no) return FS_ERR;
+    STAT_ADD(blk_reads, cnt);
+    if(g_map){ memcpy(buf, g_map+(size_t)blk_no*BSIZE, (size_t)cnt*BSIZE); return FS_OK; }
+    return bcache_readn(buf, blk_no, cnt);
+}
+int dev_write_blocks(const void* buf, uint32_t blk_no, uint32_t cnt){
+    if(DEV_BAD(blk_no) || cnt > g_sb.blocks_count-blk_no) return FS_ERR;
+    STAT_ADD(blk_writes, cnt);
+    if(g_map){ memcpy(g_map+(size_t)blk_no*BSIZE, buf, (size_t)cnt*BSIZE); return FS_OK; }
+    return bcache_writen(buf, blk_no, cnt);
+}
+// 有缓存副本时包一层回调：写成功后副本才标为干净，再交给调用方（它可能就此释放 buf）
+typedef struct { const void* buf; uint32_t blk, cnt; dev_aio_cb cb; void* arg; } wr_ctx_t;
+
+static void write_done(void* arg, int res){
+    wr_ctx_t* c=(wr_ctx_t*)arg;
+    if(res==FS_OK) bcache_written(c->buf, c->blk, c->cnt);
+    if(c->cb) c->cb(c->arg, res);
+    free(c);
+}
+
+int dev_write_blocks_async(const void* buf, uint32_t blk_no, uint32_t cnt, dev_aio_cb cb, void* arg){
+    if(DEV_BAD(blk_no) || cnt > g_sb.blocks_count-blk_no) return FS_ERR;
+    STAT_ADD(blk_writes, cnt);
+    if(g_map){
+        memcpy(g_map+(size_t)blk_no*BSIZE, buf, (size_t)cnt*BSIZE);
+        if(cb) cb(arg, FS_OK);
+        return FS_OK;
+    }
+    if(!bcache_update(buf, blk_no, cnt)) return dev_aio_write(buf, blk_no, cnt, cb, arg);
+    wr_ctx_t* c=(wr_ctx_t*)malloc(sizeof(wr_ctx_t));
+    if(!c) return FS_ERR;       // 副本已是新内容且为脏，之后刷盘照样写出
+    *c=(wr_ctx_t){ buf, blk_no, cnt, cb, arg };
+    if(dev_aio_write(buf, blk_no, cnt, write_done, c)!=FS_OK){ free(c); return FS_ERR; }
     return FS_OK;
 }
+
+void dev_get_stats(dev_stats_t* out){
+    if(!out) return;
+    *out=g_devstat;
+    out->backend = g_mopt.backend;
+    out->direct  = g_direct;
+    out->block_size = BSIZE;
+}
@@ -1,71 +1,265 @@
 #include <string.h>
+#include <stdlib.h>
 #include "fs.h"
 
-// 目录：仅用直指针，顺序存 64B dirent
-static int read_dir_block(inode_t* in, uint32_t bn, uint8_t* buf){
-    if(bn>=NDIRECT) return FS_ERR;
-    if(in->direct[bn]==0) return FS_ERR;
-    return dev_read_block(buf, in->direct[bn]);
-}
+// 目录：顺序存放定长 64B dirent（删除只清零 ino，不回收槽位），
+// 数据块经 map_bn_for_read/map_bn_for_write 映射，可以越过直指针使用间接块。
+#define DE_PER_BLK  (BSIZE/sizeof(dirent_t))
+
 static int ensure_dir_block(inode_t* in, uint32_t bn, uint8_t* blkbuf){
-    if(bn>=NDIRECT) return FS_ENOSPC;
-    if(in->direct[bn]==0){
-        int b=alloc_block(); if(b<0) return b;
-        memset(blkbuf,0,BLOCK_SIZE); dev_write_block(blkbuf,(uint32_t)b);
-        in->direct[bn]=(uint32_t)b; in->blocks++; ts_now(&in->ctime);
+    int b=map_bn_for_write(in, bn);          // 新块已清零
+    if(b<0) return b;
+    return dev_read_block(blkbuf, (uint32_t)b);
+}
+
+// ===== 哈希目录索引 =====
+// 超过一个块的目录建立索引：索引数据放在一个不挂在任何目录下的隐藏 inode（dx_ino）里，
+// 目录 inode 以 INODE_FL_INDEX 标记。dirent 本身的格式与排列不变，不认识索引的代码
+// 照旧线性扫描即可。索引文件：
+//   块 0    dx_hdr_t
+//   块 1..N 开放寻址哈希表，每项 (hash, 槽号+1)，0=空，DX_TOMB=已删除
+// 头部记录建索引时目录的槽位数，不一致（例如被旧代码追加过）就整体重建。
+#define DX_MAGIC     0x44584831u   // "DXH1"
+#define DX_TOMB      0xFFFFFFFFu
+#define DX_PER_BLK   (BSIZE/sizeof(dx_ent_t))
+
+typedef struct { uint32_t hash, slot; } dx_ent_t;
+typedef struct {
+    uint32_t magic;
+    uint32_t nblocks;       // 哈希表块数（2 的幂）
+    uint32_t live, tomb;    // 有效项 / 墓碑
+    uint32_t dir_slots;     // 对应的目录槽位数 = din.size/64
+} dx_hdr_t;
+
+static uint32_t dx_hash(const char* name){
+    uint32_t h=2166136261u;                 // FNV-1a
+    for(int i=0;i<NAME_MAX_LEN && name[i];i++){ h^=(uint8_t)name[i]; h*=16777619u; }
+    return h ? h : 1;
+}
+
+static int dx_read_hdr(const inode_t* xin, dx_hdr_t* h){
+    inode_t tmp=*xin;
+    int b=map_bn_for_read(&tmp, 0); if(b<0) return FS_ERR;
+    const uint8_t* p=dev_peek_block((uint32_t)b); if(!p) return FS_ERR;
+    memcpy(h, p, sizeof(*h));
+    return h->magic==DX_MAGIC && h->nblocks ? FS_OK : FS_ERR;
+}
+static int dx_write_hdr(inode_t* xin, const dx_hdr_t* h){
+    int b=map_bn_for_write(xin, 0); if(b<0) return b;
+    uint8_t buf[BLOCK_SIZE_MAX]={0}; memcpy(buf, h, sizeof(*h));
+    return dev_write_meta(buf, (uint32_t)b);
+}
+
+// 读槽位 slot 处的目录项
+static int dir_slot(inode_t* din, uint32_t slot, dirent_t* out){
+    int b=map_bn_for_read(din, slot/DE_PER_BLK); if(b<0) return FS_ERR;
+    const uint8_t* p=dev_peek_block((uint32_t)b); if(!p) return FS_ERR;
+    memcpy(out, p+(slot%DE_PER_BLK)*sizeof(dirent_t), sizeof(*out));
+    return FS_OK;
+}
+
+// 线性重建：扫描全部槽位，在内存里建好表后顺序写出
+static int dx_build(uint32_t dir_ino, inode_t* din){
+    uint32_t slots=din->size/sizeof(dirent_t), live=0;
+    for(uint32_t i=0;i<slots;i++){ dirent_t de; if(dir_slot(din,i,&de)==FS_OK && de.ino) live++; }
+
+    uint32_t nblocks=1;                      // 负载因子 <= 1/2
+    while(nblocks*DX_PER_BLK < live*2+2) nblocks<<=1;
+    uint32_t cap=nblocks*DX_PER_BLK;
+    dx_ent_t* tbl=(dx_ent_t*)calloc(cap, sizeof(dx_ent_t)); if(!tbl) return FS_ERR;
+    for(uint32_t i=0;i<slots;i++){
+        dirent_t de; if(dir_slot(din,i,&de)!=FS_OK || !de.ino) continue;
+        uint32_t h=dx_hash(de.name), g=h&(cap-1);
+        while(tbl[g].slot) g=(g+1)&(cap-1);
+        tbl[g].hash=h; tbl[g].slot=i+1;
+    }
+
+    // 复用或新建索引 inode；旧内容整体丢弃
+    inode_t xin;
+    if(din->flags & INODE_FL_INDEX){
+        inode_truncate(din->dx_ino);
+        if(read_inode(din->dx_ino,&xin)!=FS_OK){ free(tbl); return FS_ERR; }
     }else{
-        dev_read_block(blkbuf, in->direct[bn]);
+        int x=alloc_inode(); if(x<0){ free(tbl); return x; }
+        memset(&xin,0,sizeof(xin)); xin.mode=0100600; xin.links=1;
+        ts_now(&xin.ctime); ts_now(&xin.mtime); ts_now(&xin.atime);
+        din->dx_ino=(uint32_t)x; din->flags|=INODE_FL_INDEX;
     }
-    return FS_OK;
+    int r=FS_OK;
+    dx_hdr_t h={ DX_MAGIC, nblocks, live, 0, slots };
+    if(dx_write_hdr(&xin,&h)!=FS_OK) r=FS_ERR;
+    for(uint32_t k=0;k<nblocks && r==FS_OK;k++){
+        int b=map_bn_for_write(&xin, k+1);
+        if(b<0 || dev_write_meta(&tbl[k*DX_PER_BLK], (uint32_t)b)!=FS_OK) r=FS_ERR;
+    }
+    free(tbl);
+    xin.size=(nblocks+1)*BSIZE;
+    write_inode(din->dx_ino, &xin);
+    if(r!=FS_OK){                            // 建不成就退回线性目录
+        inode_truncate(din->dx_ino); free_inode(din->dx_ino);
+        din->dx_ino=0; din->flags&=~INODE_FL_INDEX;
+    }
+    return write_inode(dir_ino, din)==FS_OK ? r : FS_ERR;
 }
 
-int dir_lookup(uint32_t dir_ino, const char* name, uint32_t* out_ino){
-    inode_t din; if(read_inode(dir_ino,&din)!=FS_OK) return FS_ERR;
-    if((din.mode & 0170000)!=0040000) return FS_ENOTDIR;
-    uint32_t n=din.size/sizeof(dirent_t);
-    uint8_t blk[BLOCK_SIZE]; dirent_t de;
-    for(uint32_t i=0;i<n;i++){
-        uint32_t bn=(i*sizeof(dirent_t))/BLOCK_SIZE, off=(i*sizeof(dirent_t))%BLOCK_SIZE;
-        if(read_dir_block(&din,bn,blk)!=FS_OK) continue;
-        memcpy(&de, blk+off, sizeof(de));
-        if(de.ino!=0 && strncmp(de.name,name,NAME_MAX_LEN)==0){
-            *out_ino=de.ino; return FS_OK;
+// 沿探测序列找 name；*hslot 返回命中的表项位置（供删除使用）
+// 返回 FS_OK / FS_ENOENT；FS_ERR 表示索引不可用，调用方应退回线性扫描并重建
+static int dx_find(inode_t* din, const char* name, uint32_t* slot, uint32_t* hslot){
+    inode_t xin; dx_hdr_t h;
+    if(read_inode(din->dx_ino,&xin)!=FS_OK || dx_read_hdr(&xin,&h)!=FS_OK) return FS_ERR;
+    if(h.dir_slots != din->size/sizeof(dirent_t)) return FS_ERR;
+    uint32_t cap=h.nblocks*DX_PER_BLK, hv=dx_hash(name), g=hv&(cap-1);
+    for(uint32_t probes=0; probes<cap; ){
+        int b=map_bn_for_read(&xin, 1+g/DX_PER_BLK); if(b<0) return FS_ERR;
+        const dx_ent_t* e=(const dx_ent_t*)dev_peek_block((uint32_t)b); if(!e) return FS_ERR;
+        dx_ent_t ents[BLOCK_SIZE_MAX/sizeof(dx_ent_t)]; memcpy(ents, e, BSIZE);   // 下面还要读目录块
+        for(uint32_t k=g%DX_PER_BLK; k<DX_PER_BLK && probes<cap; k++, probes++, g=(g+1)&(cap-1)){
+            if(ents[k].slot==0) return FS_ENOENT;
+            if(ents[k].slot==DX_TOMB || ents[k].hash!=hv) continue;
+            dirent_t de;
+            if(dir_slot(din, ents[k].slot-1, &de)==FS_OK && de.ino && strncmp(de.name,name,NAME_MAX_LEN)==0){
+                *slot=ents[k].slot-1; if(hslot) *hslot=g;
+                return FS_OK;
+            }
         }
     }
     return FS_ENOENT;
 }
+
+// 改写表项 g
+static int dx_put(inode_t* xin, uint32_t g, uint32_t hash, uint32_t slot){
+    int b=map_bn_for_read(xin, 1+g/DX_PER_BLK); if(b<0) return FS_ERR;
+    dx_ent_t ents[BLOCK_SIZE_MAX/sizeof(dx_ent_t)];
+    if(dev_read_block(ents,(uint32_t)b)!=FS_OK) return FS_ERR;
+    ents[g%DX_PER_BLK].hash=hash; ents[g%DX_PER_BLK].slot=slot;
+    return dev_write_meta(ents,(uint32_t)b);
+}
+
+// 新目录项已写在槽位 slot（din->size 已含该项）：插入索引，负载过高则扩表重建
+static int dx_insert(uint32_t dir_ino, inode_t* din, const char* name, uint32_t slot){
+    inode_t xin; dx_hdr_t h;
+    if(read_inode(din->dx_ino,&xin)!=FS_OK || dx_read_hdr(&xin,&h)!=FS_OK ||
+       h.dir_slots!=slot || (h.live+h.tomb+1)*4 > h.nblocks*DX_PER_BLK*3)
+        return dx_build(dir_ino, din);
+    uint32_t cap=h.nblocks*DX_PER_BLK, hv=dx_hash(name), g=hv&(cap-1);
+    for(;;){
+        int b=map_bn_for_read(&xin, 1+g/DX_PER_BLK); if(b<0) return dx_build(dir_ino, din);
+        const dx_ent_t* e=(const dx_ent_t*)dev_peek_block((uint32_t)b); if(!e) return FS_ERR;
+        uint32_t s=e[g%DX_PER_BLK].slot;
+        if(s==0 || s==DX_TOMB){
+            if(s==DX_TOMB) h.tomb--;
+            break;
+        }
+        g=(g+1)&(cap-1);
+    }
+    if(dx_put(&xin, g, hv, slot+1)!=FS_OK) return FS_ERR;
+    h.live++; h.dir_slots=slot+1;
+    return dx_write_hdr(&xin,&h);
+}
+
+// ===== 目录操作 =====
+// 线性查找：每个目录块只借用一次，块内逐项比较；返回槽位号
+static int linear_find(inode_t* din, const char* name, uint32_t* slot){
+    uint32_t n=din->size/sizeof(dirent_t);
+    for(uint32_t bn=0; bn*DE_PER_BLK<n; bn++){
+        int b=map_bn_for_read(din, bn); if(b<0) continue;
+        const dirent_t* de=(const dirent_t*)dev_peek_block((uint32_t)b);
+        if(!de) continue;
+        uint32_t cnt = (n-bn*DE_PER_BLK < DE_PER_BLK) ? n-bn*DE_PER_BLK : DE_PER_BLK;
+        for(uint32_t k=0;k<cnt;k++){
+            if(de[k].ino!=0 && strncmp(de[k].name,name,NAME_MAX_LEN)==0){
+                *slot=bn*DE_PER_BLK+k; return FS_OK;
+            }
+        }
+    }
+    return FS_ENOENT;
+}
+
+// 带索引优先走哈希；索引失效时线性查找并顺手重建
+static int dir_find(uint32_t dir_ino, inode_t* din, const char* name, uint32_t* slot, uint32_t* hslot){
+    if(din->flags & INODE_FL_INDEX){
+        int r=dx_find(din, name, slot, hslot);
+        if(r!=FS_ERR) return r;
+        dx_build(dir_ino, din);
+        if(hslot) *hslot=DX_TOMB;
+    }
+    return linear_find(din, name, slot);
+}
+
+static int lookup(uint32_t dir_ino, const char* name, uint32_t* out_ino){
+    inode_t din; if(read_inode(dir_ino,&din)!=FS_OK) return FS_ERR;
+    if((din.mode & 0170000)!=0040000) return FS_ENOTDIR;
+    uint32_t slot; dirent_t de;
+    int r=dir_find(dir_ino, &din, name, &slot, NULL);
+    if(r==FS_ENOENT) dcache_insert(dir_ino, name, 0);
+    if(r!=FS_OK) return r;
+    if(dir_slot(&din, slot, &de)!=FS_OK) return FS_ERR;
+    dcache_insert(dir_ino, name, de.ino);
+    *out_ino=de.ino;
+    return FS_OK;
+}
+
 int dir_add(uint32_t dir_ino, const char* name, uint8_t ftype, uint32_t child_ino){
     inode_t din; if(read_inode(dir_ino,&din)!=FS_OK) return FS_ERR;
     if((din.mode & 0170000)!=0040000) return FS_ENOTDIR;
     uint32_t idx=din.size/sizeof(dirent_t);
-    uint32_t bn=(idx*sizeof(dirent_t))/BLOCK_SIZE, off=(idx*sizeof(dirent_t))%BLOCK_SIZE;
-    uint8_t blk[BLOCK_SIZE]; if(ensure_dir_block(&din,bn,blk)!=FS_OK) return FS_ENOSPC;
+    uint32_t bn=idx/DE_PER_BLK, off=(idx%DE_PER_BLK)*sizeof(dirent_t);
+    uint8_t blk[BLOCK_SIZE_MAX]; if(ensure_dir_block(&din,bn,blk)!=FS_OK) return FS_ENOSPC;
 
     dirent_t de={0}; de.ino=child_ino; de.reclen=sizeof(dirent_t); de.file_type=ftype;
     strncpy(de.name,name,NAME_MAX_LEN-1);
     memcpy(blk+off, &de, sizeof(de));
-    if(dev_write_block(blk, din.direct[bn])!=FS_OK) return FS_ERR;
+    if(dev_write_meta(blk, (uint32_t)map_bn_for_read(&din,bn))!=FS_OK) return FS_ERR;
     din.size += sizeof(dirent_t); ts_now(&din.mtime);
-    return write_inode(dir_ino,&din);
+    if(write_inode(dir_ino,&din)!=FS_OK) return FS_ERR;
+    dcache_insert(dir_ino, de.name, child_ino);      // 顶替可能存在的负项
+
+    // 超过一个块的目录维护哈希索引（失败不影响目录本身，查找会退回线性扫描）
+    if(din.flags & INODE_FL_INDEX) dx_insert(dir_ino, &din, de.name, idx);
+    else if(idx+1 > DE_PER_BLK)    dx_build(dir_ino, &din);
+    return FS_OK;
 }
+
 int dir_remove(uint32_t dir_ino, const char* name){
     inode_t din; if(read_inode(dir_ino,&din)!=FS_OK) return FS_ERR;
-    uint32_t n=din.size/sizeof(dirent_t); uint8_t blk[BLOCK_SIZE]; dirent_t de;
-    for(uint32_t i=0;i<n;i++){
-        uint32_t bn=(i*sizeof(dirent_t))/BLOCK_SIZE, off=(i*sizeof(dirent_t))%BLOCK_SIZE;
-        if(read_dir_block(&din,bn,blk)!=FS_OK) continue;
-        memcpy(&de, blk+off, sizeof(de));
-        if(de.ino!=0 && strncmp(de.name,name,NAME_MAX_LEN)==0){
-            memset(blk+off,0,sizeof(de));
-            if(dev_write_block(blk, din.direct[bn])!=FS_OK) return FS_ERR;
-            ts_now(&din.mtime); write_inode(dir_ino,&din); return FS_OK;
+    uint32_t slot, hslot=DX_TOMB;
+    int r=dir_find(dir_ino, &din, name, &slot, &hslot);
+    if(r!=FS_OK) return r;
+
+    int b=map_bn_for_read(&din, slot/DE_PER_BLK); if(b<0) return FS_ERR;
+    uint8_t blk[BLOCK_SIZE_MAX];
+    if(dev_read_block(blk,(uint32_t)b)!=FS_OK) return FS_ERR;
+    dirent_t* de=(dirent_t*)(blk+(slot%DE_PER_BLK)*sizeof(dirent_t));
+    if(de->file_type==FT_DIR) dcache_purge_dir(de->ino);
+    memset(de, 0, sizeof(dirent_t));
+    if(dev_write_meta(blk,(uint32_t)b)!=FS_OK) return FS_ERR;
+    dcache_insert(dir_ino, name, 0);
+
+    if((din.flags & INODE_FL_INDEX) && hslot!=DX_TOMB){
+        inode_t xin; dx_hdr_t h;
+        if(read_inode(din.dx_ino,&xin)==FS_OK && dx_read_hdr(&xin,&h)==FS_OK &&
+           dx_put(&xin, hslot, 0, DX_TOMB)==FS_OK){
+            h.live--; h.tomb++; dx_write_hdr(&xin,&h);
         }
     }
-    return FS_ENOENT;
+    ts_now(&din.mtime); write_inode(dir_ino,&din);
+    return FS_OK;
+}
+
+// dcache 命中只有几十纳秒，计时反而比它贵；统计只记未命中时查目录块的慢路径
+int dir_lookup(uint32_t dir_ino, const char* name, uint32_t* out_ino){
+    uint32_t ino;
+    if(dcache_lookup(dir_ino, name, &ino)){
+        if(!ino) return FS_ENOENT;
+        *out_ino=ino; return FS_OK;
+    }
+    uint64_t t0=now_ns(); int r=lookup(dir_ino, name, out_ino);
+    stat_op(MX_OP_DIR_LOOKUP, t0, r);
+    return r;
 }
 
 // 极简路径解析：支持绝对/相对，忽略 . ..
-int namei(const char* path, uint32_t* out_ino){
+static int walk(const char* path, uint32_t* out_ino){
     if(!path||!*path) return FS_ERR;
     uint32_t cur = (path[0]=='/')? g_sb.root_ino : g_cwd;
     const char* p=path; if(*p=='/') p++;
@@ -81,3 +275,9 @@ int namei(const char* path, uint32_t* out_ino){
     }
     *out_ino=cur; return FS_OK;
 }
+int namei(const char* path, uint32_t* out_ino){
+    uint64_t t0=now_ns(); int r=walk(path, out_ino);
+    stat_op(MX_OP_NAMEI, t0, r);
+    TRACE(TR_NAMEI, t0, 0, 0, r==FS_OK ? (int)*out_ino : r, path);
+    return r;
+}
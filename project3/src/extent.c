@@ -0,0 +1,237 @@
+// src/extent.c — 基于 extent 的数据块映射：(逻辑起点, 物理起点, 长度)
+// 不超过 NEXT_INODE 个 extent 时直接存放在 inode 内；更多时移进一棵 B+ 树，inode 只记根块号。
+// 叶块存 extent，索引块存 (子树起始 lblk, 子块号)；节点满了对半分裂（顺序追加时左半留满），
+// 根分裂时树长高一层。各节点内按 lblk 升序。
+#include <string.h>
+#include "fs.h"
+
+// 自根到叶的路径：经过的节点及在各索引节点中所走的槽
+typedef struct {
+    uint32_t blk[EXT_MAX_DEPTH], slot[EXT_MAX_DEPTH];
+    int depth;                  // 节点数，0 表示 extent 在 inode 内
+    int full;                   // 自叶向上连续已满的层数
+} ext_path_t;
+
+// 借用一个树节点并校验头部（下一次 dev_* 调用前有效）
+static const ext_leaf_hdr_t* node_peek(uint32_t blk){
+    const ext_leaf_hdr_t* h = (const ext_leaf_hdr_t*)dev_peek_block(blk);
+    if(!h) return NULL;
+    if(h->magic==EXT_LEAF_MAGIC) return h->count<=EXT_LEAF_MAX ? h : NULL;
+    return h->magic==EXT_IDX_MAGIC && h->count>0 && h->count<=EXT_IDX_MAX ? h : NULL;
+}
+
+static int node_write(uint32_t blk, uint32_t magic, const void* ent, uint32_t n, size_t sz){
+    uint8_t buf[BLOCK_SIZE_MAX] = {0};
+    ext_leaf_hdr_t h = { magic, n };
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), ent, n*sz);
+    return dev_write_meta(buf, blk);
+}
+
+// 二分：lblk 所在或其前驱 extent 的下标；-1 表示 lblk 在所有 extent 之前
+static int ext_find(const extent_t* e, uint32_t n, uint32_t lblk){
+    int lo=0, hi=(int)n-1, ans=-1;
+    while(lo<=hi){
+        int mid=(lo+hi)/2;
+        if(e[mid].lblk<=lblk){ ans=mid; lo=mid+1; } else hi=mid-1;
+    }
+    return ans;
+}
+// 索引节点中负责 lblk 的子树；比首键还小的也归第一个子树
+static int idx_find(const ext_idx_t* x, uint32_t n, uint32_t lblk){
+    int lo=1, hi=(int)n-1, ans=0;
+    while(lo<=hi){
+        int mid=(lo+hi)/2;
+        if(x[mid].lblk<=lblk){ ans=mid; lo=mid+1; } else hi=mid-1;
+    }
+    return ans;
+}
+
+// 下降到 lblk 所在的叶，返回其 extent 数组（借用，同 node_peek）
+static const extent_t* ext_descend(const inode_t* in, uint32_t lblk, ext_path_t* p, uint32_t* n){
+    p->depth=0;
+    if(!in->ext_root){ *n=in->ext_count; p->full = in->ext_count>=NEXT_INODE; return in->ext; }
+    p->full=0;
+    uint32_t blk=in->ext_root;
+    while(p->depth < EXT_MAX_DEPTH){
+        const ext_leaf_hdr_t* h = node_peek(blk);
+        if(!h) return NULL;
+        int leaf = h->magic==EXT_LEAF_MAGIC;
+        p->full = h->count >= (leaf ? EXT_LEAF_MAX : EXT_IDX_MAX) ? p->full+1 : 0;
+        p->blk[p->depth++] = blk;
+        if(leaf){ *n=h->count; return (const extent_t*)(h+1); }
+        const ext_idx_t* x = (const ext_idx_t*)(h+1);
+        int k = idx_find(x, h->count, lblk);
+        p->slot[p->depth-1] = (uint32_t)k;
+        blk = x[k].child;
+    }
+    return NULL;
+}
+
+int ext_lookup(const inode_t* in, uint32_t lblk, uint32_t* run){
+    ext_path_t p;
+    uint32_t n; const extent_t* e = ext_descend(in, lblk, &p, &n);
+    if(!e) return FS_ERR;
+    int k = ext_find(e, n, lblk);
+    if(k<0 || lblk >= e[k].lblk + e[k].len) return FS_ERR;   // 空洞
+    uint32_t d = lblk - e[k].lblk;
+    if(run) *run = e[k].len - d;
+    return (int)(e[k].pblk + d);
+}
+
+// 把 lblk→b 并入有序数组 e（容量至少 n+1）：能与前驱/后继首尾相接就延长，否则插入新项。
+// 返回 lblk 所在项的下标
+static int ext_add(extent_t* e, uint32_t* pn, uint32_t lblk, uint32_t b){
+    uint32_t n=*pn;
+    int k = ext_find(e, n, lblk);
+    if(k>=0 && e[k].lblk+e[k].len==lblk && e[k].pblk+e[k].len==b){
+        e[k].len++;
+        // 填补空洞后可能与后继首尾相接
+        if(k+1<(int)n && e[k].lblk+e[k].len==e[k+1].lblk && e[k].pblk+e[k].len==e[k+1].pblk){
+            e[k].len += e[k+1].len;
+            memmove(&e[k+1], &e[k+2], (n-(uint32_t)k-2)*sizeof(extent_t));
+            *pn=n-1;
+        }
+        return k;
+    }
+    if(k+1<(int)n && lblk+1==e[k+1].lblk && b+1==e[k+1].pblk){
+        e[k+1].lblk--; e[k+1].pblk--; e[k+1].len++;
+        return k+1;
+    }
+    memmove(&e[k+2], &e[k+1], (n-(uint32_t)(k+1))*sizeof(extent_t));
+    e[k+1] = (extent_t){ lblk, b, 1 };
+    *pn=n+1;
+    return k+1;
+}
+
+// 写回一个节点；超过 max 项时分成两块，右半写进 right，*key 返回右半的起始 lblk。
+// 新项在末尾（顺序追加）时左半留满、右半只放新项。返回 1 表示分裂了
+static int node_put(uint32_t blk, uint32_t magic, const void* ent, uint32_t n, size_t sz, uint32_t max,
+                    int append, uint32_t right, uint32_t* key){
+    if(n<=max) return node_write(blk, magic, ent, n, sz);
+    uint32_t m = append ? n-1 : n/2;
+    const uint8_t* c = (const uint8_t*)ent;
+    memcpy(key, c + m*sz, sizeof(uint32_t));         // 两种项都以 lblk 开头
+    if(node_write(right, magic, c + m*sz, n-m, sz)!=FS_OK || node_write(blk, magic, ent, m, sz)!=FS_OK) return FS_ERR;
+    return 1;
+}
+
+// 把已并入新 extent 的叶（e[0..n)，新项下标 k）写回，溢出时沿路径向上分裂；
+// 所需的节点块由调用方备在 spare 里，按用到的顺序取
+static int ext_insert(inode_t* in, const ext_path_t* p, const extent_t* e, uint32_t n, int k, const uint32_t* spare){
+    if(!p->depth){
+        if(n<=NEXT_INODE){
+            memset(in->ext, 0, sizeof(in->ext));
+            memcpy(in->ext, e, n*sizeof(extent_t));
+            in->ext_count = (uint16_t)n;
+            return FS_OK;
+        }
+        if(node_write(spare[0], EXT_LEAF_MAGIC, e, n, sizeof(extent_t))!=FS_OK) return FS_ERR;
+        in->ext_root = spare[0]; in->ext_count = 0;
+        memset(in->ext, 0, sizeof(in->ext));
+        return FS_OK;
+    }
+    int d = p->depth-1, ns = 0;
+    uint32_t key;
+    int r = node_put(p->blk[d], EXT_LEAF_MAGIC, e, n, sizeof(extent_t), EXT_LEAF_MAX, k==(int)n-1, spare[ns], &key);
+    while(r==1){
+        uint32_t right = spare[ns++];
+        if(d==0){                       // 根分裂：新根指向左右两半
+            ext_idx_t x[2] = { { 0, p->blk[0] }, { key, right } };
+            if(node_write(spare[ns], EXT_IDX_MAGIC, x, 2, sizeof(ext_idx_t))!=FS_OK) return FS_ERR;
+            in->ext_root = spare[ns];
+            return FS_OK;
+        }
+        d--;
+        const ext_leaf_hdr_t* h = node_peek(p->blk[d]);
+        if(!h) return FS_ERR;
+        ext_idx_t x[EXT_IDX_CAP+1];
+        uint32_t m = h->count, s = p->slot[d];
+        memcpy(x, h+1, m*sizeof(ext_idx_t));
+        memmove(&x[s+2], &x[s+1], (m-s-1)*sizeof(ext_idx_t));
+        x[s+1] = (ext_idx_t){ key, right };
+        m++;
+        r = node_put(p->blk[d], EXT_IDX_MAGIC, x, m, sizeof(ext_idx_t), EXT_IDX_MAX, s+2==m, spare[ns], &key);
+    }
+    return r;
+}
+
+// 把 lblk 映射到物理块：given 非 0 时用调用方已分配的块（失败时由调用方释放），否则就近分配
+static int ext_map_at(inode_t* in, uint32_t lblk, int zero, uint32_t given){
+    int p = ext_lookup(in, lblk, NULL);
+    if(p >= 0) return p;
+
+    ext_path_t path;
+    extent_t e[EXT_LEAF_CAP+1];
+    uint32_t n; const extent_t* v = ext_descend(in, lblk, &path, &n);
+    if(!v) return FS_ERR;
+    memcpy(e, v, n*sizeof(extent_t));
+
+    // 目标物理块：与前驱 extent 保持相同的逻辑→物理偏移，顺序追加时正好是其尾后一块
+    int k = ext_find(e, n, lblk);
+    uint32_t goal = 0;
+    if(k >= 0) goal = e[k].pblk + (lblk - e[k].lblk);
+    else if(n > 0 && e[0].pblk > e[0].lblk - lblk) goal = e[0].pblk - (e[0].lblk - lblk);
+
+    int b = given ? (int)given : alloc_block_goal(goal); if(b < 0) return b;
+    if(zero) dev_write_block(g_zero_block, (uint32_t)b);
+
+    k = ext_add(e, &n, lblk, (uint32_t)b);
+
+    // 要分裂时先备齐节点块，中途不会因空间不足留下半棵树
+    uint32_t spare[EXT_MAX_DEPTH+1] = {0};
+    int ns = 0;
+    if(n > (path.depth ? EXT_LEAF_MAX : NEXT_INODE)){
+        int grow = !path.depth || path.full==path.depth;    // 树长高一层
+        int need = path.full + (path.depth && grow);
+        int r = path.depth + grow > EXT_MAX_DEPTH ? FS_ENOSPC : FS_OK;
+        for(; r==FS_OK && ns<need; ns++){
+            int s = alloc_block(); if(s < 0){ r=s; break; }
+            spare[ns] = (uint32_t)s;
+        }
+        if(r != FS_OK){
+            while(ns>0) free_block(spare[--ns]);
+            if(!given) free_block((uint32_t)b);
+            return r;
+        }
+    }
+
+    int r = ext_insert(in, &path, e, n, k, spare);
+    if(r != FS_OK){ if(!given) free_block((uint32_t)b); return r; }   // I/O 错误：节点块可能已挂进树，不回收
+    in->blocks += 1 + (uint32_t)ns;
+    ts_now(&in->ctime);
+    return b;
+}
+int ext_map_write(inode_t* in, uint32_t lblk, int zero){ return ext_map_at(in, lblk, zero, 0); }
+int ext_map_assign(inode_t* in, uint32_t lblk, uint32_t pblk){ return ext_map_at(in, lblk, 0, pblk); }
+
+static void free_extents(const extent_t* e, uint32_t n){
+    for(uint32_t i=0;i<n;i++)
+        for(uint32_t j=0;j<e[i].len;j++) free_block(e[i].pblk + j);
+}
+// 释放子树的全部数据块与节点块
+static int node_free(uint32_t blk, int depth){
+    int r = FS_OK;
+    const ext_leaf_hdr_t* h = depth<EXT_MAX_DEPTH ? node_peek(blk) : NULL;
+    if(!h) r = FS_ERR;
+    else if(h->magic==EXT_LEAF_MAGIC){
+        extent_t e[EXT_LEAF_CAP]; uint32_t n=h->count;
+        memcpy(e, h+1, n*sizeof(extent_t));
+        free_extents(e, n);
+    }else{
+        ext_idx_t x[EXT_IDX_CAP]; uint32_t n=h->count;
+        memcpy(x, h+1, n*sizeof(ext_idx_t));
+        for(uint32_t i=0;i<n;i++) if(node_free(x[i].child, depth+1)!=FS_OK) r = FS_ERR;
+    }
+    free_block(blk);
+    return r;
+}
+
+int ext_truncate(inode_t* in){
+    int r = FS_OK;
+    if(in->ext_root) r = node_free(in->ext_root, 0);
+    else free_extents(in->ext, in->ext_count);
+    in->ext_root = 0; in->ext_count = 0;
+    memset(in->ext, 0, sizeof(in->ext));
+    return r;
+}
@@ -1,12 +1,8 @@
-// src/file.c — 带权限校验与单级间接的数据块映射
+// src/file.c — 带权限校验与一/二/三级间接的数据块映射
 #include <string.h>
 #include <stdlib.h>
 #include "fs.h"
 
-// ===== 引用全局状态 =====
-extern int g_uid;       // 当前登录用户（root=0）
-extern uint32_t g_cwd;  // 当前目录（用于相对路径解析）
-
 // ======= 权限检查（简化版） =======
 // 约定：root(uid=0) 拥有一切权限；owner 看 0400/0200；others 看 0004/0002
 static int perm_can_read(const inode_t* in, int uid){
@@ -21,14 +17,85 @@ static int perm_can_write(const inode_t* in, int uid){
 }
 
 // ======= 物理块映射 =======
-// 将逻辑块号 bn 映射到物理块号（写路径：必要时分配）
-static int map_bn_for_write(inode_t* in, uint32_t bn){
+// 直接块 NDIRECT 个，之后依次是一级、二级、三级间接（每张表 BSIZE/4 个指针）。
+// 打开文件描述（ofile_t）里为每一级保留最近用过的一张表的副本；任何间接表被改写或释放时
+// g_bmap_gen 加一，所有副本随之作废，所以顺序读只在跨表时才访问表块。
+// 代数可能被写不同文件的线程同时加，用原子操作。
+#define PTRS  (BSIZE/4u)
+
+#define g_bmap_gen     __atomic_load_n(&g_vol->bmap_gen, __ATOMIC_RELAXED)
+#define BMAP_GEN_BUMP() __atomic_add_fetch(&g_vol->bmap_gen, 1, __ATOMIC_RELAXED)
+
+// 逻辑块 bn → 各级表内下标；返回间接级数（0=直接块），超出三级间接范围返回 -1
+static int bmap_path(uint32_t bn, uint32_t idx[3]){
+    uint64_t p=PTRS, b=bn;
+    if(b < NDIRECT){ idx[0]=(uint32_t)b; return 0; }
+    b -= NDIRECT;
+    if(b < p){ idx[0]=(uint32_t)b; return 1; }
+    b -= p;
+    if(b < p*p){ idx[0]=(uint32_t)(b/p); idx[1]=(uint32_t)(b%p); return 2; }
+    b -= p*p;
+    if(b < p*p*p){ idx[0]=(uint32_t)(b/(p*p)); idx[1]=(uint32_t)(b/p%p); idx[2]=(uint32_t)(b%p); return 3; }
+    return -1;
+}
+static uint32_t* bmap_root(inode_t* in, int lv){
+    return lv==1 ? &in->indirect1 : lv==2 ? &in->indirect2 : &in->indirect3;
+}
+
+// 取第 d 层、位于物理块 blk 的表：有缓存用副本，否则借用块缓存（下次 dev_* 调用前有效）
+static const uint32_t* bmap_table(bmap_cache_t* mc, int d, uint32_t blk){
+    if(!mc) return (const uint32_t*)dev_peek_block(blk);
+    uint32_t gen=g_bmap_gen;
+    if(mc->gen != gen){ memset(mc->blk, 0, sizeof(mc->blk)); mc->gen=gen; }
+    if(mc->blk[d]==blk) return mc->tbl[d];
+    if(!mc->tbl[d] && !(mc->tbl[d]=(uint32_t*)malloc(BLOCK_SIZE_MAX))) return (const uint32_t*)dev_peek_block(blk);
+    if(dev_read_block(mc->tbl[d], blk)!=FS_OK) return NULL;
+    mc->blk[d]=blk;
+    return mc->tbl[d];
+}
+// 改写表项：其他打开文件的副本作废，自己的副本同步更新
+static int bmap_store(bmap_cache_t* mc, int d, uint32_t blk, uint32_t i, uint32_t val){
+    uint32_t tbl[BLOCK_SIZE_MAX/4];
+    if(dev_read_block(tbl, blk)!=FS_OK) return FS_ERR;
+    tbl[i]=val;
+    if(dev_write_meta(tbl, blk)!=FS_OK) return FS_ERR;
+    uint32_t gen=BMAP_GEN_BUMP();
+    if(mc){
+        if(mc->blk[d]==blk) mc->tbl[d][i]=val;
+        mc->gen=gen;
+    }
+    return FS_OK;
+}
+
+// 新分配的块（数据块或间接表）清零
+static int alloc_zeroed(){
+    int b = alloc_block(); if(b < 0) return b;
+    dev_write_block(g_zero_block,(uint32_t)b);
+    return b;
+}
+
+// 缺的数据块：given 为调用方已分配的块（延迟分配刷盘），否则现分配（MAP_OVERWRITE 不清零）
+static int data_block(int alloc, uint32_t given){
+    if(given) return (int)given;
+    return alloc==MAP_OVERWRITE ? alloc_block() : alloc_zeroed();
+}
+
+// 逻辑块 bn → 物理块；alloc 非 0 时沿途缺的表和数据块都分配
+static int map_bn_at(inode_t* in, uint32_t bn, int alloc, uint32_t given, bmap_cache_t* mc){
+    if(in->flags & INODE_FL_EXTENTS){
+        if(given) return ext_map_assign(in, bn, given);
+        return alloc ? ext_map_write(in, bn, alloc!=MAP_OVERWRITE) : ext_lookup(in, bn, NULL);
+    }
+
+    uint32_t idx[3];
+    int lv = bmap_path(bn, idx);
+    if(lv < 0) return alloc ? FS_ENOSPC : FS_ERR;
+
     // 直指针
-    if(bn < NDIRECT){
+    if(lv == 0){
         if(in->direct[bn]==0){
-            int b = alloc_block(); if(b < 0) return b;
-            // 新分配的数据块清零
-            uint8_t zero[BLOCK_SIZE]={0}; dev_write_block(zero,(uint32_t)b);
+            if(!alloc) return FS_ERR;
+            int b = data_block(alloc, given); if(b < 0) return b;
             in->direct[bn] = (uint32_t)b;
             in->blocks++;
             ts_now(&in->ctime);
@@ -36,52 +103,98 @@ static int map_bn_for_write(inode_t* in, uint32_t bn){
         return (int)in->direct[bn];
     }
 
-    // 单级间接
-    uint32_t idx = bn - NDIRECT;
-    if(idx >= BLOCK_SIZE/4) return FS_ENOSPC; // 超出单级间接范围
-
-    if(in->indirect1 == 0){
-        // 分配间接表块
-        int b = alloc_block(); if(b < 0) return b;
-        uint8_t zero[BLOCK_SIZE]={0};
-        dev_write_block(zero,(uint32_t)b);
-        in->indirect1 = (uint32_t)b;
+    // 间接：根指针在 inode 里，逐层向下
+    uint32_t* root = bmap_root(in, lv);
+    if(*root == 0){
+        if(!alloc) return FS_ERR;
+        int b = alloc_zeroed(); if(b < 0) return b;
+        *root = (uint32_t)b;
         ts_now(&in->ctime);
     }
-
-    uint32_t tbl[BLOCK_SIZE/4];
-    if(dev_read_block(tbl, in->indirect1) != FS_OK) return FS_ERR;
-
-    if(tbl[idx] == 0){
-        int b = alloc_block(); if(b < 0) return b;
-        // 清零新数据块
-        uint8_t zero[BLOCK_SIZE]={0}; dev_write_block(zero,(uint32_t)b);
-        tbl[idx] = (uint32_t)b;
-        if(dev_write_block(tbl, in->indirect1) != FS_OK) return FS_ERR;
-        in->blocks++;
-        ts_now(&in->ctime);
+    uint32_t cur = *root;
+    for(int d=0; d<lv; d++){
+        const uint32_t* t = bmap_table(mc, d, cur);
+        if(!t) return FS_ERR;
+        uint32_t next = t[idx[d]];
+        if(next == 0){
+            if(!alloc) return FS_ERR;
+            int b = d == lv-1 ? data_block(alloc, given) : alloc_zeroed();
+            if(b < 0) return b;
+            if(bmap_store(mc, d, cur, idx[d], (uint32_t)b) != FS_OK) return FS_ERR;
+            if(d == lv-1){ in->blocks++; ts_now(&in->ctime); }
+            next = (uint32_t)b;
+        }
+        cur = next;
     }
-    return (int)tbl[idx];
+    return (int)cur;
 }
 
-// 将逻辑块号 bn 映射到物理块号（读路径：不分配）
-static int map_bn_for_read(inode_t* in, uint32_t bn){
-    if(bn < NDIRECT){
-        return in->direct[bn] ? (int)in->direct[bn] : FS_ERR;
+int map_bn(inode_t* in, uint32_t bn, int alloc, bmap_cache_t* mc){ return map_bn_at(in, bn, alloc, 0, mc); }
+int map_bn_assign(inode_t* in, uint32_t bn, uint32_t phys, bmap_cache_t* mc){ return map_bn_at(in, bn, MAP_OVERWRITE, phys, mc); }
+int map_bn_for_write(inode_t* in, uint32_t bn){ return map_bn(in, bn, MAP_ALLOC, NULL); }
+int map_bn_for_read(inode_t* in, uint32_t bn){ return map_bn(in, bn, 0, NULL); }
+
+// 递归释放 d 级表 blk 下的全部块（d=0 即数据块本身）
+static void bmap_free_tree(uint32_t blk, int d){
+    if(d > 0){
+        uint32_t tbl[BLOCK_SIZE_MAX/4];
+        if(dev_read_block(tbl, blk)==FS_OK)
+            for(uint32_t i=0;i<PTRS;i++) if(tbl[i]) bmap_free_tree(tbl[i], d-1);
+    }
+    free_block(blk);
+}
+int bmap_truncate(inode_t* in){
+    for(int i=0;i<NDIRECT;i++) if(in->direct[i]){ free_block(in->direct[i]); in->direct[i]=0; }
+    for(int lv=1; lv<=3; lv++){
+        uint32_t* root = bmap_root(in, lv);
+        if(*root){ bmap_free_tree(*root, lv); *root=0; }
     }
-    if(in->indirect1 == 0) return FS_ERR;
+    BMAP_GEN_BUMP();
+    return FS_OK;
+}
+
+void bmap_cache_release(bmap_cache_t* mc){
+    for(int d=0; d<3; d++){ free(mc->tbl[d]); mc->tbl[d]=NULL; mc->blk[d]=0; }
+}
 
-    uint32_t idx = bn - NDIRECT;
-    if(idx >= BLOCK_SIZE/4) return FS_ERR;
+// ======= 描述符表 =======
+// 表只在独占卷时增长或改动（open/dup/close），共享模式下的 fs_read/fs_write 只查表
+ofile_t* fs_file(int fd){
+    if(fd < 0 || (uint32_t)fd >= g_vol->nfd) return NULL;
+    return g_vol->fdt[fd].of;
+}
 
-    uint32_t tbl[BLOCK_SIZE/4];
-    if(dev_read_block(tbl, in->indirect1) != FS_OK) return FS_ERR;
-    return tbl[idx] ? (int)tbl[idx] : FS_ERR;
+// 容量翻倍；新槽按升序压栈，空表上先分到小号 fd
+static int fd_grow(){
+    uint32_t n = g_vol->nfd ? g_vol->nfd*2 : FD_TABLE_MIN;
+    if(n > FD_TABLE_MAX) return FS_ERR;
+    fdent_t* t = (fdent_t*)realloc(g_vol->fdt, n*sizeof(fdent_t));
+    if(!t) return FS_ERR;
+    for(uint32_t i=n; i-- > g_vol->nfd; ){
+        t[i].of = NULL; t[i].flags = 0;
+        t[i].next = g_vol->fd_free; g_vol->fd_free = (int)i;
+    }
+    g_vol->fdt = t; g_vol->nfd = n;
+    return FS_OK;
+}
+static int fd_alloc(ofile_t* of, int flags){
+    if(g_vol->fd_free < 0 && fd_grow() != FS_OK) return FS_ERR;
+    int fd = g_vol->fd_free;
+    fdent_t* e = &g_vol->fdt[fd];
+    g_vol->fd_free = e->next;
+    e->of = of; e->flags = flags; e->next = -1;
+    of->ref++;
+    return fd;
+}
+static void fd_release(int fd){
+    fdent_t* e = &g_vol->fdt[fd];
+    e->of = NULL; e->flags = 0;
+    e->next = g_vol->fd_free; g_vol->fd_free = fd;
 }
 
 // ======= 打开文件 =======
 // 支持 "r"（只读）与 "w"（可写；如不存在则创建，不自动截断）
-int fs_open(const char* path, const char* mode){
+static int open_file(const char* path, const char* mode){
     uint32_t ino;
     int writable = (mode && strchr(mode,'w') != NULL);
     int r = namei(path, &ino);
@@ -118,6 +231,7 @@ int fs_open(const char* path, const char* mode){
         in.mode  = MODE_FILE;        // 默认 0644
         in.links = 1;
         in.uid   = (uint16_t)g_uid;  // 记录所有者
+        if(g_mopt.extents) in.flags |= INODE_FL_EXTENTS;
         ts_now(&in.ctime); ts_now(&in.mtime); ts_now(&in.atime);
 
         if(write_inode((uint32_t)nino, &in) != FS_OK) return FS_ERR;
@@ -135,59 +249,180 @@ int fs_open(const char* path, const char* mode){
         }
     }
 
-    // 分配进程内 fd 槽
-    for(int fd=0; fd<MAX_OPEN; ++fd){
-        if(!g_ofile[fd].used){
-            g_ofile[fd].used     = 1;
-            g_ofile[fd].ino      = ino;
-            g_ofile[fd].offset   = 0;
-            g_ofile[fd].writable = writable;
-            return fd;
-        }
-    }
-    return FS_ERR;
+    // 建立打开文件描述（打开期间钉住 inode 缓存项），挂到 inode 的描述链上
+    ofile_t* of = (ofile_t*)calloc(1, sizeof(ofile_t));
+    if(!of) return FS_ERR;
+    if(iget(ino) != FS_OK){ free(of); return FS_ERR; }
+    of->ino = ino;
+    of->writable = writable;
+    pthread_mutex_init(&of->lock, NULL);
+    int fd = fd_alloc(of, 0);
+    if(fd < 0){ pthread_mutex_destroy(&of->lock); free(of); iput(ino); return fd; }
+    inode_open_add(ino, of);
+    return fd;
 }
 
+int fs_open(const char* path, const char* mode){
+    uint64_t t0=TRACE_T0(); int r=open_file(path, mode);
+    TRACE(TR_OPEN, t0, mode && strchr(mode,'w'), 0, r, path);
+    return r;
+}
+
+// 关掉 fd；描述没有别的 fd 引用时才真正关闭。已删除（孤儿）文件的最后一次关闭释放 inode
+static int close_fd(int fd){
+    ofile_t* of = fs_file(fd);
+    if(!of) return FS_EBADF;
+    fd_release(fd);
+    if(--of->ref > 0) return FS_OK;
+    uint32_t ino = of->ino;
+    int r = FS_OK;
+    if(inode_open_del(ino, of)){
+        r = inode_truncate(ino);
+        free_inode(ino);
+    }else r = da_flush(ino);             // 延迟分配的数据此时分配物理块
+    bmap_cache_release(&of->bmc);
+    pthread_mutex_destroy(&of->lock);
+    free(of);
+    iput(ino);
+    fs_maybe_sync();
+    return r;
+}
 int fs_close(int fd){
-    if(fd<0 || fd>=MAX_OPEN || !g_ofile[fd].used) return FS_EBADF;
-    g_ofile[fd].used = 0;
-    return FS_OK;
+    uint64_t t0=TRACE_T0(); int r=close_fd(fd);
+    TRACE(TR_CLOSE, t0, fd, 0, r, NULL);
+    return r;
+}
+
+int fs_close_all(){
+    int r = FS_OK;
+    for(uint32_t fd=0; fd<g_vol->nfd; fd++)
+        if(g_vol->fdt[fd].of && fs_close((int)fd) != FS_OK) r = FS_ERR;
+    return r;
+}
+
+int fs_dup(int fd, int flags){
+    ofile_t* of = fs_file(fd);
+    if(!of) return FS_EBADF;
+    uint64_t t0 = TRACE_T0();
+    int r = fd_alloc(of, flags & FD_RDONLY);
+    TRACE(TR_DUP, t0, fd, flags, r, NULL);
+    return r;
+}
+
+int fs_fdflags(int fd, int flags){
+    if(!fs_file(fd)) return FS_EBADF;
+    int old = g_vol->fdt[fd].flags;
+    if(flags >= 0) g_vol->fdt[fd].flags = flags & FD_RDONLY;
+    return old;
 }
 
 int fs_seek(int fd, int32_t off){
-    if(fd<0 || fd>=MAX_OPEN || !g_ofile[fd].used) return FS_EBADF;
-    g_ofile[fd].offset = (off < 0) ? 0u : (uint32_t)off;
+    ofile_t* of = fs_file(fd);
+    if(!of) return FS_EBADF;
+    TRACE(TR_SEEK, now_ns(), fd, off, FS_OK, NULL);
+    pthread_mutex_lock(&of->lock);
+    of->offset = (off < 0) ? 0u : (uint32_t)off;
+    of->ra_pos = UINT32_MAX; of->ra_win = 0; of->ra_end = 0;   // 预读重新开始
+    pthread_mutex_unlock(&of->lock);
     return FS_OK;
 }
 
-// ======= 读 =======
-int fs_read(int fd, void* buf, uint32_t len){
-    if(fd<0 || fd>=MAX_OPEN || !g_ofile[fd].used) return FS_EBADF;
+// ======= 顺序预读 =======
+// 本次读从上次读结束处开始即为顺序：窗口从 RA_MIN 块起，每次顺序读翻倍，上限 ra_kb；
+// 非顺序读或 seek 后窗口归零。已预读的部分用掉一半后，才把 [ra_end, 本次末块+窗口)
+// 按物理连续段合并成大读请求装入块缓存，之后的 fs_read 直接命中缓存。
+// 本次请求中的整块走对齐直读，不必预读，所以起点不早于请求末尾所在块。
+#define RA_MIN  4u
+
+static void readahead(ofile_t* of, inode_t* in, uint32_t pos, uint32_t len){
+    uint32_t last = (pos + len - 1) / BSIZE, tail = (pos + len) / BSIZE;
+    uint32_t max = g_mopt.ra_kb * 1024u / BSIZE;
+    if(pos == of->ra_pos && max)
+        of->ra_win = !of->ra_win ? RA_MIN : (of->ra_win*2 < max ? of->ra_win*2 : max);
+    else{ of->ra_win = 0; of->ra_end = 0; }
+    of->ra_pos = pos + len;
+    if(!of->ra_win) return;
+
+    if(of->ra_end > last+1 && of->ra_end-(last+1) > of->ra_win/2) return;   // 剩余预读量还够
+    uint32_t eof = (in->size + BSIZE - 1) / BSIZE;
+    uint32_t from = of->ra_end > tail ? of->ra_end : tail;
+    uint32_t to = last + 1 + of->ra_win; if(to > eof) to = eof;
+    uint32_t run_p = 0, run_n = 0;
+    for(uint32_t b=from; b<to; b++){
+        int p = map_bn(in, b, 0, &of->bmc);
+        if(p >= 0 && run_n && (uint32_t)p == run_p+run_n){ run_n++; continue; }
+        if(run_n) dev_readahead(run_p, run_n);
+        run_n = 0;
+        if(p >= 0){ run_p = (uint32_t)p; run_n = 1; }
+    }
+    if(run_n) dev_readahead(run_p, run_n);
+    if(to > of->ra_end) of->ra_end = to;
+}
 
+// 按 atime 策略决定是否更新（更新时顺带改 in->atime）；noatime 下只读负载完全不写盘
+#define RELATIME_SECS  86400u
+static int atime_due(inode_t* in){
+    int mode = fs_atime_mode();
+    if(mode == ATIME_NOATIME) return 0;
+    uint32_t now; ts_now(&now);
+    if(mode == ATIME_RELATIME && in->atime >= in->mtime && in->atime >= in->ctime &&
+       now - in->atime < RELATIME_SECS) return 0;
+    in->atime = now;
+    return 1;
+}
+
+// ======= 读 =======
+// 调用方已持描述锁与 inode 锁（见 fs_read/fs_write）
+static int file_read(ofile_t* of, void* buf, uint32_t len){
     inode_t in;
-    if(read_inode(g_ofile[fd].ino, &in) != FS_OK) return FS_ERR;
+    if(read_inode(of->ino, &in) != FS_OK) return FS_ERR;
 
     // 权限校验
     if(!perm_can_read(&in, g_uid)) return FS_EPERM;
 
     uint8_t* out = (uint8_t*)buf;
-    uint32_t pos = g_ofile[fd].offset;
+    uint32_t pos = of->offset;
 
     if(pos >= in.size) return 0;                // EOF
     uint32_t remain = in.size - pos;
     if(len > remain) len = remain;
+    if(len == 0) return 0;
+    readahead(of, &in, pos, len);
 
     uint32_t done = 0;
     while(done < len){
-        uint32_t bn = pos / BLOCK_SIZE;
-        uint32_t boff = pos % BLOCK_SIZE;
-        int phys = map_bn_for_read(&in, bn);
+        uint32_t bn = pos / BSIZE;
+        uint32_t boff = pos % BSIZE;
+
+        // 延迟分配缓冲中的块（尚未映射）优先
+        const uint8_t* dab = g_mopt.delalloc ? (const uint8_t*)da_peek(of->ino, bn) : NULL;
+        if(dab){
+            uint32_t can = BSIZE - boff;
+            if(can > len - done) can = len - done;
+            memcpy(out + done, dab + boff, can);
+            done += can;
+            pos  += can;
+            continue;
+        }
+
+        int phys = map_bn(&in, bn, 0, &of->bmc);
         if(phys < 0) break;
 
-        uint8_t blk[BLOCK_SIZE];
+        // 对齐的整块区间：物理连续的一段一次读进调用方缓冲
+        if(boff == 0 && len - done >= BSIZE){
+            uint32_t nb = (len - done) / BSIZE, run = 1;
+            while(run < nb && map_bn(&in, bn+run, 0, &of->bmc) == phys + (int)run) run++;
+            if(dev_read_blocks(out + done, (uint32_t)phys, run) != FS_OK) return FS_ERR;
+            done += run * BSIZE;
+            pos  += run * BSIZE;
+            continue;
+        }
+
+        // 首尾不满一块：经块缓存
+        uint8_t blk[BLOCK_SIZE_MAX];
         if(dev_read_block(blk, (uint32_t)phys) != FS_OK) return FS_ERR;
 
-        uint32_t can = BLOCK_SIZE - boff;
+        uint32_t can = BSIZE - boff;
         if(can > len - done) can = len - done;
 
         memcpy(out + done, blk + boff, can);
@@ -195,51 +430,126 @@ int fs_read(int fd, void* buf, uint32_t len){
         pos  += can;
     }
 
-    g_ofile[fd].offset = pos;
-    ts_now(&in.atime);
-    write_inode(g_ofile[fd].ino, &in);
+    of->offset = pos;
+    if(atime_due(&in)) write_inode(of->ino, &in);
     return (int)done;
 }
 
 // ======= 写 =======
-int fs_write(int fd, const void* buf, uint32_t len){
-    if(fd<0 || fd>=MAX_OPEN || !g_ofile[fd].used) return FS_EBADF;
-    if(!g_ofile[fd].writable) return FS_EPERM;
+static int file_write(ofile_t* of, const void* buf, uint32_t len){
 
     inode_t in;
-    if(read_inode(g_ofile[fd].ino, &in) != FS_OK) return FS_ERR;
+    if(read_inode(of->ino, &in) != FS_OK) return FS_ERR;
 
     // 权限校验
     if(!perm_can_write(&in, g_uid)) return FS_EPERM;
 
     const uint8_t* inbuf = (const uint8_t*)buf;
-    uint32_t pos = g_ofile[fd].offset;
+    uint32_t pos = of->offset;
     uint32_t done = 0;
+    int err = FS_OK, retried = 0;
+    int amode = g_mopt.delalloc ? 0 : MAP_OVERWRITE;   // 延迟分配时整块路径只覆盖已映射的块
 
     while(done < len){
-        uint32_t bn   = pos / BLOCK_SIZE;
-        uint32_t boff = pos % BLOCK_SIZE;
+        uint32_t bn   = pos / BSIZE;
+        uint32_t boff = pos % BSIZE;
+
+        // 延迟分配：尚未映射的块只进内存缓冲并预留空间，不碰位图。
+        // 预留不够时先把已写部分记入 inode、fs_sync（刷掉全部延迟分配、提交日志释放的块）再试一次；
+        // fs_sync 要独占卷，共享模式下就此停下交给 api.c
+        if(g_mopt.delalloc && map_bn(&in, bn, 0, &of->bmc) < 0){
+            uint32_t can = BSIZE - boff;
+            if(can > len - done) can = len - done;
+            int r = da_write(of->ino, bn, boff, inbuf + done, can);
+            if(r == FS_ENOSPC && !retried && vol_shared()){ err = vol_defer(); break; }
+            if(r == FS_ENOSPC && !retried){
+                if(pos > in.size) in.size = pos;
+                if(write_inode(of->ino, &in) != FS_OK || fs_sync() != FS_OK ||
+                   read_inode(of->ino, &in) != FS_OK){ err = FS_ERR; break; }
+                retried = 1;
+                continue;
+            }
+            if(r != FS_OK){ err = r; break; }
+            done += can;
+            pos  += can;
+            continue;
+        }
 
-        int phys = map_bn_for_write(&in, bn);
-        if(phys < 0) return phys;
+        // 对齐的整块区间：新块不清零、不读旧内容，物理连续的一段一次写出（aio 打开时各段
+        // 同时在途，返回前收割）。不连续的下一块已分配，留给下一轮作为新段的起点
+        if(boff == 0 && len - done >= BSIZE){
+            uint32_t nb = (len - done) / BSIZE, run = 1;
+            int phys = map_bn(&in, bn, amode, &of->bmc);
+            if(phys < 0){ err = phys; break; }
+            while(run < nb){
+                int p = map_bn(&in, bn+run, amode, &of->bmc);
+                if(p < 0){ if(amode) err = p; break; }
+                if(p != phys + (int)run) break;
+                run++;
+            }
+            if(dev_write_blocks_async(inbuf + done, (uint32_t)phys, run, NULL, NULL) != FS_OK){ err = FS_ERR; break; }
+            done += run * BSIZE;
+            pos  += run * BSIZE;
+            if(err != FS_OK) break;
+            continue;
+        }
 
-        uint8_t blk[BLOCK_SIZE];
-        if(dev_read_block(blk, (uint32_t)phys) != FS_OK) return FS_ERR;
+        // 首尾不满一块：读-改-写
+        int phys = map_bn(&in, bn, MAP_ALLOC, &of->bmc);
+        if(phys < 0){ err = phys; break; }
 
-        uint32_t can = BLOCK_SIZE - boff;
+        uint8_t blk[BLOCK_SIZE_MAX];
+        if(dev_read_block(blk, (uint32_t)phys) != FS_OK){ err = FS_ERR; break; }
+
+        uint32_t can = BSIZE - boff;
         if(can > len - done) can = len - done;
 
         memcpy(blk + boff, inbuf + done, can);
-        if(dev_write_block(blk, (uint32_t)phys) != FS_OK) return FS_ERR;
+        if(dev_write_block(blk, (uint32_t)phys) != FS_OK){ err = FS_ERR; break; }
 
         done += can;
         pos  += can;
     }
 
+    // 整块段写盘失败时不知道哪些落了盘，整个调用报错
+    if(dev_aio_drain() != FS_OK){ err = FS_ERR; done = 0; }
+
+    // 中途出错：已写部分照常记入 inode（否则新分配的块会丢失），有进度则返回短写
     if(pos > in.size) in.size = pos;
     ts_now(&in.mtime);
-    if(write_inode(g_ofile[fd].ino, &in) != FS_OK) return FS_ERR;
+    if(write_inode(of->ino, &in) != FS_OK) return FS_ERR;
 
-    g_ofile[fd].offset = pos;
-    return (int)done;
+    of->offset = pos;
+    if(g_mopt.delalloc && !vol_shared() && da_balance() != FS_OK && err == FS_OK) err = FS_ERR;
+    fs_maybe_sync();
+    return (err != FS_OK && done == 0) ? err : (int)done;
+}
+
+// 同一描述的读写串行（共享偏移与预读状态，dup 出来的 fd 也一样）；同一文件读共享、写独占。
+// 独占卷时这些锁都无人竞争
+static int file_io(int fd, void* buf, uint32_t len, int wr){
+    ofile_t* of = fs_file(fd);
+    if(!of) return FS_EBADF;
+    if(wr && (!of->writable || (g_vol->fdt[fd].flags & FD_RDONLY))) return FS_EPERM;
+    pthread_mutex_lock(&of->lock);
+    int r = inode_lock(of->ino, wr);
+    if(r == FS_OK){
+        r = wr ? file_write(of, buf, len) : file_read(of, buf, len);
+        if(!wr) dev_aio_drain();        // 收割预读（失败不影响本次读）
+        inode_unlock(of->ino);
+    }
+    pthread_mutex_unlock(&of->lock);
+    return r;
+}
+int fs_read(int fd, void* buf, uint32_t len){
+    uint64_t t0=now_ns(); int r=file_io(fd, buf, len, 0);
+    stat_op(MX_OP_READ, t0, r);
+    TRACE(TR_READ, t0, fd, len, r, NULL);
+    return r;
+}
+int fs_write(int fd, const void* buf, uint32_t len){
+    uint64_t t0=now_ns(); int r=file_io(fd, (void*)buf, len, 1);
+    stat_op(MX_OP_WRITE, t0, r);
+    TRACE(TR_WRITE, t0, fd, len, r, NULL);
+    return r;
 }
@@ -1,37 +1,188 @@
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "fs.h"
 
-int fs_format(){
-    dev_close();
-    if(dev_open("disk.img","wb+")!=FS_OK) return FS_ERR;
+// 超级块/组描述符的计数器只在内存中增减：置脏后在 fs_sync / 卸载 / 提交间隔到期时写回
+#define g_sb_dirty  (g_vol->sb_dirty)    // 内存计数器与磁盘不一致
+#define g_sb_live   (g_vol->sb_live)     // 已把磁盘上的 state 改为 SB_STATE_DIRTY
+#define g_last_sync (g_vol->last_sync)
 
-    // 清盘
-    uint8_t zero[BLOCK_SIZE]={0};
-    for(uint32_t i=0;i<TOTAL_BLOCKS;i++) dev_write_block(zero,i);
+// 解析逗号分隔的挂载选项，如 "dev=pread,direct,stats" 或 "mmap"
+int fs_parse_opts(const char* s){
+    if(!s) return FS_OK;
+    char buf[256]; strncpy(buf, s, sizeof(buf)-1); buf[sizeof(buf)-1]='\0';
+    for(char* tok=strtok(buf, ","); tok; tok=strtok(NULL, ",")){
+        if(strcmp(tok,"dev=stdio")==0)      { g_mopt.backend=DEV_STDIO; g_mopt.direct=0; }
+        else if(strcmp(tok,"dev=pread")==0) g_mopt.backend=DEV_PREAD;
+        else if(strcmp(tok,"direct")==0)    { g_mopt.backend=DEV_PREAD; g_mopt.direct=1; }
+        else if(strcmp(tok,"dev=mmap")==0 || strcmp(tok,"mmap")==0){ g_mopt.backend=DEV_MMAP; g_mopt.direct=0; }
+        else if(strcmp(tok,"stats")==0)     g_mopt.show_stats=1;
+        else if(strncmp(tok,"stats=",6)==0){
+            if(strlen(tok+6)>=sizeof(g_mopt.stats_file)){ fprintf(stderr, "stats file name too long: %s\n", tok+6); return FS_ERR; }
+            strcpy(g_mopt.stats_file, tok+6);
+        }
+        else if(strncmp(tok,"trace=",6)==0){
+            if(strlen(tok+6)>=sizeof(g_mopt.trace_file)){ fprintf(stderr, "trace file name too long: %s\n", tok+6); return FS_ERR; }
+            strcpy(g_mopt.trace_file, tok+6);
+        }
+        else if(strncmp(tok,"tracebuf=",9)==0) g_mopt.trace_buf=(uint32_t)atoi(tok+9);
+        else if(strncmp(tok,"commit=",7)==0) g_mopt.commit_secs=(uint32_t)atoi(tok+7);
+        else if(strcmp(tok,"extents")==0)   g_mopt.extents=1;
+        else if(strncmp(tok,"ra=",3)==0)    g_mopt.ra_kb=(uint32_t)atoi(tok+3);
+        else if(strcmp(tok,"strictatime")==0) g_mopt.atime=ATIME_STRICT;
+        else if(strcmp(tok,"relatime")==0)  g_mopt.atime=ATIME_RELATIME;
+        else if(strcmp(tok,"noatime")==0)   g_mopt.atime=ATIME_NOATIME;
+        else if(strcmp(tok,"delalloc")==0)  g_mopt.delalloc=1;
+        else if(strcmp(tok,"nodelalloc")==0) g_mopt.delalloc=0;
+        else if(strcmp(tok,"aio=off")==0)   g_mopt.aio=AIO_OFF;
+        else if(strcmp(tok,"aio=uring")==0) g_mopt.aio=AIO_URING;
+        else if(strcmp(tok,"aio=threads")==0) g_mopt.aio=AIO_THREADS;
+        else if(strncmp(tok,"qd=",3)==0){
+            int q=atoi(tok+3);
+            g_mopt.qd = q<1 ? 1u : (uint32_t)q>AIO_QD_MAX ? AIO_QD_MAX : (uint32_t)q;
+        }
+        else{ fprintf(stderr, "unknown mount option: %s\n", tok); return FS_ERR; }
+    }
+    return FS_OK;
+}
+
+int fs_parse_atime(const char* s){
+    if(strcmp(s,"strict")==0 || strcmp(s,"strictatime")==0) return ATIME_STRICT;
+    if(strcmp(s,"relatime")==0) return ATIME_RELATIME;
+    if(strcmp(s,"noatime")==0)  return ATIME_NOATIME;
+    return 0;
+}
+// -o 指定的优先，否则用超级块里的缺省；旧镜像没有该字段按 strict
+int fs_atime_mode(){
+    if(g_mopt.atime) return g_mopt.atime;
+    return g_sb.atime_mode ? (int)g_sb.atime_mode : ATIME_STRICT;
+}
+int fs_set_atime_default(int mode){
+    if(mode<ATIME_STRICT || mode>ATIME_NOATIME) return FS_ERR;
+    g_sb.atime_mode=(uint32_t)mode;
+    sb_mark_dirty();
+    return FS_OK;
+}
+
+// 超级块小于一个块、组描述符表末块可能不满：先拷进整块缓冲再写，尾部补零
+int sb_write(){
+    uint8_t blk[BLOCK_SIZE_MAX]={0};
+    memcpy(blk, &g_sb, sizeof(g_sb));
+    return dev_write_meta(blk, BLK_SUPER);
+}
+int gd_write(){
+    if(!g_gdt) return FS_ERR;
+    size_t total=(size_t)g_sb.groups_count*sizeof(group_desc_t);
+    for(uint32_t k=0; k<g_sb.gdt_blocks; k++){
+        uint8_t blk[BLOCK_SIZE_MAX]={0};
+        size_t off=(size_t)k*BSIZE, n= total-off < BSIZE ? total-off : BSIZE;
+        memcpy(blk, (uint8_t*)g_gdt+off, n);
+        if(dev_write_meta(blk, BLK_GDESC+k)!=FS_OK) return FS_ERR;
+    }
+    return FS_OK;
+}
+static int gd_read(){
+    free(g_gdt);
+    g_gdt=(group_desc_t*)calloc(g_sb.gdt_blocks, BSIZE);   // 按整块分配，末块多出的部分不用
+    if(!g_gdt) return FS_ERR;
+    for(uint32_t k=0; k<g_sb.gdt_blocks; k++)
+        if(dev_read_block((uint8_t*)g_gdt+(size_t)k*BSIZE, BLK_GDESC+k)!=FS_OK) return FS_ERR;
+    return FS_OK;
+}
+
+// 首次修改时先把磁盘上的 state 置为 DIRTY 并落盘：之后若未正常卸载，下次挂载能发现
+void sb_mark_dirty(){
+    g_sb_dirty = 1;
+    if(!g_sb_live){
+        g_sb_live = 1;
+        g_sb.state = SB_STATE_DIRTY;
+        sb_write(); gd_write();
+        if(!journal_active()) dev_sync();   // 有日志时随第一次提交落盘，崩溃后重放即可
+    }
+}
+
+static int sb_flush(){
+    if(!g_sb_dirty) return FS_OK;
+    ts_now((uint32_t*)&g_sb.write_time);
+    if(sb_write()!=FS_OK || gd_write()!=FS_OK) return FS_ERR;
+    g_sb_dirty = 0;
+    return FS_OK;
+}
+
+// 块组几何：每组的块数 = 一个位图块的位数；inode 平均分到各组，并凑满整块 inode 表。
+// 0 号组：引导块、超级块、GDT、位图×2、inode 表；其他组：位图×2、inode 表
+static int geom_init(uint32_t bs, uint64_t size, uint32_t inodes){
+    if(!bs) bs=DEF_BLOCK_SIZE;
+    if(bs<BLOCK_SIZE_MIN || bs>BLOCK_SIZE_MAX || (bs&(bs-1))) return FS_ERR;
+    uint64_t nblk = size ? size/bs : DEF_BLOCKS;
+    if(nblk > 0x7fffffffu) return FS_ERR;           // 块号以 int 返回
+    if(!inodes) inodes = size ? (uint32_t)(size/8192u) : DEF_INODES;   // 缺省每 8KB 一个 inode
+    if(inodes < 16) inodes = 16;
+
+    uint32_t bpg=bs*8u, ipb=bs/INODE_SIZE;
+    uint32_t ng=(uint32_t)((nblk+bpg-1)/bpg);
+    uint32_t ipg=(inodes+ng-1)/ng, ipg_max=(bpg-1)/ipb*ipb;     // 组内位 0 不用
+    ipg=(ipg+ipb-1)/ipb*ipb; if(ipg>ipg_max) ipg=ipg_max;
+    uint32_t itbl=ipg/ipb;
+    uint32_t gdtb=(uint32_t)((ng*sizeof(group_desc_t)+bs-1)/bs);
+    // 末组太小（放不下自己的元数据再加几个数据块）就舍去
+    uint32_t last=(uint32_t)(nblk-(uint64_t)(ng-1)*bpg);
+    if(ng>1 && last < 2+itbl+16){ nblk-=last; ng--; }
+    if(nblk < 2u+gdtb+2u+itbl+16u) return FS_ERR;
 
-    // 初始化 SB/GD
     memset(&g_sb,0,sizeof(g_sb));
-    g_sb.magic=FS_MAGIC; g_sb.block_size=BLOCK_SIZE; g_sb.blocks_count=TOTAL_BLOCKS;
-    g_sb.inodes_count=MAX_INODES; g_sb.free_inodes=MAX_INODES; g_sb.free_blocks=TOTAL_BLOCKS;
-    g_sb.first_data_block=BLK_DATA_START; g_sb.inode_table_start=BLK_ITBL_START;
-    g_sb.block_bitmap_blk=BLK_BMAP; g_sb.inode_bitmap_blk=BLK_IMAP; g_sb.root_ino=1;
-    ts_now((uint32_t*)&g_sb.mount_time); ts_now((uint32_t*)&g_sb.write_time);
+    g_sb.magic=FS_MAGIC; g_sb.block_size=bs; g_sb.blocks_count=(uint32_t)nblk;
+    g_sb.rev=SB_REV_GROUPS; g_sb.blocks_per_group=bpg; g_sb.inodes_per_group=ipg;
+    g_sb.groups_count=ng; g_sb.itbl_blocks=itbl; g_sb.gdt_blocks=gdtb;
+    g_sb.inodes_count=ipg*ng; g_sb.root_ino=1;
+    g_sb.atime_mode=ATIME_RELATIME;
 
-    memset(&g_gd,0,sizeof(g_gd));
-    g_gd.block_bitmap=BLK_BMAP; g_gd.inode_bitmap=BLK_IMAP; g_gd.inode_table=BLK_ITBL_START;
-    g_gd.free_blocks_count=TOTAL_BLOCKS; g_gd.free_inodes_count=MAX_INODES;
+    free(g_gdt);
+    g_gdt=(group_desc_t*)calloc(gdtb, bs);
+    if(!g_gdt) return FS_ERR;
+    for(uint32_t g=0; g<ng; g++){
+        uint32_t bb = g ? g*bpg : BLK_GDESC+gdtb;
+        g_gdt[g].block_bitmap=bb; g_gdt[g].inode_bitmap=bb+1; g_gdt[g].inode_table=bb+2;
+    }
+    // 旧字段保留为 0 号组的位置，便于查看
+    g_sb.block_bitmap_blk=g_gdt[0].block_bitmap; g_sb.inode_bitmap_blk=g_gdt[0].inode_bitmap;
+    g_sb.inode_table_start=g_gdt[0].inode_table; g_sb.first_data_block=g_gdt[0].inode_table+itbl;
+    return FS_OK;
+}
 
-    dev_write_block(&g_sb, BLK_SUPER);
-    dev_write_block(&g_gd, BLK_GDESC);
+// 日志区放在 0 号组数据区开头：缺省取卷的 1/32（256..16384 块），最多占该组剩余空间的一半
+static void journal_geom(uint32_t journal){
+    uint32_t room = (group_len(0) - g_sb.first_data_block) / 2;
+    if(journal == FORMAT_NO_JOURNAL) return;
+    uint32_t jb = journal;
+    if(!jb){ jb = g_sb.blocks_count/32; if(jb < 256) jb = 256; if(jb > 16384) jb = 16384; }
+    if(jb > room) jb = room;
+    if(jb < 16) return;
+    g_sb.journal_start = g_sb.first_data_block; g_sb.journal_blocks = jb;
+}
 
-    // 预留元数据块
-    for(uint32_t i=0;i<BLK_DATA_START;i++) bmap_set(i,1,1);
-    g_sb.free_blocks -= BLK_DATA_START; g_gd.free_blocks_count -= BLK_DATA_START;
-    dev_write_block(&g_sb, BLK_SUPER); dev_write_block(&g_gd, BLK_GDESC);
+int fs_format(const char* img, uint32_t block_size, uint64_t size, uint32_t inodes, uint32_t journal){
+    fs_unmount();
+    if(geom_init(block_size, size, inodes)!=FS_OK) return FS_ERR;
+    journal_geom(journal);
+    if(dev_open(img,"wb+")!=FS_OK) return FS_ERR;
 
-    // 根 inode
-    bmap_set(1,0,1); g_sb.free_inodes--; g_gd.free_inodes_count--;
-    dev_write_block(&g_sb, BLK_SUPER); dev_write_block(&g_gd, BLK_GDESC);
+    // 镜像直接截到卷大小：未写的块读出来就是 0，不必逐块清零
+    if(dev_truncate((uint64_t)g_sb.blocks_count*BSIZE)!=FS_OK || dev_attach()!=FS_OK){ dev_close(); return FS_ERR; }
+    ts_now((uint32_t*)&g_sb.mount_time); ts_now((uint32_t*)&g_sb.write_time);
+    if(bitmap_load()!=FS_OK){ dev_close(); return FS_ERR; }   // 全零位图
+
+    // 预留各组元数据块 + 根 inode，空闲计数直接由位图统计
+    for(uint32_t g=0; g<g_sb.groups_count; g++){
+        for(uint32_t b=g*g_sb.blocks_per_group; b<group_meta_end(g); b++) bmap_set(b,1,1);
+    }
+    for(uint32_t b=0; b<g_sb.journal_blocks; b++) bmap_set(g_sb.journal_start+b,1,1);
+    bmap_set(1,0,1);
+    for(uint32_t g=0; g<g_sb.groups_count; g++)
+        bitmap_count_group(g, &g_gdt[g].free_blocks_count, &g_gdt[g].free_inodes_count);
+    bitmap_count_free(&g_sb.free_blocks, &g_sb.free_inodes);
+    g_sb_live = 0; sb_mark_dirty();
 
     inode_t root={0}; root.mode=MODE_DIR; root.links=2; ts_now(&root.ctime); ts_now(&root.mtime); ts_now(&root.atime);
     write_inode(1,&root);
@@ -41,17 +192,62 @@ int fs_format(){
 
     // 创建默认用户表
     users_bootstrap();
-    dev_close();
+    return fs_unmount();
+}
+
+// 超级块位于字节偏移 block_size 处：按候选块大小依次探测
+static int sb_probe(){
+    for(uint32_t bs=BLOCK_SIZE_MIN; bs<=BLOCK_SIZE_MAX; bs<<=1){
+        superblock_t sb;
+        if(dev_read_at(&sb, sizeof(sb), bs)!=FS_OK) continue;
+        if(sb.magic==FS_MAGIC && sb.block_size==bs){ g_sb=sb; return FS_OK; }
+    }
+    return FS_ERR;
+}
+
+// 旧版镜像只有一个组：位图各一块（超出 8*block_size 的块不可寻址），inode 表固定 64 块
+static int sb_check_geometry(){
+    if(g_sb.atime_mode > ATIME_NOATIME) g_sb.atime_mode=0;   // 旧镜像此处可能是垃圾
+    if(g_sb.rev != SB_REV_GROUPS){
+        g_sb.journal_start=0; g_sb.journal_blocks=0;
+        g_sb.blocks_per_group=BSIZE*8u; g_sb.groups_count=1;
+        g_sb.inodes_per_group=g_sb.inodes_count; g_sb.itbl_blocks=LEGACY_ITBL_BLOCKS; g_sb.gdt_blocks=1;
+        return g_sb.inodes_count && g_sb.inodes_count<BSIZE*8u ? FS_OK : FS_ERR;
+    }
+    uint32_t ng=g_sb.groups_count, bpg=g_sb.blocks_per_group;
+    if(bpg!=BSIZE*8u || !ng || (uint64_t)(ng-1)*bpg >= g_sb.blocks_count || (uint64_t)ng*bpg < g_sb.blocks_count) return FS_ERR;
+    if(!g_sb.inodes_per_group || g_sb.inodes_per_group>=bpg || g_sb.inodes_count!=g_sb.inodes_per_group*ng) return FS_ERR;
+    if((uint64_t)g_sb.gdt_blocks*BSIZE < (uint64_t)ng*sizeof(group_desc_t)) return FS_ERR;
     return FS_OK;
 }
 
 int fs_mount(const char* img){
     if(dev_open(img, "rb+")!=FS_OK) return FS_ERR;
-    if(dev_read_block(&g_sb, BLK_SUPER)!=FS_OK) return FS_ERR;
-    if(g_sb.magic!=FS_MAGIC || g_sb.block_size!=BLOCK_SIZE) return FS_ERR;
-    if(dev_read_block(&g_gd, BLK_GDESC)!=FS_OK) return FS_ERR;
+    icache_drop(); dcache_drop();
+    if(sb_probe()!=FS_OK || sb_check_geometry()!=FS_OK){ dev_close(); return FS_ERR; }
+    if(dev_attach()!=FS_OK){ dev_close(); return FS_ERR; }
+    // 先重放日志：超级块本身也可能在事务里，重放过就重新读
+    int jr = journal_replay();
+    if(jr < 0 || (jr > 0 && (sb_probe()!=FS_OK || sb_check_geometry()!=FS_OK))){ dev_close(); return FS_ERR; }
+    if(gd_read()!=FS_OK || bitmap_load()!=FS_OK || journal_enable()!=FS_OK){ dev_close(); return FS_ERR; }
+    g_sb_dirty = 0; g_sb_live = 0; ts_now(&g_last_sync);
+
+    // 上次未正常卸载：计数器可能落后于位图，逐组按 popcount 重新计算
+    if(g_sb.state != SB_STATE_CLEAN){
+        uint32_t fb=0, fi=0; int fix=0;
+        for(uint32_t g=0; g<g_sb.groups_count; g++){
+            uint32_t b, i; bitmap_count_group(g, &b, &i);
+            if(b!=g_gdt[g].free_blocks_count || i!=g_gdt[g].free_inodes_count){
+                g_gdt[g].free_blocks_count=b; g_gdt[g].free_inodes_count=i; fix=1;
+            }
+            fb+=b; fi+=i;
+        }
+        if(fix || fb!=g_sb.free_blocks || fi!=g_sb.free_inodes){
+            g_sb.free_blocks=fb; g_sb.free_inodes=fi;
+            sb_mark_dirty();
+        }
+    }
     g_cwd = g_sb.root_ino;
-    memset(g_ofile,0,sizeof(g_ofile));
 
     // 引导 .users（若不存在则创建 root:root:0）
     users_bootstrap();
@@ -64,6 +260,53 @@ int fs_mount(const char* img){
         strncpy(g_user,"root",MAX_USER_LEN-1);
         g_user[MAX_USER_LEN-1]='\0';
     }
-    
+    // 跟踪从挂载完成后开始，只记本次运行的操作
+    if(g_mopt.trace_file[0] && trace_start(g_mopt.trace_buf)!=FS_OK)
+        fprintf(stderr, "cannot allocate trace buffer, tracing off\n");
     return FS_OK;
 }
+
+// 先把延迟分配的数据落盘，再把内存中的元数据（位图、计数器）写回块缓存（有日志时作为一个事务提交），再把缓存刷到宿主文件
+int fs_sync(){
+    int r=da_flush_all();
+    bitmap_release_pending();
+    if(icache_sync()!=FS_OK) r=FS_ERR;
+    if(bitmap_sync()!=FS_OK) r=FS_ERR;
+    if(sb_flush()!=FS_OK) r=FS_ERR;
+    if(journal_commit()!=FS_OK) r=FS_ERR;      // 无日志时即 dev_sync
+    ts_now(&g_last_sync);
+    return r;
+}
+
+// 提交间隔（-o commit=N 秒，0 表示只在 sync/卸载时写回）到期则 fs_sync
+int fs_sync_due(){
+    // 日志快装不下了（已记入的映像 + 提交时还要写的 inode 表/位图/组描述符）：不等提交间隔
+    if(journal_active() && journal_need_commit(icache_dirty() + bitmap_dirty() + g_sb.gdt_blocks + 1)) return 1;
+    if(!g_mopt.commit_secs || !g_sb_live) return 0;
+    uint32_t now; ts_now(&now);
+    return now - g_last_sync >= g_mopt.commit_secs;
+}
+// 提交要独占卷：共享模式下由 api.c 放锁后换独占锁再来
+void fs_maybe_sync(){ if(!vol_shared() && fs_sync_due()) fs_sync(); }
+
+int fs_unmount(){
+    int mounted = g_gdt!=NULL;
+    int r=fs_close_all();
+    if(da_flush_all()!=FS_OK){ r=FS_ERR; da_drop_all(); }
+    if(icache_sync()!=FS_OK) r=FS_ERR;
+    icache_drop(); dcache_drop();
+    bitmap_release_pending();
+    if(bitmap_sync()!=FS_OK) r=FS_ERR;
+    if(g_sb_live){ g_sb.state = SB_STATE_CLEAN; g_sb_dirty = 1; g_sb_live = 0; }
+    if(sb_flush()!=FS_OK) r=FS_ERR;
+    if(journal_disable()!=FS_OK) r=FS_ERR;
+    bitmap_unload();
+    if(dev_close()!=FS_OK) r=FS_ERR;
+    free(g_gdt); g_gdt=NULL;
+    if(mounted && g_mopt.stats_file[0] && stats_dump(g_mopt.stats_file)!=FS_OK)
+        fprintf(stderr, "cannot append stats to %s\n", g_mopt.stats_file);
+    if(g_vol->trace && trace_export(g_mopt.trace_file)!=FS_OK)
+        fprintf(stderr, "cannot write trace to %s\n", g_mopt.trace_file);
+    trace_stop();
+    return r;
+}
@@ -1,35 +1,343 @@
 #include <string.h>
+#include <stdlib.h>
 #include "fs.h"
 
+// ===== inode 缓存 =====
+// 以 inode 号为键缓存 inode_t；write_inode 只改缓存并置脏，icache_sync 时把
+// 同一 inode 表块里的所有脏 inode 合并成一次块写。打开的文件通过 iget/iput
+// 持有引用，被引用的项不会被淘汰，所以 fs_read/fs_write 不再触碰 inode 表。
+// 缓存本身由一把互斥锁保护；每项另有一把读写锁（inode_lock），打开期间项被钉住，
+// 锁也就一直有效。项按 IC_NENT 个一组分配：全部被钉住时再加一组（打开上千个文件的
+// 情形），已分配的组不移动也不释放，直到卷销毁；哈希桶数随组数加倍。
+// 无效项在空闲链上，无引用的有效项在 LRU 链上（表头最旧），取淘汰项是 O(1)；
+// 脏项另挂在脏链上，同步时只排序脏项。
+#define IC_NENT   256u
+#define IC_NCHUNK 256u   // 最多 IC_NENT*IC_NCHUNK 项
+#define IC_NHASH  128u   // 初始桶数，2 的幂；每项不超过 2 个桶链长
+
+typedef struct icent {
+    uint32_t ino;
+    int valid, dirty, ref;
+    struct icent* hnext;
+    struct icent *prev, *next;  // 空闲链或 LRU 链（ref>0 时不在任何链上）
+    struct icent *dprev, *dnext;// 脏链
+    inode_t in;
+    ofile_t* opens;             // 打开描述链（见 inode_open_add）
+    int orphan;                 // 已删除但仍被打开，最后关闭时释放
+    pthread_rwlock_t rw;        // 文件数据锁，与缓存项的复用无关
+} icent_t;
+
+typedef struct { icent_t *head, *tail; } iclist_t;
+
+struct icache_state {
+    icent_t* chunk[IC_NCHUNK];
+    uint32_t nchunk;
+    icent_t** hash;
+    uint32_t nhash;
+    iclist_t free, lru;
+    icent_t* dirty;             // 脏链表头
+    uint32_t ndirty;            // 脏项个数（每次读写后都要查提交点，不逐项数）
+    icache_stats_t st;
+    pthread_mutex_t lock;
+};
+#define ic (*g_vol->icache)
+#define LOCK()   pthread_mutex_lock(&ic.lock)
+#define UNLOCK() pthread_mutex_unlock(&ic.lock)
+#define FOR_EACH_ENT(s, e) \
+    for(uint32_t c_=0; c_<(s)->nchunk; c_++) for(icent_t* e=(s)->chunk[c_]; e<(s)->chunk[c_]+IC_NENT; e++)
+
+static void ic_list_del(iclist_t* l, icent_t* e){
+    if(e->prev) e->prev->next=e->next; else l->head=e->next;
+    if(e->next) e->next->prev=e->prev; else l->tail=e->prev;
+    e->prev=e->next=NULL;
+}
+static void ic_list_add(iclist_t* l, icent_t* e){
+    e->next=NULL; e->prev=l->tail;
+    if(l->tail) l->tail->next=e; else l->head=e;
+    l->tail=e;
+}
+
+static void ic_set_dirty(struct icache_state* s, icent_t* e){
+    if(e->dirty) return;
+    e->dirty=1; s->ndirty++;
+    e->dprev=NULL; e->dnext=s->dirty;
+    if(s->dirty) s->dirty->dprev=e;
+    s->dirty=e;
+}
+static void ic_clear_dirty(struct icache_state* s, icent_t* e){
+    if(!e->dirty) return;
+    if(e->dprev) e->dprev->dnext=e->dnext; else s->dirty=e->dnext;
+    if(e->dnext) e->dnext->dprev=e->dprev;
+    e->dprev=e->dnext=NULL;
+    e->dirty=0; s->ndirty--;
+}
+
+static inline uint32_t ihash(const struct icache_state* s, uint32_t ino){ return (ino * 2654435761u) & (s->nhash-1); }
+
+// 桶数加倍到不少于项数的一半，把有效项重新挂链
+static int ic_rehash(struct icache_state* s){
+    uint32_t n=s->nhash ? s->nhash : IC_NHASH;
+    while(n*2 < s->nchunk*IC_NENT) n<<=1;
+    if(n==s->nhash) return FS_OK;
+    icent_t** h=(icent_t**)calloc(n, sizeof(icent_t*));
+    if(!h) return s->hash ? FS_OK : FS_ERR;    // 扩不了就沿用旧表，只是链长些
+    free(s->hash); s->hash=h; s->nhash=n;
+    FOR_EACH_ENT(s, e){
+        if(!e->valid) continue;
+        uint32_t b=ihash(s, e->ino); e->hnext=h[b]; h[b]=e;
+    }
+    return FS_OK;
+}
+
+static icent_t* ic_add_chunk(struct icache_state* s){
+    if(s->nchunk >= IC_NCHUNK) return NULL;
+    icent_t* c=(icent_t*)calloc(IC_NENT, sizeof(icent_t));
+    if(!c) return NULL;
+    for(uint32_t i=0;i<IC_NENT;i++){ pthread_rwlock_init(&c[i].rw, NULL); ic_list_add(&s->free, &c[i]); }
+    s->chunk[s->nchunk++]=c;
+    if(ic_rehash(s)!=FS_OK) return NULL;
+    return c;
+}
+
+int icache_vol_init(volume_t* v){
+    if(!(v->icache=calloc(1, sizeof(*v->icache)))) return FS_ERR;
+    pthread_mutex_init(&v->icache->lock, NULL);
+    return ic_add_chunk(v->icache) ? FS_OK : FS_ERR;
+}
+void icache_vol_free(volume_t* v){
+    if(!v->icache) return;
+    pthread_mutex_destroy(&v->icache->lock);
+    FOR_EACH_ENT(v->icache, e) pthread_rwlock_destroy(&e->rw);
+    for(uint32_t c=0;c<v->icache->nchunk;c++) free(v->icache->chunk[c]);
+    free(v->icache->hash);
+    free(v->icache); v->icache=NULL;
+}
+
 static int inode_pos(uint32_t ino, uint32_t* blk, uint32_t* off){
-    if(ino==0 || ino>MAX_INODES) return FS_ERR;
-    uint32_t idx=(ino-1)*INODE_SIZE;
-    *blk = g_sb.inode_table_start + (idx / BLOCK_SIZE);
-    *off = idx % BLOCK_SIZE;
+    if(ino==0 || ino>g_sb.inodes_count || !g_gdt) return FS_ERR;
+    uint32_t idx=((ino-1) % g_sb.inodes_per_group)*INODE_SIZE;   // 组内字节偏移
+    *blk = g_gdt[GROUP_OF_INO(ino)].inode_table + (idx / BSIZE);
+    *off = idx % BSIZE;
     return FS_OK;
 }
-int read_inode(uint32_t ino, inode_t* out){
-    uint32_t blk,off; if(inode_pos(ino,&blk,&off)!=FS_OK) return FS_ERR;
-    uint8_t buf[BLOCK_SIZE]; if(dev_read_block(buf,blk)!=FS_OK) return FS_ERR;
-    memcpy(out, buf+off, sizeof(inode_t));
+
+static icent_t* ic_lookup(uint32_t ino){
+    for(icent_t* e=ic.hash[ihash(&ic, ino)]; e; e=e->hnext)
+        if(e->valid && e->ino==ino) return e;
+    return NULL;
+}
+static void ic_unhash(icent_t* e){
+    icent_t** pp=&ic.hash[ihash(&ic, e->ino)];
+    while(*pp && *pp!=e) pp=&(*pp)->hnext;
+    if(*pp) *pp=e->hnext;
+    e->hnext=NULL;
+}
+
+// 淘汰前单独写回一个脏项
+static int ic_flush_one(icent_t* e){
+    uint8_t buf[BLOCK_SIZE_MAX];
+    uint32_t blk,off;
+    if(inode_pos(e->ino,&blk,&off)!=FS_OK || dev_read_block(buf, blk)!=FS_OK) return FS_ERR;
+    memcpy(buf+off, &e->in, sizeof(inode_t));
+    if(dev_write_meta(buf, blk)!=FS_OK) return FS_ERR;
+    ic.st.writebacks++;
+    ic_clear_dirty(&ic, e);
     return FS_OK;
 }
+
+// 取一个空闲项：优先无效项，否则淘汰 LRU 表头（最久未用且无引用），全被钉住时加一组
+static icent_t* ic_victim(){
+    icent_t* v=ic.free.head;
+    if(v){ ic_list_del(&ic.free, v); return v; }
+    if(!(v=ic.lru.head)){
+        if(!ic_add_chunk(&ic) || !(v=ic.free.head)) return NULL;
+        ic_list_del(&ic.free, v); return v;
+    }
+    if(v->dirty && ic_flush_one(v)!=FS_OK) return NULL;
+    ic_list_del(&ic.lru, v);
+    ic_unhash(v); v->valid=0;
+    return v;
+}
+
+// load=0：调用方会整体覆盖，不必读盘
+static icent_t* ic_get(uint32_t ino, int load){
+    uint32_t blk,off; if(inode_pos(ino,&blk,&off)!=FS_OK) return NULL;
+    icent_t* e=ic_lookup(ino);
+    if(e){
+        ic.st.hits++;
+        if(!e->ref){ ic_list_del(&ic.lru, e); ic_list_add(&ic.lru, e); }
+        return e;
+    }
+    ic.st.misses++;
+    if(!(e=ic_victim())) return NULL;
+    if(load){
+        const uint8_t* buf=dev_peek_block(blk);
+        if(!buf){ ic_list_add(&ic.free, e); return NULL; }
+        memcpy(&e->in, buf+off, sizeof(inode_t));
+    }
+    e->ino=ino; e->valid=1; e->dirty=0; e->ref=0;
+    e->opens=NULL; e->orphan=0;
+    ic_list_add(&ic.lru, e);
+    uint32_t h=ihash(&ic, ino); e->hnext=ic.hash[h]; ic.hash[h]=e;
+    return e;
+}
+
+int read_inode(uint32_t ino, inode_t* out){
+    LOCK();
+    icent_t* e=ic_get(ino, 1);
+    if(e) memcpy(out, &e->in, sizeof(inode_t));
+    UNLOCK();
+    return e ? FS_OK : FS_ERR;
+}
 int write_inode(uint32_t ino, const inode_t* in){
-    uint32_t blk,off; if(inode_pos(ino,&blk,&off)!=FS_OK) return FS_ERR;
-    uint8_t buf[BLOCK_SIZE]; if(dev_read_block(buf,blk)!=FS_OK) return FS_ERR;
-    memcpy(buf+off, in, sizeof(inode_t));
-    return dev_write_block(buf, blk);
+    LOCK();
+    icent_t* e=ic_get(ino, 0);
+    if(e){ memcpy(&e->in, in, sizeof(inode_t)); ic_set_dirty(&ic, e); }
+    UNLOCK();
+    return e ? FS_OK : FS_ERR;
 }
-int inode_truncate(uint32_t ino){
+
+// 打开文件期间钉住 inode，避免被淘汰
+int iget(uint32_t ino){
+    LOCK();
+    icent_t* e=ic_get(ino, 1);
+    if(e && !e->ref++) ic_list_del(&ic.lru, e);
+    UNLOCK();
+    return e ? FS_OK : FS_ERR;
+}
+void iput(uint32_t ino){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    if(e && e->ref>0 && !--e->ref) ic_list_add(&ic.lru, e);
+    UNLOCK();
+}
+
+// 只对已 iget 的 inode 有效：被钉住的项不会换人，锁可以在缓存锁之外等待
+int inode_lock(uint32_t ino, int excl){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    if(e && !e->ref) e=NULL;
+    UNLOCK();
+    if(!e) return FS_ERR;
+    if(excl) pthread_rwlock_wrlock(&e->rw);
+    else pthread_rwlock_rdlock(&e->rw);
+    return FS_OK;
+}
+void inode_unlock(uint32_t ino){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    UNLOCK();
+    if(e) pthread_rwlock_unlock(&e->rw);
+}
+
+// 以下只在独占卷时调用（open/close/unlink），缓存锁只为与 inode 缓存的其他用户互斥
+void inode_open_add(uint32_t ino, ofile_t* of){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    if(e && e->ref){ of->inext=e->opens; e->opens=of; }
+    UNLOCK();
+}
+int inode_open_del(uint32_t ino, ofile_t* of){
+    int last=0;
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    if(e){
+        ofile_t** pp=&e->opens;
+        while(*pp && *pp!=of) pp=&(*pp)->inext;
+        if(*pp) *pp=of->inext;
+        of->inext=NULL;
+        last = e->orphan && !e->opens;
+    }
+    UNLOCK();
+    return last;
+}
+ofile_t* inode_opens(uint32_t ino){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    ofile_t* of = e ? e->opens : NULL;
+    UNLOCK();
+    return of;
+}
+int inode_orphan(uint32_t ino){
+    LOCK();
+    icent_t* e=ic_lookup(ino);
+    int open = e && e->opens;
+    if(open) e->orphan=1;
+    UNLOCK();
+    return open;
+}
+
+typedef struct { uint32_t blk, off; icent_t* e; } icdirty_t;
+
+static int cmp_dirty(const void* a, const void* b){
+    const icdirty_t *x=(const icdirty_t*)a, *y=(const icdirty_t*)b;
+    return (x->blk>y->blk)-(x->blk<y->blk);
+}
+
+// 写回所有脏 inode：脏链按所在表块排序后每块一次读改写
+int icache_sync(){
+    LOCK();
+    uint32_t n=0;
+    icdirty_t* d=(icdirty_t*)malloc((ic.ndirty ? ic.ndirty : 1)*sizeof(icdirty_t));
+    if(!d){ UNLOCK(); return FS_ERR; }
+    for(icent_t* e=ic.dirty; e; e=e->dnext)
+        if(inode_pos(e->ino,&d[n].blk,&d[n].off)==FS_OK){ d[n].e=e; n++; }
+    qsort(d, n, sizeof(d[0]), cmp_dirty);
+    int r=FS_OK;
+    uint8_t buf[BLOCK_SIZE_MAX];
+    for(uint32_t i=0,j;i<n;i=j){
+        for(j=i+1; j<n && d[j].blk==d[i].blk; j++) ;
+        if(dev_read_block(buf, d[i].blk)!=FS_OK){ r=FS_ERR; continue; }
+        for(uint32_t k=i;k<j;k++) memcpy(buf+d[k].off, &d[k].e->in, sizeof(inode_t));
+        ic.st.writebacks++;
+        if(dev_write_meta(buf, d[i].blk)!=FS_OK){ r=FS_ERR; continue; }
+        for(uint32_t k=i;k<j;k++) ic_clear_dirty(&ic, d[k].e);
+    }
+    UNLOCK();
+    free(d);
+    return r;
+}
+
+uint32_t icache_dirty(){
+    LOCK();
+    uint32_t n=ic.ndirty;
+    UNLOCK();
+    return n;
+}
+
+// 卸载时丢弃（应先 icache_sync）；各项的读写锁保留
+void icache_drop(){
+    LOCK();
+    ic.free.head=ic.free.tail=NULL; ic.lru.head=ic.lru.tail=NULL;
+    FOR_EACH_ENT(&ic, e){
+        e->ino=0; e->valid=e->dirty=e->ref=0; e->hnext=NULL;
+        e->dprev=e->dnext=NULL;
+        e->opens=NULL; e->orphan=0;
+        ic_list_add(&ic.free, e);
+    }
+    memset(ic.hash, 0, ic.nhash*sizeof(ic.hash[0]));
+    ic.dirty=NULL; ic.ndirty=0;
+    UNLOCK();
+}
+
+void icache_get_stats(icache_stats_t* out){ if(out){ LOCK(); *out=ic.st; UNLOCK(); } }
+
+// 截断后打开它的描述上预读状态作废（间接表副本由代数作废）
+static int truncate_ino(uint32_t ino){
+    da_discard(ino);
+    for(ofile_t* of=inode_opens(ino); of; of=of->inext){ of->ra_pos=UINT32_MAX; of->ra_win=0; of->ra_end=0; }
     inode_t in; if(read_inode(ino,&in)!=FS_OK) return FS_ERR;
-    for(int i=0;i<NDIRECT;i++) if(in.direct[i]){ free_block(in.direct[i]); in.direct[i]=0; }
-    if(in.indirect1){
-        uint32_t tbl[BLOCK_SIZE/4];
-        if(dev_read_block(tbl, in.indirect1)==FS_OK){
-            for(size_t i=0;i<BLOCK_SIZE/4;i++) if(tbl[i]) free_block(tbl[i]);
-        }
-        free_block(in.indirect1); in.indirect1=0;
+    if(in.flags & INODE_FL_INDEX){          // 目录索引随目录一起释放
+        truncate_ino(in.dx_ino); free_inode(in.dx_ino);
+        in.dx_ino=0; in.flags &= ~INODE_FL_INDEX;
     }
+    if(in.flags & INODE_FL_EXTENTS) ext_truncate(&in);
+    else bmap_truncate(&in);
     in.size=0; in.blocks=0; ts_now(&in.mtime); ts_now(&in.ctime);
     return write_inode(ino,&in);
 }
+int inode_truncate(uint32_t ino){
+    uint64_t t0=now_ns(); int r=truncate_ino(ino);
+    stat_op(MX_OP_TRUNCATE, t0, r);
+    return r;
+}
@@ -0,0 +1,303 @@
+// src/journal.c — 元数据预写日志（物理块映像，整批提交）
+// 位图、inode 表、目录块、间接表、超级块/组描述符经 dev_write_meta 写入时不落到缓存，
+// 而是留在本事务的块映像表里（读时优先返回映像）。提交时把全部映像连同目标块号写进日志区，
+// 再写一个带校验和的提交块，只做一次 fsync；之后映像才写回原位置（普通脏块，随缓存写回）。
+//
+// 日志区分成两半，事务按序号交替使用。事务 N+1 提交时的那次 fsync 才把事务 N 写回原位的
+// 脏块刷出，所以半区要到 N+2 才被覆盖；崩溃时两半里最多有两个相邻的完整事务，挂载时按
+// 序号先旧后新重放（重放是幂等的）。正常卸载时检查点后把两半的头清零。
+// 超过半区容量的大事务先检查点（上一事务已无需保留），再从日志区开头占用整个日志区，
+// 它之后的下一次提交同样要先检查点。
+//
+// 映像表由一把递归锁保护（提交把映像写回原位时会经 dev_write_block 回到 journal_update）。
+// 共享卷锁下只会有 journal_log/journal_read/journal_update 和映像表满时的强制提交。
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+#define J_NHASH  1024u      // 2 的幂
+#define J_STAGE  (256u<<10) // 映像拼成一段写出的缓冲
+
+typedef struct jent {
+    uint32_t blk;
+    struct jent* hnext;
+    uint8_t* data;
+} jent_t;
+
+typedef struct {
+    int live;
+    uint32_t seq;               // 下一个事务的序号
+    uint32_t half;              // 每半区块数
+    uint32_t cap, cap_full;     // 一个事务最多容纳的块数：半区 / 整个日志区
+    int ckpt;                   // 上次是整区大事务：下次写日志前先检查点
+    jent_t** list; uint32_t n;  // 本事务的映像，按加入顺序
+    jent_t* hash[J_NHASH];
+    journal_stats_t st;
+} journal_t;
+
+struct journal_state {
+    uint8_t stage[J_STAGE];     // 映像拼成一段写出
+    journal_t j;
+    pthread_mutex_t lock;
+};
+#define jn      (g_vol->journal->j)
+#define j_stage (g_vol->journal->stage)
+#define LOCK()   pthread_mutex_lock(&g_vol->journal->lock)
+#define UNLOCK() pthread_mutex_unlock(&g_vol->journal->lock)
+
+int journal_vol_init(volume_t* v){
+    void* p=NULL;
+    if(posix_memalign(&p, 4096, sizeof(struct journal_state))!=0) return FS_ERR;
+    memset(p, 0, sizeof(struct journal_state));
+    v->journal=(struct journal_state*)p;
+    pthread_mutexattr_t a; pthread_mutexattr_init(&a);
+    pthread_mutexattr_settype(&a, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&v->journal->lock, &a); pthread_mutexattr_destroy(&a);
+    return FS_OK;
+}
+void journal_vol_free(volume_t* v){
+    if(v->journal) pthread_mutex_destroy(&v->journal->lock);
+    free(v->journal); v->journal=NULL;
+}
+
+static inline uint32_t jhash(uint32_t blk){ return (blk * 2654435761u) & (J_NHASH-1); }
+
+static uint32_t fnv1a(uint32_t h, const void* p, size_t n){
+    const uint8_t* s=(const uint8_t*)p;
+    for(size_t i=0;i<n;i++){ h ^= s[i]; h *= 16777619u; }
+    return h;
+}
+
+// count 个目标块号连同头部占几个描述块
+static uint32_t jdesc_blocks(uint32_t count){
+    return (uint32_t)((sizeof(jdesc_hdr_t) + (size_t)count*4 + BSIZE - 1) / BSIZE);
+}
+
+static uint32_t half_base(uint32_t seq){ return g_sb.journal_start + (seq & 1u) * jn.half; }
+
+// len 块的日志空间最多放多少个映像（描述块 + 映像 + 提交块）
+static uint32_t jcap(uint32_t len){
+    uint32_t n = len > 2 ? len - 2 : 0;
+    while(n && jdesc_blocks(n) + n + 1 > len) n--;
+    return n;
+}
+
+// 日志区须在 GDT 之后、卷内；不合法则当作没有日志
+static int jgeom(){
+    if(!g_sb.journal_blocks) return 0;
+    if(g_sb.journal_start < BLK_GDESC + g_sb.gdt_blocks || g_sb.journal_blocks < 8 ||
+       (uint64_t)g_sb.journal_start + g_sb.journal_blocks > g_sb.blocks_count){ g_sb.journal_blocks=0; return 0; }
+    jn.half = g_sb.journal_blocks / 2;
+    jn.cap = jcap(jn.half); jn.cap_full = jcap(g_sb.journal_blocks);
+    return 1;
+}
+
+// 校验一半日志：头、提交块、校验和都对才算完整事务，返回块数，否则 -1
+static int check_half(uint32_t base, uint32_t* seq, uint32_t** tags_out){
+    uint8_t blk[BLOCK_SIZE_MAX];
+    if(dev_raw_read(blk, base)!=FS_OK) return -1;
+    jdesc_hdr_t h; memcpy(&h, blk, sizeof(h));
+    uint32_t max = base==g_sb.journal_start ? jn.cap_full : jn.cap;
+    if(h.magic!=JNL_DESC_MAGIC || !h.count || h.count>max || h.ndesc!=jdesc_blocks(h.count)) return -1;
+    jcommit_t c;
+    if(dev_raw_read(blk, base + h.ndesc + h.count)!=FS_OK) return -1;
+    memcpy(&c, blk, sizeof(c));
+    if(c.magic!=JNL_COMMIT_MAGIC || c.seq!=h.seq || c.count!=h.count) return -1;
+
+    uint8_t* desc = (uint8_t*)malloc((size_t)h.ndesc*BSIZE);
+    if(!desc || dev_raw_readn(desc, base, h.ndesc)!=FS_OK){ free(desc); return -1; }
+    uint32_t* tags = (uint32_t*)malloc((size_t)h.count*4);
+    if(!tags){ free(desc); return -1; }
+    memcpy(tags, desc + sizeof(h), (size_t)h.count*4);
+    free(desc);
+    uint32_t cs = fnv1a(2166136261u, tags, (size_t)h.count*4);
+    for(uint32_t i=0; i<h.count; i++){
+        if(tags[i] >= g_sb.blocks_count || dev_raw_read(blk, base + h.ndesc + i)!=FS_OK){ free(tags); return -1; }
+        cs = fnv1a(cs, blk, BSIZE);
+    }
+    if(cs != c.csum){ free(tags); return -1; }
+    *seq = h.seq; *tags_out = tags;
+    return (int)h.count;
+}
+
+// 把一个已校验的事务写回原位置
+static int replay_one(uint32_t base, uint32_t n, const uint32_t* tags){
+    uint8_t blk[BLOCK_SIZE_MAX];
+    uint32_t ndesc = jdesc_blocks(n);
+    for(uint32_t i=0; i<n; i++)
+        if(dev_raw_read(blk, base + ndesc + i)!=FS_OK || dev_raw_write(blk, tags[i])!=FS_OK) return FS_ERR;
+    return FS_OK;
+}
+
+// 挂载时（位图、组描述符读入之前）调用：把两半里完整的事务按序号先旧后新写回原位置并刷盘，
+// 返回重放块数
+int journal_replay(){
+    journal_stats_t keep = jn.st;
+    memset(&jn, 0, sizeof(jn)); jn.seq = 1; jn.st = keep;
+    if(!jgeom()) return 0;
+    int cnt[2]; uint32_t seq[2], base[2]; uint32_t* tags[2] = { NULL, NULL };
+    for(uint32_t k=0; k<2; k++){
+        base[k] = g_sb.journal_start + k*jn.half;
+        cnt[k] = check_half(base[k], &seq[k], &tags[k]);
+    }
+    int order[2] = { 0, 1 }, total = 0, r = FS_OK;
+    if(cnt[0] >= 0 && cnt[1] >= 0 && seq[0] > seq[1]){ order[0] = 1; order[1] = 0; }
+    for(int i=0; i<2; i++){
+        int k = order[i];
+        if(cnt[k] < 0) continue;
+        if(r==FS_OK) r = replay_one(base[k], (uint32_t)cnt[k], tags[k]);
+        if(seq[k] >= jn.seq) jn.seq = seq[k] + 1;
+        total += cnt[k];
+        free(tags[k]);
+    }
+    if(!total) return 0;
+    if(r!=FS_OK || dev_sync()!=FS_OK) return FS_ERR;
+    jn.st.replayed += (uint32_t)total;
+    return total;
+}
+
+int journal_enable(){
+    if(!g_sb.journal_blocks || jn.live) return FS_OK;
+    if(!jn.cap && !jgeom()) return FS_OK;
+    jn.list = (jent_t**)calloc(jn.cap_full, sizeof(jent_t*));
+    if(!jn.list) return FS_ERR;
+    jn.n = 0; memset(jn.hash, 0, sizeof(jn.hash));
+    jn.live = 1;
+    return FS_OK;
+}
+
+int journal_active(){ return jn.live; }
+
+static jent_t* jlookup(uint32_t blk){
+    for(jent_t* e=jn.hash[jhash(blk)]; e; e=e->hnext) if(e->blk==blk) return e;
+    return NULL;
+}
+
+// 借出映像指针（下次提交前有效；仅在独占卷时使用）
+const void* journal_peek(uint32_t blk){
+    LOCK();
+    jent_t* e = jn.n ? jlookup(blk) : NULL;
+    UNLOCK();
+    return e ? e->data : NULL;
+}
+int journal_read(void* buf, uint32_t blk){
+    LOCK();
+    jent_t* e = jn.n ? jlookup(blk) : NULL;
+    if(e) memcpy(buf, e->data, BSIZE);
+    UNLOCK();
+    return e != NULL;
+}
+
+// 非元数据路径写到了本事务中的块（例如新分配时清零）：改写映像，保持读写一致
+int journal_update(const void* buf, uint32_t blk){
+    LOCK();
+    jent_t* e = jn.n ? jlookup(blk) : NULL;
+    if(e) memcpy(e->data, buf, BSIZE);
+    UNLOCK();
+    return e != NULL;
+}
+
+int journal_log(const void* buf, uint32_t blk){
+    LOCK();
+    jent_t* e = jlookup(blk);
+    if(!e){
+        // 映像表满：先提交已有部分（此时操作可能只做了一半，只在单个操作超出整个日志区时发生）
+        if(jn.n == jn.cap_full){
+            jn.st.forced++;
+            if(journal_commit()!=FS_OK){ UNLOCK(); return FS_ERR; }
+        }
+        e = (jent_t*)malloc(sizeof(jent_t));
+        if(!e || !(e->data = (uint8_t*)malloc(BSIZE))){ free(e); UNLOCK(); return FS_ERR; }
+        e->blk = blk;
+        uint32_t h = jhash(blk); e->hnext = jn.hash[h]; jn.hash[h] = e;
+        jn.list[jn.n++] = e;
+    }
+    memcpy(e->data, buf, BSIZE);
+    UNLOCK();
+    return FS_OK;
+}
+
+// 操作边界上检查：backlog 为提交时还会加进来的块数估计（脏 inode、位图、组描述符），
+// 合计超过半区的一半就提交，留出余量给下一个操作
+int journal_need_commit(uint32_t backlog){
+    LOCK();
+    int r = jn.live && jn.n + backlog >= jn.cap/2;
+    UNLOCK();
+    return r;
+}
+
+static int journal_commit_locked();
+int journal_commit(){
+    LOCK();
+    int r = journal_commit_locked();
+    UNLOCK();
+    return r;
+}
+
+static int journal_commit_locked(){
+    if(!jn.live || !jn.n) return dev_sync();
+    uint32_t n = jn.n, seq = jn.seq, base = half_base(seq);
+    uint32_t ndesc = jdesc_blocks(n);
+    int big = n > jn.cap;
+    if((big || jn.ckpt) && dev_sync()!=FS_OK) return FS_ERR;    // 检查点：之前的事务都已在原位置落盘
+    if(big) base = g_sb.journal_start;
+
+    // 描述块：头 + 目标块号
+    uint8_t* desc = (uint8_t*)calloc(ndesc, BSIZE);
+    if(!desc) return FS_ERR;
+    jdesc_hdr_t h = { JNL_DESC_MAGIC, seq, n, ndesc };
+    memcpy(desc, &h, sizeof(h));
+    uint32_t* tags = (uint32_t*)(desc + sizeof(h));
+    for(uint32_t i=0;i<n;i++) tags[i] = jn.list[i]->blk;
+    uint32_t cs = fnv1a(2166136261u, tags, (size_t)n*4);
+    int r = dev_raw_writen(desc, base, ndesc);
+    free(desc);
+
+    // 映像按段拼起来写
+    uint32_t per = J_STAGE / BSIZE;
+    for(uint32_t i=0; i<n && r==FS_OK; i+=per){
+        uint32_t k = n-i < per ? n-i : per;
+        for(uint32_t j=0;j<k;j++){
+            memcpy(j_stage + (size_t)j*BSIZE, jn.list[i+j]->data, BSIZE);
+            cs = fnv1a(cs, jn.list[i+j]->data, BSIZE);
+        }
+        r = dev_raw_writen(j_stage, base + ndesc + i, k);
+    }
+    if(r != FS_OK) return FS_ERR;
+    uint8_t cb[BLOCK_SIZE_MAX] = {0};
+    jcommit_t c = { JNL_COMMIT_MAGIC, seq, n, cs };
+    memcpy(cb, &c, sizeof(c));
+    if(dev_raw_write(cb, base + ndesc + n)!=FS_OK) return FS_ERR;
+
+    // 唯一一次刷盘：日志、数据块和上一事务已写回原位的块一起落盘
+    if(dev_sync()!=FS_OK) return FS_ERR;
+
+    // 已提交：映像写回原位置（普通脏块）。先清空映像表，dev_write_block 才不会再转回这里
+    jent_t** list = jn.list; jn.n = 0; memset(jn.hash, 0, sizeof(jn.hash));
+    for(uint32_t i=0;i<n;i++){
+        if(dev_write_block(list[i]->data, list[i]->blk)!=FS_OK) r = FS_ERR;
+        free(list[i]->data); free(list[i]); list[i] = NULL;
+    }
+    jn.seq++; jn.ckpt = big;
+    jn.st.commits++; jn.st.blocks += n;
+    return r;
+}
+
+// 卸载：提交剩余映像，刷盘使原位置都是最新，再清掉两半的头，下次挂载无需重放
+int journal_disable(){
+    if(!jn.live) return FS_OK;
+    int r = journal_commit();
+    if(dev_sync()!=FS_OK) r = FS_ERR;
+    if(r==FS_OK){
+        if(dev_raw_write(g_zero_block, g_sb.journal_start)!=FS_OK ||
+           dev_raw_write(g_zero_block, g_sb.journal_start + jn.half)!=FS_OK) r = FS_ERR;
+    }
+    for(uint32_t i=0;i<jn.n;i++){ free(jn.list[i]->data); free(jn.list[i]); }
+    free(jn.list);
+    journal_stats_t keep = jn.st;
+    memset(&jn, 0, sizeof(jn));
+    jn.st = keep;
+    return r;
+}
+
+void journal_get_stats(journal_stats_t* out){ if(out){ LOCK(); *out = jn.st; UNLOCK(); } }
@@ -35,7 +35,7 @@ static int append_line(const char* path, const char* line){
 
     // seek 到末尾（用 inode 大小）
     inode_t in;
-    if(read_inode(g_ofile[fd].ino, &in) != FS_OK){ fs_close(fd); return FS_ERR; }
+    if(read_inode(fs_file(fd)->ino, &in) != FS_OK){ fs_close(fd); return FS_ERR; }
     fs_seek(fd, (int32_t)in.size);
 
     int n = fs_write(fd, line, (uint32_t)strlen(line));
@@ -73,9 +73,9 @@ int session_save(int uid, const char* user){
 
     // 截断到 0
     inode_t in;
-    if(read_inode(g_ofile[fd].ino, &in) == FS_OK){
+    if(read_inode(fs_file(fd)->ino, &in) == FS_OK){
         in.size = 0;
-        if(write_inode(g_ofile[fd].ino, &in) != FS_OK){ fs_close(fd); return FS_ERR; }
+        if(write_inode(fs_file(fd)->ino, &in) != FS_OK){ fs_close(fd); return FS_ERR; }
     }
     fs_seek(fd, 0);
 
@@ -217,9 +217,9 @@ int users_change_password(const char* name, const char* pass){
 
     // 截断文件
     inode_t in;
-    if(read_inode(g_ofile[fd].ino, &in) == FS_OK){
+    if(read_inode(fs_file(fd)->ino, &in) == FS_OK){
         in.size = 0;
-        if(write_inode(g_ofile[fd].ino, &in) != FS_OK){ fs_close(fd); free(s); return FS_ERR; }
+        if(write_inode(fs_file(fd)->ino, &in) != FS_OK){ fs_close(fd); free(s); return FS_ERR; }
     }
     fs_seek(fd, 0);
 
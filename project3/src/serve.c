@@ -0,0 +1,249 @@
+// src/serve.c — mini_ext2 serve：卷挂载一次，经 Unix 域套接字服务本机多个客户端（协议见 server.h）
+// 每个连接一个线程，卷本身可多线程并发（见 api.c）。连接内按到达顺序执行：一次 read 读到的
+// 全部完整请求执行完后，应答一次写回。
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+#define OUT_BATCH (1u<<20)      // 应答积压到这么多就先写出，不等本批请求执行完
+
+typedef struct conn {
+    int sock, done, stop;
+    mx_vol_t* v;
+    pthread_t th;
+    int* fds; uint32_t nfds;    // 连接内 fd → 卷上的 fd，-1 为空
+    uint8_t *in, *out;
+    uint32_t in_len, in_cap, out_len, out_cap;
+    struct conn* next;
+} conn_t;
+
+static int g_wake[2] = { -1, -1 };      // 自管道：信号与 SRV_STOP 经它叫醒 accept 循环
+static void wake(){ if(write(g_wake[1], "x", 1)<0){} }
+static void on_signal(int sig){ (void)sig; wake(); }
+
+static int reserve(uint8_t** b, uint32_t* cap, uint32_t need){
+    if(need<=*cap) return 0;
+    uint32_t n = *cap ? *cap : 65536;
+    while(n<need) n*=2;
+    uint8_t* p=(uint8_t*)realloc(*b, n);
+    if(!p) return -1;
+    *b=p; *cap=n;
+    return 0;
+}
+
+// 为下一条应答预留头与 cap 字节载荷，返回载荷位置；resp_end 填头并提交
+static uint8_t* resp_begin(conn_t* c, uint32_t cap){
+    if(reserve(&c->out, &c->out_cap, c->out_len+(uint32_t)sizeof(srv_resp_t)+cap)) return NULL;
+    return c->out+c->out_len+sizeof(srv_resp_t);
+}
+static void resp_end(conn_t* c, uint32_t tag, int res, uint32_t len){
+    srv_resp_t h={ len, tag, res };
+    memcpy(c->out+c->out_len, &h, sizeof h);
+    c->out_len += (uint32_t)sizeof h+len;
+}
+
+static int fd_of(conn_t* c, int h){ return h>=0 && (uint32_t)h<c->nfds ? c->fds[h] : -1; }
+static int fd_bind(conn_t* c, int h, int fd){
+    if((uint32_t)h>=c->nfds){
+        uint32_t n = c->nfds ? c->nfds : 16;
+        while(n<=(uint32_t)h) n*=2;
+        int* p=(int*)realloc(c->fds, n*sizeof(int));
+        if(!p) return FS_ERR;
+        for(uint32_t i=c->nfds;i<n;i++) p[i]=-1;
+        c->fds=p; c->nfds=n;
+    }
+    c->fds[h]=fd;
+    return FS_OK;
+}
+// OPEN/DUP 指定的新 fd 必须在范围内且空闲
+static int fd_free_slot(conn_t* c, int h){ return h>=0 && h<SRV_FD_MAX && fd_of(c, h)<0; }
+
+typedef struct { conn_t* c; uint32_t at, len; int full; } ls_ctx_t;
+static int ls_put(void* arg, const char* name, int is_dir, const mx_stat_t* st){
+    ls_ctx_t* x=(ls_ctx_t*)arg;
+    srv_dirent_t e; e.st=*st; e.is_dir=(uint16_t)is_dir; e.name_len=(uint16_t)strlen(name);
+    uint32_t n=(uint32_t)sizeof e+e.name_len;
+    if(x->len+n>SRV_MSG_MAX || !resp_begin(x->c, x->len+n)){ x->full=1; return 1; }   // 超长目录截断
+    uint8_t* p=x->c->out+x->at+x->len;
+    memcpy(p, &e, sizeof e); memcpy(p+sizeof e, name, e.name_len);
+    x->len+=n;
+    return 0;
+}
+
+static void serve_one(conn_t* c, const srv_req_t* q, const uint8_t* p){
+    mx_vol_t* v=c->v;
+    char path[4096]="";
+    int res=FS_EINVAL, fd=fd_of(c, q->fd);
+    uint32_t len=0;
+    uint8_t* out;
+    switch(q->op){
+    case SRV_OPEN: case SRV_MKDIR: case SRV_UNLINK: case SRV_READDIR: case SRV_STAT:
+        if(q->len>=sizeof(path)) goto reply;
+        memcpy(path, p, q->len); path[q->len]='\0';
+        break;
+    }
+    switch(q->op){
+    case SRV_OPEN:
+        if(!fd_free_slot(c, q->arg)) break;
+        if((res=mx_open(v, path, (q->flags & 1) ? "w" : "r"))>=0){
+            if(fd_bind(c, q->arg, res)!=FS_OK){ mx_close(v, res); res=FS_ERR; }
+            else res=q->arg;
+        }
+        break;
+    case SRV_DUP:
+        if(fd<0){ res=FS_EBADF; break; }
+        if(!fd_free_slot(c, q->arg)) break;
+        if((res=mx_dup(v, fd, q->flags))>=0){
+            if(fd_bind(c, q->arg, res)!=FS_OK){ mx_close(v, res); res=FS_ERR; }
+            else res=q->arg;
+        }
+        break;
+    case SRV_CLOSE:
+        if(fd<0){ res=FS_EBADF; break; }
+        res=mx_close(v, fd); c->fds[q->fd]=-1;
+        break;
+    case SRV_READ:
+        if(fd<0){ res=FS_EBADF; break; }
+        if(q->arg<0 || (uint32_t)q->arg>SRV_MSG_MAX) break;
+        if(!(out=resp_begin(c, (uint32_t)q->arg))){ res=FS_ERR; break; }
+        res=mx_read(v, fd, out, (uint32_t)q->arg);
+        len = res>0 ? (uint32_t)res : 0;
+        break;
+    case SRV_WRITE:  res = fd<0 ? FS_EBADF : mx_write(v, fd, p, q->len); break;
+    case SRV_SEEK:   res = fd<0 ? FS_EBADF : mx_seek(v, fd, q->arg); break;
+    case SRV_MKDIR:  res=mx_mkdir(v, path); break;
+    case SRV_UNLINK: res=mx_unlink(v, path); break;
+    case SRV_READDIR:{
+        ls_ctx_t x={ c, c->out_len+(uint32_t)sizeof(srv_resp_t), 0, 0 };
+        res=mx_readdir(v, *path ? path : NULL, ls_put, &x);
+        len=x.len;
+        break;
+    }
+    case SRV_STAT:
+        if(!(out=resp_begin(c, sizeof(mx_stat_t)))){ res=FS_ERR; break; }
+        res=mx_stat(v, path, (mx_stat_t*)out);
+        if(res==FS_OK) len=sizeof(mx_stat_t);
+        break;
+    case SRV_SYNC:   res=mx_sync(v); break;
+    case SRV_STATS:
+        if(!(out=resp_begin(c, sizeof(mx_stats_t)))){ res=FS_ERR; break; }
+        mx_get_stats(v, (mx_stats_t*)out);
+        res=FS_OK; len=sizeof(mx_stats_t);
+        break;
+    case SRV_STOP:   c->stop=1; res=FS_OK; break;      // 应答写出后再叫醒主循环
+    }
+reply:
+    if(!resp_begin(c, len)) return;         // 内存不足：丢弃应答，客户端会等到断开
+    resp_end(c, q->tag, res, len);
+}
+
+static int flush_out(conn_t* c){
+    for(uint32_t off=0; off<c->out_len; ){
+        ssize_t n=send(c->sock, c->out+off, c->out_len-off, MSG_NOSIGNAL);
+        if(n<0 && errno==EINTR) continue;
+        if(n<=0) return -1;
+        off+=(uint32_t)n;
+    }
+    c->out_len=0;
+    return 0;
+}
+
+static void* conn_main(void* arg){
+    conn_t* c=(conn_t*)arg;
+    for(;;){
+        if(reserve(&c->in, &c->in_cap, c->in_len+65536)) break;
+        ssize_t n=read(c->sock, c->in+c->in_len, c->in_cap-c->in_len);
+        if(n<0 && errno==EINTR) continue;
+        if(n<=0) break;
+        c->in_len+=(uint32_t)n;
+
+        uint32_t pos=0;
+        srv_req_t q;
+        while(c->in_len-pos>=sizeof q){
+            memcpy(&q, c->in+pos, sizeof q);
+            if(q.len>SRV_MSG_MAX) goto out;                 // 协议错误，断开
+            if(c->in_len-pos<sizeof q+q.len) break;         // 载荷未收全
+            serve_one(c, &q, c->in+pos+sizeof q);
+            pos+=(uint32_t)sizeof q+q.len;
+            if(c->out_len>=OUT_BATCH && flush_out(c)) goto out;
+        }
+        memmove(c->in, c->in+pos, c->in_len-pos);
+        c->in_len-=pos;
+        if(flush_out(c)) break;
+        if(c->stop) wake();
+    }
+out:
+    for(uint32_t i=0;i<c->nfds;i++) if(c->fds[i]>=0) mx_close(c->v, c->fds[i]);
+    free(c->fds); free(c->in); free(c->out);
+    c->fds=NULL; c->in=c->out=NULL;
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void conn_reap(conn_t** list, int all){
+    for(conn_t** pp=list; *pp; ){
+        conn_t* c=*pp;
+        if(all) shutdown(c->sock, SHUT_RDWR);
+        if(all || __atomic_load_n(&c->done, __ATOMIC_ACQUIRE)){
+            pthread_join(c->th, NULL);
+            close(c->sock);
+            *pp=c->next; free(c);
+        }else pp=&c->next;
+    }
+}
+
+int srv_run(mx_vol_t* v, const char* path){
+    struct sockaddr_un a;
+    memset(&a, 0, sizeof a);
+    a.sun_family=AF_UNIX;
+    if(strlen(path)>=sizeof(a.sun_path)) return FS_EINVAL;
+    strcpy(a.sun_path, path);
+
+    int lfd=socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if(lfd<0) return FS_ERR;
+    // 套接字文件已存在：能连上说明另一个服务端在用，否则是上次遗留的
+    if(connect(lfd, (struct sockaddr*)&a, sizeof a)==0){ close(lfd); return FS_EBUSY; }
+    unlink(path);
+    if(bind(lfd, (struct sockaddr*)&a, sizeof a)<0 || listen(lfd, 64)<0 || pipe2(g_wake, O_CLOEXEC)<0){
+        close(lfd); return FS_ERR;
+    }
+
+    struct sigaction sa, old_int, old_term, old_pipe;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler=on_signal;
+    sigaction(SIGINT, &sa, &old_int); sigaction(SIGTERM, &sa, &old_term);
+    sa.sa_handler=SIG_IGN;
+    sigaction(SIGPIPE, &sa, &old_pipe);
+
+    conn_t* conns=NULL;
+    for(;;){
+        struct pollfd pf[2]={ { lfd, POLLIN, 0 }, { g_wake[0], POLLIN, 0 } };
+        if(poll(pf, 2, -1)<0){ if(errno==EINTR) continue; break; }
+        if(pf[1].revents) break;
+        if(!(pf[0].revents & POLLIN)) continue;
+        int s=accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        conn_reap(&conns, 0);
+        if(s<0) continue;
+        conn_t* c=(conn_t*)calloc(1, sizeof(conn_t));
+        if(!c){ close(s); continue; }
+        c->sock=s; c->v=v;
+        if(pthread_create(&c->th, NULL, conn_main, c)!=0){ close(s); free(c); continue; }
+        c->next=conns; conns=c;
+    }
+    conn_reap(&conns, 1);
+
+    close(lfd); unlink(path);
+    close(g_wake[0]); close(g_wake[1]); g_wake[0]=g_wake[1]=-1;
+    sigaction(SIGINT, &old_int, NULL); sigaction(SIGTERM, &old_term, NULL); sigaction(SIGPIPE, &old_pipe, NULL);
+    return FS_OK;
+}
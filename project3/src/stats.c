@@ -0,0 +1,150 @@
+// src/stats.c — 常开的运行时统计：关键操作的次数与 log2 延迟直方图、块分配器扫描长度，
+// 以及各层统计的汇总与文本输出（-o stats、stats 命令、stats=文件 卸载时追加）。
+// 计数用 relaxed 原子加，共享卷锁下多线程同时更新；读取时各字段分别原子读，不是一致快照
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fs.h"
+
+#define ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#define LD(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+
+static inline uint32_t bucket(uint64_t v){
+    if(v<2) return 0;
+    uint32_t b=63u-(uint32_t)__builtin_clzll(v);
+    return b<MX_HIST ? b : MX_HIST-1;
+}
+static void max_update(uint64_t* m, uint64_t v){
+    uint64_t c=LD(m);
+    while(v>c && !__atomic_compare_exchange_n(m, &c, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void stat_op(int op, uint64_t t0, int r){
+    uint64_t dt=now_ns()-t0;
+    mx_op_stats_t* s=&g_vol->opstat.op[op];      // calls 不单独计，汇总时由直方图求和
+    if(r<0 && r!=FS_EBUSY) ADD(&s->fails, 1);
+    ADD(&s->total_ns, dt);
+    ADD(&s->hist[bucket(dt)], 1);
+    max_update(&s->max_ns, dt);
+}
+
+void stat_scan(uint32_t words){
+    alloc_stats_t* a=&g_vol->opstat.alloc;
+    ADD(&a->allocs, 1);
+    ADD(&a->words, words);
+    ADD(&a->hist[bucket(words)], 1);
+    max_update(&a->max, words);
+}
+
+static void load_u64(uint64_t* dst, const uint64_t* src, size_t n){ for(size_t i=0;i<n;i++) dst[i]=LD(&src[i]); }
+
+void stats_collect(mx_stats_t* out){
+    memset(out, 0, sizeof(*out));
+    dev_get_stats(&out->dev); bcache_get_stats(&out->cache);
+    icache_get_stats(&out->icache); dcache_get_stats(&out->dcache);
+    journal_get_stats(&out->journal); da_get_stats(&out->delalloc);
+    load_u64((uint64_t*)out->op, (const uint64_t*)g_vol->opstat.op, sizeof(out->op)/(sizeof(uint64_t)));
+    load_u64((uint64_t*)&out->alloc, (const uint64_t*)&g_vol->opstat.alloc, sizeof(out->alloc)/(sizeof(uint64_t)));
+    for(int i=0;i<MX_OP_NUM;i++)
+        for(uint32_t b=0;b<MX_HIST;b++) out->op[i].calls+=out->op[i].hist[b];
+    out->delalloc_on=g_mopt.delalloc;
+}
+
+// ---- 文本输出 ----
+static const char* op_names[MX_OP_NUM]={ "namei", "dir_lookup", "alloc_block", "fs_read", "fs_write", "truncate" };
+
+// 2^b 纳秒写成 "512ns" / "4us" / "16ms" / "2s"
+static void fmt_pow2(uint32_t b, char* out, size_t n){
+    uint64_t v=1ull<<b;
+    if(v<1024) snprintf(out, n, "%lluns", (unsigned long long)v);
+    else if(v<(1ull<<20)) snprintf(out, n, "%lluus", (unsigned long long)(v>>10));
+    else if(v<(1ull<<30)) snprintf(out, n, "%llums", (unsigned long long)(v>>20));
+    else snprintf(out, n, "%llus", (unsigned long long)(v>>30));
+}
+// 第 p 百分位所在桶的上界是 2 的这么多次幂（显示时 us/ms 按 1024 进位）
+static uint32_t pct_bucket(const uint64_t* h, uint64_t total, uint32_t p){
+    uint64_t want=(total*p+99)/100, acc=0;
+    for(uint32_t i=0;i<MX_HIST;i++){ acc+=h[i]; if(acc>=want) return i+1; }
+    return MX_HIST;
+}
+static double pct(uint64_t a, uint64_t b){ return b ? 100.0*a/b : 0.0; }
+
+void mx_stats_print(FILE* f, const mx_stats_t* s, int hist){
+    static const char* names[]={"stdio","pread","mmap"};
+    const dev_stats_t* d=&s->dev; const bcache_stats_t* c=&s->cache;
+    fprintf(f, "[stats] dev=%s%s reads=%llu (avg %.1f us) writes=%llu (avg %.1f us) syncs=%llu\n",
+            names[d->backend], d->direct? "+direct":"",
+            (unsigned long long)d->reads,  d->reads?  d->read_ns/1000.0/d->reads   : 0.0,
+            (unsigned long long)d->writes, d->writes? d->write_ns/1000.0/d->writes : 0.0,
+            (unsigned long long)d->syncs);
+    fprintf(f, "[stats] blocks read=%llu (%.1f MB) written=%llu (%.1f MB) block-if reads=%llu writes=%llu\n",
+            (unsigned long long)d->read_blocks,  d->read_blocks *(double)d->block_size/(1<<20),
+            (unsigned long long)d->write_blocks, d->write_blocks*(double)d->block_size/(1<<20),
+            (unsigned long long)d->blk_reads, (unsigned long long)d->blk_writes);
+    if(d->aio)
+        fprintf(f, "[stats] aio=%s async=%llu max-in-flight=%llu\n", d->aio==1 ? "io_uring" : "threads",
+                (unsigned long long)d->async, (unsigned long long)d->qd_max);
+    fprintf(f, "[stats] cache hits=%llu misses=%llu hit-rate=%.1f%% evictions=%llu writebacks=%llu readahead=%llu\n",
+            (unsigned long long)c->hits, (unsigned long long)c->misses, pct(c->hits, c->hits+c->misses),
+            (unsigned long long)c->evictions, (unsigned long long)c->writebacks, (unsigned long long)c->readahead);
+    const icache_stats_t* ic=&s->icache;
+    fprintf(f, "[stats] icache hits=%llu misses=%llu hit-rate=%.1f%% itable-writes=%llu\n",
+            (unsigned long long)ic->hits, (unsigned long long)ic->misses, pct(ic->hits, ic->hits+ic->misses),
+            (unsigned long long)ic->writebacks);
+    const dcache_stats_t* dcs=&s->dcache;
+    uint64_t dtot=dcs->hits+dcs->neg_hits+dcs->misses;
+    fprintf(f, "[stats] dcache hits=%llu neg-hits=%llu misses=%llu hit-rate=%.1f%%\n",
+            (unsigned long long)dcs->hits, (unsigned long long)dcs->neg_hits, (unsigned long long)dcs->misses,
+            pct(dcs->hits+dcs->neg_hits, dtot));
+    const journal_stats_t* js=&s->journal;
+    if(js->commits || js->replayed)
+        fprintf(f, "[stats] journal commits=%llu blocks=%llu forced=%llu replayed=%llu\n",
+                (unsigned long long)js->commits, (unsigned long long)js->blocks,
+                (unsigned long long)js->forced, (unsigned long long)js->replayed);
+    const da_stats_t* das=&s->delalloc;
+    if(s->delalloc_on)
+        fprintf(f, "[stats] delalloc buffered=%llu flushed=%llu runs=%llu flushes=%llu\n",
+                (unsigned long long)das->buffered, (unsigned long long)das->flushed,
+                (unsigned long long)das->runs, (unsigned long long)das->flushes);
+
+    char p50[16], p99[16], lo[16], hi[16];
+    for(int i=0;i<MX_OP_NUM;i++){
+        const mx_op_stats_t* o=&s->op[i];
+        if(!o->calls) continue;
+        fmt_pow2(pct_bucket(o->hist, o->calls, 50), p50, sizeof p50);
+        fmt_pow2(pct_bucket(o->hist, o->calls, 99), p99, sizeof p99);
+        fprintf(f, "[stats] op %-11s calls=%llu fails=%llu avg=%.2f us p50<%s p99<%s max=%.1f us\n",
+                op_names[i], (unsigned long long)o->calls, (unsigned long long)o->fails,
+                o->total_ns/1000.0/o->calls, p50, p99, o->max_ns/1000.0);
+        if(!hist) continue;
+        for(uint32_t b=0;b<MX_HIST;b++){
+            if(!o->hist[b]) continue;
+            fmt_pow2(b, lo, sizeof lo); fmt_pow2(b+1, hi, sizeof hi);
+            fprintf(f, "[stats]    [%6s, %6s) %12llu %5.1f%%\n", b ? lo : "0", b==MX_HIST-1 ? "inf" : hi,
+                    (unsigned long long)o->hist[b], pct(o->hist[b], o->calls));
+        }
+    }
+    const alloc_stats_t* a=&s->alloc;
+    if(a->allocs){
+        fprintf(f, "[stats] alloc-scan allocs=%llu words=%llu avg=%.1f p99<%llu max=%llu\n",
+                (unsigned long long)a->allocs, (unsigned long long)a->words, (double)a->words/a->allocs,
+                1ull<<pct_bucket(a->hist, a->allocs, 99), (unsigned long long)a->max);
+        if(hist)
+            for(uint32_t b=0;b<MX_HIST;b++) if(a->hist[b])
+                fprintf(f, "[stats]    [%6llu, %6llu) words %12llu %5.1f%%\n", b ? 1ull<<b : 0ull, 1ull<<(b+1),
+                        (unsigned long long)a->hist[b], pct(a->hist[b], a->allocs));
+    }
+}
+
+int stats_dump(const char* path){
+    FILE* f=fopen(path, "a");
+    if(!f) return FS_ERR;
+    mx_stats_t* s=(mx_stats_t*)malloc(sizeof(mx_stats_t));
+    if(!s){ fclose(f); return FS_ERR; }
+    stats_collect(s);
+    char t[20]; human_time((uint32_t)time(NULL), t, sizeof t);
+    fprintf(f, "[stats] --- unmount %s ---\n", t);
+    mx_stats_print(f, s, 1);
+    free(s);
+    return fclose(f)==0 ? FS_OK : FS_ERR;
+}
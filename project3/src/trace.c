@@ -0,0 +1,131 @@
+// src/trace.c — 操作跟踪：-o trace=文件 时把 open/close/read/write/seek/dup/mkdir/unlink、
+// namei、块分配与设备 I/O 逐条记进环形缓冲（带起止时间、线程与参数），卸载或 mx_trace_dump
+// 时导出 Chrome trace JSON（chrome://tracing、Perfetto 可直接打开看时间线与火焰图）。
+// 写入无锁：原子加取一个槽位，环满后覆盖最旧的记录，导出时报告被覆盖的条数。
+// 导出每个事件占一行，"cat":"op" 的事件就是 tools/replay 重放用的操作日志。
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "fs.h"
+
+#define TRACE_DEFAULT (1u<<16)
+#define TRACE_MAX     (1u<<24)
+
+typedef struct {
+    uint64_t t0, dt;
+    int64_t  a, b;
+    uint32_t tid;
+    int32_t  res;
+    uint16_t ev;
+    char     name[86];              // 路径，超长截断
+} trace_rec_t;                      // 128 字节
+
+struct trace_state {
+    trace_rec_t* ring;
+    uint32_t mask;
+    uint64_t head;                  // 已写入的总条数
+    uint64_t start;                 // 开始记录的时刻，导出的 ts 以它为 0
+};
+#define g_tr (g_vol->trace)
+
+static uint32_t g_next_tid;
+static __thread uint32_t t_tid;
+
+// 各事件的名字、类别与 a/b 参数名（NULL 表示不导出）；有路径的事件另带 path
+static const struct { const char *name, *cat, *a, *b; } ev_info[TR_NUM]={
+    [TR_OPEN]     ={ "fs_open",     "op",  "w",    NULL  },
+    [TR_CLOSE]    ={ "fs_close",    "op",  "fd",   NULL  },
+    [TR_READ]     ={ "fs_read",     "op",  "fd",   "len" },
+    [TR_WRITE]    ={ "fs_write",    "op",  "fd",   "len" },
+    [TR_SEEK]     ={ "fs_seek",     "op",  "fd",   "off" },
+    [TR_DUP]      ={ "fs_dup",      "op",  "fd",   "flags" },
+    [TR_MKDIR]    ={ "mkdir",       "op",  NULL,   NULL  },
+    [TR_UNLINK]   ={ "unlink",      "op",  NULL,   NULL  },
+    [TR_NAMEI]    ={ "namei",       "fs",  NULL,   NULL  },
+    [TR_ALLOC]    ={ "alloc_block", "fs",  "goal", "want" },
+    [TR_DEV_READ] ={ "dev_read",    "dev", "blk",  "cnt" },
+    [TR_DEV_WRITE]={ "dev_write",   "dev", "blk",  "cnt" },
+    [TR_DEV_SYNC] ={ "dev_sync",    "dev", NULL,   NULL  },
+};
+
+int trace_start(uint32_t n){
+    trace_stop();
+    if(!n) n=TRACE_DEFAULT;
+    if(n>TRACE_MAX) n=TRACE_MAX;
+    uint32_t cap=1024; while(cap<n) cap<<=1;
+    struct trace_state* t=(struct trace_state*)calloc(1, sizeof(*t));
+    if(!t) return FS_ERR;
+    if(!(t->ring=(trace_rec_t*)malloc((size_t)cap*sizeof(trace_rec_t)))){ free(t); return FS_ERR; }
+    t->mask=cap-1;
+    t->start=now_ns();
+    g_tr=t;
+    return FS_OK;
+}
+
+void trace_stop(){
+    if(!g_tr) return;
+    free(g_tr->ring); free(g_tr);
+    g_tr=NULL;
+}
+
+void trace_ev(int ev, uint64_t t0, int64_t a, int64_t b, int res, const char* name){
+    struct trace_state* t=g_tr;
+    uint64_t end=now_ns();
+    if(!t_tid) t_tid=__atomic_add_fetch(&g_next_tid, 1, __ATOMIC_RELAXED);
+    trace_rec_t* r=&t->ring[__atomic_fetch_add(&t->head, 1, __ATOMIC_RELAXED) & t->mask];
+    r->t0=t0; r->dt=end-t0; r->a=a; r->b=b;
+    r->tid=t_tid; r->res=res; r->ev=(uint16_t)ev;
+    if(name){ strncpy(r->name, name, sizeof(r->name)-1); r->name[sizeof(r->name)-1]='\0'; }
+    else r->name[0]='\0';
+}
+
+static void put_str(FILE* f, const char* s){
+    fputc('"', f);
+    for(; *s; s++){
+        unsigned char c=(unsigned char)*s;
+        if(c=='"' || c=='\\') fprintf(f, "\\%c", c);
+        else if(c<0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static int by_start(const void* x, const void* y, void* ring){
+    const trace_rec_t *a=(const trace_rec_t*)ring+*(const uint32_t*)x, *b=(const trace_rec_t*)ring+*(const uint32_t*)y;
+    if(a->t0!=b->t0) return a->t0<b->t0 ? -1 : 1;
+    return a->dt>b->dt ? -1 : a->dt<b->dt;          // 同时开始的外层（更长的）在前
+}
+
+// 调用方独占卷，此时没有并发写入
+int trace_export(const char* path){
+    struct trace_state* t=g_tr;
+    if(!t) return FS_EINVAL;
+    uint64_t head=t->head, cap=(uint64_t)t->mask+1;
+    uint32_t n=(uint32_t)(head<cap ? head : cap);
+    uint32_t* idx=(uint32_t*)malloc((n ? n : 1)*sizeof(uint32_t));
+    if(!idx) return FS_ERR;
+    // 按写入顺序取出环里现存的记录，再按开始时间排序
+    for(uint32_t i=0;i<n;i++) idx[i]=(uint32_t)((head-n+i) & t->mask);
+    qsort_r(idx, n, sizeof(uint32_t), by_start, t->ring);
+
+    FILE* f=fopen(path, "w");
+    if(!f){ free(idx); return FS_ERR; }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"format\":\"mini_ext2 trace 1\",\"events\":%u,\"dropped\":%llu},\n",
+            n, (unsigned long long)(head-n));
+    fprintf(f, "\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"mini_ext2\"}}");
+    for(uint32_t i=0;i<n;i++){
+        const trace_rec_t* r=&t->ring[idx[i]];
+        if(r->ev>=TR_NUM) continue;
+        uint64_t ts = r->t0>t->start ? r->t0-t->start : 0;
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                ev_info[r->ev].name, ev_info[r->ev].cat, r->tid, ts/1000.0, r->dt/1000.0);
+        if(r->name[0]){ fputs("\"path\":", f); put_str(f, r->name); fputc(',', f); }
+        if(ev_info[r->ev].a) fprintf(f, "\"%s\":%lld,", ev_info[r->ev].a, (long long)r->a);
+        if(ev_info[r->ev].b) fprintf(f, "\"%s\":%lld,", ev_info[r->ev].b, (long long)r->b);
+        fprintf(f, "\"res\":%d}}", r->res);
+    }
+    fputs("\n]}\n", f);
+    free(idx);
+    return fclose(f)==0 ? FS_OK : FS_ERR;
+}
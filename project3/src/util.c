@@ -2,6 +2,11 @@
 #include <stdio.h>
 #include "fs.h"
 
+uint64_t now_ns(){
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 void ts_now(uint32_t* out){ if(out) *out = (uint32_t)time(NULL); }
 
 void human_time(uint32_t t, char* out, size_t n){
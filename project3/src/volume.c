@@ -0,0 +1,58 @@
+// src/volume.c — 卷上下文：一个镜像的全部状态打包在 volume_t 里，g_vol 指向当前卷
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include "fs.h"
+
+__thread volume_t* g_vol = NULL;
+
+static __thread int t_shared, t_deferred;
+
+// 未列出的字段为 0
+static const mount_opts_t mopt_default = {
+    .backend=DEV_STDIO, .commit_secs=5, .ra_kb=128, .delalloc=1, .aio=AIO_OFF, .qd=32,
+};
+
+volume_t* vol_create(){
+    volume_t* v=(volume_t*)calloc(1, sizeof(volume_t));
+    if(!v) return NULL;
+    v->mopt=mopt_default;
+    v->fd=-1; v->cwd=1; v->bmap_gen=1; v->fd_free=-1;
+    strcpy(v->user, "root");                // 初始 root
+    // 写者优先：持续的并发读不会把 sync/close 饿死
+    pthread_rwlockattr_t a; pthread_rwlockattr_init(&a);
+    pthread_rwlockattr_setkind_np(&a, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&v->lock, &a); pthread_rwlockattr_destroy(&a);
+    if(bcache_vol_init(v)!=FS_OK || journal_vol_init(v)!=FS_OK || bitmap_vol_init(v)!=FS_OK ||
+       icache_vol_init(v)!=FS_OK || dcache_vol_init(v)!=FS_OK || da_vol_init(v)!=FS_OK ||
+       aio_vol_init(v)!=FS_OK){
+        vol_destroy(v); return NULL;
+    }
+    return v;
+}
+
+// 仍挂载着的卷先卸载（写回并关闭设备），再释放各层状态
+int vol_destroy(volume_t* v){
+    if(!v) return FS_OK;
+    volume_t* save=g_vol;
+    g_vol=v;
+    int r=FS_OK;
+    if(v->bcache && v->journal && v->bitmap && v->icache && v->dcache && v->delalloc) r=fs_unmount();
+    aio_vol_free(v); da_vol_free(v); dcache_vol_free(v); icache_vol_free(v);
+    bitmap_vol_free(v); journal_vol_free(v); bcache_vol_free(v);
+    pthread_rwlock_destroy(&v->lock);
+    free(v->fdt);
+    g_vol = save==v ? NULL : save;
+    free(v);
+    return r;
+}
+
+void vol_lock(int excl){
+    if(excl) pthread_rwlock_wrlock(&g_vol->lock);
+    else pthread_rwlock_rdlock(&g_vol->lock);
+    t_shared = !excl; t_deferred = 0;
+}
+void vol_unlock(){ t_shared = 0; pthread_rwlock_unlock(&g_vol->lock); }
+int vol_shared(){ return t_shared; }
+int vol_defer(){ t_deferred = 1; return FS_EBUSY; }
+int vol_deferred(){ int d = t_deferred; t_deferred = 0; return d; }
@@ -0,0 +1,245 @@
+// tools/bench.c — 文件系统核心微基准
+//   bench [-o 结果.json] [-n 倍数] [挂载选项]
+// 每组用例在新格式化的 bench.img 上单线程运行，逐次计时，报告 ops/s、延迟 p50/p90/p99/max，
+// 以及平均每次操作经块接口读/写的块数（dev_read_block/dev_write_block 等，命中缓存也算）
+// 与宿主机读/写次数。-o 另写一份 JSON，两次运行的结果可直接 diff。-n 按倍数放大操作数。
+// 镜像结束后删除
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "miniext2.h"
+
+#define IMG      "bench.img"
+#define IMG_SIZE (512ull<<20)
+#define BSZ      4096
+#define DEPTH    32                 // namei 用例的目录深度
+#define BIG      (32u<<20)          // 顺序/随机读写用例的文件大小
+
+static mx_vol_t* V;
+static const char* g_opts;
+static int g_scale = 1;
+static FILE* g_json;
+static int g_ncase;
+
+static uint64_t ns(){ struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return (uint64_t)t.tv_sec*1000000000ull + (uint64_t)t.tv_nsec; }
+static uint32_t xs(uint32_t* s){ uint32_t x=*s; x^=x<<13; x^=x>>17; x^=x<<5; return *s=x; }
+static int cmp_u64(const void* a, const void* b){ uint64_t x=*(const uint64_t*)a, y=*(const uint64_t*)b; return x<y ? -1 : x>y; }
+
+static void die(const char* what, int r){ fprintf(stderr, "bench: %s failed (%d)\n", what, r); exit(1); }
+
+static void fresh(){
+    if(V) mx_unmount(V, NULL);
+    int r=mx_format(IMG, g_opts, BSZ, IMG_SIZE, 65536, 0, NULL);
+    if(r!=FS_OK) die("format", r);
+    if(!(V=mx_mount(IMG, g_opts, &r))) die("mount", r);
+}
+// 卸载再挂载：读用例从冷的块缓存开始
+static void remount(){
+    int r=mx_unmount(V, NULL);
+    if(r!=FS_OK) die("unmount", r);
+    if(!(V=mx_mount(IMG, g_opts, &r))) die("mount", r);
+}
+
+// ---- 一组用例的计时与统计 ----
+typedef struct {
+    const char* name;
+    uint64_t* lat; uint32_t n, cap;
+    uint64_t t0, bytes;
+    mx_stats_t s0;
+} run_t;
+
+static void begin(run_t* r, const char* name, uint32_t cap){
+    memset(r, 0, sizeof *r);
+    r->name=name; r->cap=cap;
+    r->lat=(uint64_t*)malloc(cap*sizeof(uint64_t));
+    mx_get_stats(V, &r->s0);
+    r->t0=ns();
+}
+#define OP(r, expr) do{ uint64_t t_=ns(); int e_=(expr); (r)->lat[(r)->n++]=ns()-t_; if(e_<0) die((r)->name, e_); }while(0)
+
+static void end(run_t* r){
+    uint64_t total=ns()-r->t0;
+    mx_stats_t s1; mx_get_stats(V, &s1);
+    qsort(r->lat, r->n, sizeof(uint64_t), cmp_u64);
+    uint32_t n = r->n ? r->n : 1;
+    #define PCT(p) (r->n ? r->lat[(uint32_t)((uint64_t)(r->n-1)*(p)/100)] : 0)
+    uint64_t sum=0; for(uint32_t i=0;i<r->n;i++) sum+=r->lat[i];
+    double ops = total ? r->n*1e9/total : 0;
+    double br=(double)(s1.dev.blk_reads -r->s0.dev.blk_reads )/n, bw=(double)(s1.dev.blk_writes-r->s0.dev.blk_writes)/n;
+    double hr=(double)(s1.dev.reads-r->s0.dev.reads)/n, hw=(double)(s1.dev.writes-r->s0.dev.writes)/n;
+    printf("%-16s %8u %11.0f %9.1f %9.1f %9.1f %10.1f %8.2f %8.2f %7.2f %7.2f\n",
+           r->name, r->n, ops, PCT(50)/1e3, PCT(90)/1e3, PCT(99)/1e3, r->n ? r->lat[r->n-1]/1e3 : 0.0, br, bw, hr, hw);
+    if(g_json){
+        fprintf(g_json, "%s\n    {\"name\": \"%s\", \"ops\": %u, \"secs\": %.6f, \"ops_per_sec\": %.1f, \"bytes\": %llu,\n"
+                "     \"lat_ns\": {\"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu},\n"
+                "     \"per_op\": {\"blk_reads\": %.3f, \"blk_writes\": %.3f, \"host_reads\": %.3f, \"host_writes\": %.3f}}",
+                g_ncase ? "," : "", r->name, r->n, total/1e9, ops, (unsigned long long)r->bytes,
+                (unsigned long long)(sum/n), (unsigned long long)PCT(50), (unsigned long long)PCT(90),
+                (unsigned long long)PCT(99), (unsigned long long)(r->n ? r->lat[r->n-1] : 0), br, bw, hr, hw);
+    }
+    #undef PCT
+    g_ncase++;
+    free(r->lat);
+}
+
+// ---- 用例 ----
+// 同一目录里连续创建（目录超过一块后走哈希索引）
+static void b_create(uint32_t n){
+    fresh();
+    mx_mkdir(V, "/c");
+    run_t r; begin(&r, "create", n);
+    char p[64];
+    for(uint32_t i=0;i<n;i++){
+        snprintf(p, sizeof p, "/c/f%06u", i);
+        uint64_t t=ns();
+        int fd=mx_open(V, p, "w");
+        if(fd<0) die("create", fd);
+        mx_close(V, fd);
+        r.lat[r.n++]=ns()-t;
+    }
+    end(&r);
+}
+
+// DEPTH 层目录下的文件反复 stat：每次都完整解析路径
+static void b_namei(uint32_t n){
+    fresh();
+    char p[DEPTH*4+16]="";
+    for(int d=0; d<DEPTH; d++){
+        size_t l=strlen(p);
+        snprintf(p+l, sizeof(p)-l, "/d%d", d % 10);
+        mx_mkdir(V, p);
+    }
+    strcat(p, "/leaf");
+    int fd=mx_open(V, p, "w"); if(fd<0) die("namei setup", fd); mx_close(V, fd);
+    mx_stat_t st;
+    run_t r; begin(&r, "namei_deep", n);
+    for(uint32_t i=0;i<n;i++) OP(&r, mx_stat(V, p, &st));
+    end(&r);
+    remount();
+    begin(&r, "namei_deep_cold", 1);
+    OP(&r, mx_stat(V, p, &st));
+    end(&r);
+}
+
+// 以 sz 为单位顺序写满 BIG 字节，重新挂载后顺序读回
+static void b_seq(uint32_t sz, uint8_t* buf){
+    char wn[32], rn[32];
+    snprintf(wn, sizeof wn, "seq_write_%uk", sz>>10); snprintf(rn, sizeof rn, "seq_read_%uk", sz>>10);
+    if(sz<1024){ snprintf(wn, sizeof wn, "seq_write_%u", sz); snprintf(rn, sizeof rn, "seq_read_%u", sz); }
+    uint32_t n=BIG/sz;
+    fresh();
+    run_t r; begin(&r, wn, n);
+    int fd=mx_open(V, "/seq", "w"); if(fd<0) die("open", fd);
+    for(uint32_t i=0;i<n;i++) OP(&r, mx_write(V, fd, buf, sz));
+    OP(&r, mx_close(V, fd)); r.n--;                 // 关闭（延迟分配落盘）计入总时间，不算一次操作
+    r.bytes=(uint64_t)n*sz;
+    end(&r);
+    remount();
+    begin(&r, rn, n);
+    fd=mx_open(V, "/seq", "r"); if(fd<0) die("open", fd);
+    for(uint32_t i=0;i<n;i++) OP(&r, mx_read(V, fd, buf, sz));
+    mx_close(V, fd);
+    r.bytes=(uint64_t)n*sz;
+    end(&r);
+}
+
+// BIG 字节的文件里按 sz 对齐随机定位后读/写
+static void b_rand(uint32_t sz, uint32_t n, uint8_t* buf){
+    char wn[32], rn[32];
+    snprintf(wn, sizeof wn, "rand_write_%uk", sz>>10); snprintf(rn, sizeof rn, "rand_read_%uk", sz>>10);
+    if(sz<1024){ snprintf(wn, sizeof wn, "rand_write_%u", sz); snprintf(rn, sizeof rn, "rand_read_%u", sz); }
+    fresh();
+    int fd=mx_open(V, "/rand", "w"); if(fd<0) die("open", fd);
+    for(uint32_t off=0; off<BIG; off+=1u<<20) if(mx_write(V, fd, buf, 1u<<20)<0) die("rand setup", -1);
+    mx_close(V, fd);
+    remount();
+    uint32_t seed=12345, slots=BIG/sz;
+    run_t r; begin(&r, rn, n);
+    fd=mx_open(V, "/rand", "r"); if(fd<0) die("open", fd);
+    for(uint32_t i=0;i<n;i++){
+        uint64_t t=ns();
+        mx_seek(V, fd, (int32_t)((xs(&seed)%slots)*sz));
+        int e=mx_read(V, fd, buf, sz);
+        r.lat[r.n++]=ns()-t;
+        if(e!=(int)sz) die(rn, e);
+    }
+    mx_close(V, fd);
+    r.bytes=(uint64_t)n*sz;
+    end(&r);
+    begin(&r, wn, n);
+    fd=mx_open(V, "/rand", "w"); if(fd<0) die("open", fd);
+    for(uint32_t i=0;i<n;i++){
+        uint64_t t=ns();
+        mx_seek(V, fd, (int32_t)((xs(&seed)%slots)*sz));
+        int e=mx_write(V, fd, buf, sz);
+        r.lat[r.n++]=ns()-t;
+        if(e!=(int)sz) die(wn, e);
+    }
+    OP(&r, mx_close(V, fd)); r.n--;
+    r.bytes=(uint64_t)n*sz;
+    end(&r);
+}
+
+// 建文件、写 16KB、关闭、删除（删除时截断释放全部块）
+static void b_churn(uint32_t n, uint8_t* buf){
+    fresh();
+    mx_mkdir(V, "/t");
+    run_t r; begin(&r, "churn", n);
+    char p[64];
+    for(uint32_t i=0;i<n;i++){
+        snprintf(p, sizeof p, "/t/x%u", i%64);
+        uint64_t t=ns();
+        int fd=mx_open(V, p, "w");
+        if(fd<0) die("churn open", fd);
+        int e=mx_write(V, fd, buf, 16384);
+        mx_close(V, fd);
+        if(e<0 || (e=mx_unlink(V, p))!=FS_OK) die("churn", e);
+        r.lat[r.n++]=ns()-t;
+    }
+    end(&r);
+}
+
+static void b_login(uint32_t n){
+    fresh();
+    run_t r; begin(&r, "login", n);
+    for(uint32_t i=0;i<n;i++) OP(&r, mx_login(V, "root", "root"));
+    end(&r);
+}
+
+int main(int argc, char** argv){
+    const char* json=NULL;
+    int i=1;
+    for(; i<argc && argv[i][0]=='-'; i++){
+        if(strcmp(argv[i],"-o")==0 && i+1<argc) json=argv[++i];
+        else if(strcmp(argv[i],"-n")==0 && i+1<argc) g_scale=atoi(argv[++i]);
+        else{ fprintf(stderr, "usage: %s [-o out.json] [-n scale] [mount opts]\n", argv[0]); return 2; }
+    }
+    if(g_scale<1) g_scale=1;
+    g_opts = i<argc ? argv[i] : "dev=pread";
+    if(json && !(g_json=fopen(json, "w"))){ fprintf(stderr, "bench: cannot write %s\n", json); return 1; }
+    if(g_json) fprintf(g_json, "{\"opts\": \"%s\", \"block_size\": %u, \"scale\": %d, \"cases\": [", g_opts, BSZ, g_scale);
+
+    uint8_t* buf=(uint8_t*)aligned_alloc(4096, 1u<<20);
+    for(uint32_t k=0;k<(1u<<20);k++) buf[k]=(uint8_t)(k*7+3);
+    uint32_t s=(uint32_t)g_scale;
+
+    printf("opts=%s block=%u\n", g_opts, BSZ);
+    printf("%-16s %8s %11s %9s %9s %9s %10s %8s %8s %7s %7s\n",
+           "case", "ops", "ops/s", "p50(us)", "p90(us)", "p99(us)", "max(us)", "blk-rd", "blk-wr", "host-rd", "host-wr");
+    b_create(10000*s);
+    b_namei(20000*s);
+    static const uint32_t seq_sz[]={ 512, 4096, 65536, 1u<<20 };
+    for(int k=0;k<4;k++) b_seq(seq_sz[k], buf);
+    static const uint32_t rnd_sz[]={ 512, 4096, 65536 };
+    for(int k=0;k<3;k++) b_rand(rnd_sz[k], 4000*s, buf);
+    b_churn(2000*s, buf);
+    b_login(2000*s);
+
+    mx_unmount(V, NULL);
+    unlink(IMG);
+    free(buf);
+    if(g_json){ fprintf(g_json, "\n]}\n"); fclose(g_json); printf("json: %s\n", json); }
+    return 0;
+}
@@ -0,0 +1,291 @@
+// tools/replay.c — 重放 -o trace= 录下的操作
+//   replay [-i 镜像] [-b 块大小] [-s MB（缺省 256）] [-v] <trace.json> [挂载选项]
+// 读出跟踪里 "cat":"op" 的事件（fs_open/close/read/write/seek/dup、mkdir、unlink），在新格式化的
+// 镜像上按开始时间顺序、单线程、不停顿地重放；fd 按录制时的返回值映射。写入的数据是固定图案，
+// 不是原数据。跟踪开始前就存在的文件和目录（只读打开成功、删除成功、父目录从没建过）重放前先
+// 建好，只读打开的文件按录制时读到的最远位置填充。
+// 报告每类操作的次数与耗时、与录制时结果不一致的次数，以及整卷统计，方便对比不同的构建。
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <search.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "miniext2.h"
+
+enum { R_OPEN, R_CLOSE, R_READ, R_WRITE, R_SEEK, R_DUP, R_MKDIR, R_UNLINK, R_NUM };
+static const char* names[R_NUM]={ "fs_open", "fs_close", "fs_read", "fs_write", "fs_seek", "fs_dup", "mkdir", "unlink" };
+
+typedef struct {
+    int kind;
+    int fd, arg, res;               // arg：w / len / off / flags
+    char* path;
+    double dur_us;                  // 录制时的耗时
+} op_t;
+
+static op_t* ops; static uint32_t nops, cap_ops;
+static int g_verbose;
+
+static uint64_t ns(){ struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return (uint64_t)t.tv_sec*1000000000ull + (uint64_t)t.tv_nsec; }
+static void die(const char* what, int r){ fprintf(stderr, "replay: %s failed (%d)\n", what, r); exit(1); }
+
+// ---- 读跟踪：导出时每个事件一行，只需认出自己写的格式 ----
+static const char* after(const char* s, const char* key){ const char* p=strstr(s, key); return p ? p+strlen(key) : NULL; }
+static int get_int(const char* s, const char* key, int* out){
+    const char* p=after(s, key);
+    if(!p) return 0;
+    *out=(int)strtol(p, NULL, 10);
+    return 1;
+}
+// 解 JSON 字符串（put_str 只会写 \" \\ \u00XX 三种转义），返回结尾引号之后
+static const char* get_str(const char* p, char* out, size_t n){
+    size_t k=0;
+    for(; *p && *p!='"'; p++){
+        char c=*p;
+        if(c=='\\' && p[1]=='u'){ c=(char)strtol((char[]){ p[4], p[5], 0 }, NULL, 16); p+=5; }
+        else if(c=='\\' && p[1]){ c=*++p; }
+        if(k+1<n) out[k++]=c;
+    }
+    out[k]='\0';
+    return *p ? p+1 : p;
+}
+
+static int load(const char* path){
+    FILE* f=fopen(path, "r");
+    if(!f) return -1;
+    char* line=NULL; size_t lcap=0; ssize_t n;
+    while((n=getline(&line, &lcap, f))>0){
+        int dropped;
+        if(get_int(line, "\"dropped\":", &dropped) && dropped>0)
+            fprintf(stderr, "replay: %d oldest events were overwritten in the trace ring (raise tracebuf=)\n", dropped);
+        if(!strstr(line, "\"cat\":\"op\"")) continue;
+        const char* nm=after(line, "{\"name\":\"");
+        int kind=0;
+        while(kind<R_NUM && !(nm && strncmp(nm, names[kind], strlen(names[kind]))==0 && nm[strlen(names[kind])]=='"')) kind++;
+        if(kind==R_NUM) continue;
+        if(nops==cap_ops){
+            cap_ops = cap_ops ? cap_ops*2 : 4096;
+            if(!(ops=(op_t*)realloc(ops, cap_ops*sizeof(op_t)))) die("realloc", -1);
+        }
+        op_t* o=&ops[nops];
+        memset(o, 0, sizeof *o);
+        o->kind=kind;
+        const char* dur=after(line, "\"dur\":");
+        o->dur_us = dur ? strtod(dur, NULL) : 0;
+        const char* a=after(line, "\"args\":{");
+        if(!a) continue;
+        const char* p=after(a, "\"path\":\"");
+        if(p){
+            char buf[4096];
+            a=get_str(p, buf, sizeof buf);
+            o->path=strdup(buf);
+        }
+        get_int(a, "\"fd\":", &o->fd);
+        get_int(a, "\"res\":", &o->res);
+        if(!get_int(a, "\"len\":", &o->arg) && !get_int(a, "\"off\":", &o->arg) &&
+           !get_int(a, "\"flags\":", &o->arg)) get_int(a, "\"w\":", &o->arg);
+        nops++;
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+// ---- 跟踪开始前就有的文件/目录：在内存里走一遍名字空间，找出需要预先建好的 ----
+// 路径 → 名字空间状态（hsearch 表，条目只增不删）
+typedef struct { char* path; int state; int seed; } ent_t;    // state：1 文件 2 目录 3 已删除；seed 为预建序号
+typedef struct { ent_t* e; uint32_t sz; int file; } seed_t;  // 预建按登记顺序，父目录在前
+static seed_t* seeds; static uint32_t nseeds;
+
+static ent_t* ent(const char* path){
+    ENTRY q={ (char*)path, NULL }, *f=hsearch(q, FIND);
+    if(f) return (ent_t*)f->data;
+    ent_t* e=(ent_t*)calloc(1, sizeof(ent_t));
+    e->path=strdup(path); e->seed=-1;
+    q.key=e->path; q.data=e;
+    if(!hsearch(q, ENTER)) die("hsearch", -1);
+    return e;
+}
+static seed_t* seed(ent_t* e, int file){
+    if(e->seed>=0) return &seeds[e->seed];
+    seeds=(seed_t*)realloc(seeds, (nseeds+1)*sizeof(seed_t));
+    seeds[nseeds]=(seed_t){ e, 0, file };
+    e->seed=(int)nseeds;
+    return &seeds[nseeds++];
+}
+// 父目录没在跟踪里建过就当作原先存在
+static void need_parents(const char* path){
+    char buf[4096]; snprintf(buf, sizeof buf, "%s", path);
+    char* s=strrchr(buf, '/');
+    if(!s || s==buf) return;
+    *s='\0';
+    ent_t* e=ent(buf);
+    if(e->state) return;
+    need_parents(buf);
+    e->state=2; seed(e, 0);
+}
+static void plan(){
+    // 录制时的 fd → 打开描述（dup 共用），描述记路径与位置
+    typedef struct { ent_t* e; uint32_t pos; int seeded; } desc_t;
+    desc_t* d=(desc_t*)calloc(nops+1, sizeof(desc_t)); uint32_t nd=0;
+    int* fdd=NULL; uint32_t nfd=0;
+    #define FDD(fd) ((fd)>=0 && (uint32_t)(fd)<nfd ? fdd[fd] : -1)
+    #define FDSET(fd, v) do{ if((uint32_t)(fd)>=nfd){ uint32_t n_=nfd?nfd:64; while(n_<=(uint32_t)(fd)) n_*=2; \
+        fdd=(int*)realloc(fdd, n_*sizeof(int)); for(uint32_t i_=nfd;i_<n_;i_++) fdd[i_]=-1; nfd=n_; } fdd[fd]=(v); }while(0)
+    for(uint32_t i=0;i<nops;i++){
+        op_t* o=&ops[i];
+        int k;
+        switch(o->kind){
+        case R_OPEN:
+            if(o->res<0) break;
+            if(o->path[0]=='/') need_parents(o->path);
+            ent_t* e=ent(o->path);
+            d[nd]=(desc_t){ e, 0, 0 };
+            if(e->state!=1 && !o->arg){ d[nd].seeded=1; seed(e, 1); }   // 只读打开成功：原先就有
+            e->state=1;
+            FDSET(o->res, (int)nd); nd++;
+            break;
+        case R_DUP:  if(o->res>=0 && FDD(o->fd)>=0) FDSET(o->res, FDD(o->fd)); break;
+        case R_CLOSE: if(FDD(o->fd)>=0) fdd[o->fd]=-1; break;
+        case R_SEEK: if((k=FDD(o->fd))>=0) d[k].pos = o->arg<0 ? 0 : (uint32_t)o->arg; break;
+        case R_READ: case R_WRITE:
+            if((k=FDD(o->fd))<0 || o->res<=0) break;
+            d[k].pos+=(uint32_t)o->res;
+            if(o->kind==R_READ && d[k].seeded){
+                seed_t* s=seed(d[k].e, 1);
+                if(d[k].pos>s->sz) s->sz=d[k].pos;
+            }
+            break;
+        case R_MKDIR:
+            if(o->res<0) break;
+            if(o->path[0]=='/') need_parents(o->path);
+            ent(o->path)->state=2;
+            break;
+        case R_UNLINK:
+            if(o->res<0) break;
+            if(o->path[0]=='/') need_parents(o->path);
+            ent_t* u=ent(o->path);
+            if(!u->state) seed(u, 1);
+            u->state=3;
+            break;
+        }
+    }
+    free(d); free(fdd);
+}
+
+static void make_seeds(mx_vol_t* v, uint8_t* buf, uint32_t bcap){
+    uint32_t files=0; uint64_t bytes=0;
+    for(uint32_t i=0;i<nseeds;i++){
+        seed_t* s=&seeds[i];
+        if(!s->file){ mx_mkdir(v, s->e->path); continue; }         // 父目录排在子项前面
+        int fd=mx_open(v, s->e->path, "w");
+        if(fd<0){ fprintf(stderr, "replay: cannot seed %s (%d)\n", s->e->path, fd); continue; }
+        for(uint32_t done=0; done<s->sz; ){
+            uint32_t n = s->sz-done<bcap ? s->sz-done : bcap;
+            int r=mx_write(v, fd, buf, n);
+            if(r<=0){ fprintf(stderr, "replay: cannot seed %s (%d)\n", s->e->path, r); break; }
+            done+=(uint32_t)r;
+        }
+        mx_close(v, fd);
+        files++; bytes+=s->sz;
+    }
+    if(nseeds) printf("seeded %u dirs, %u files (%.1f MB) that existed before the trace\n",
+                      nseeds-files, files, bytes/1048576.0);
+}
+
+int main(int argc, char** argv){
+    const char* img="replay.img";
+    uint32_t bsz=0; uint64_t size=256ull<<20;      // 块大小缺省同 format
+    int i=1;
+    for(; i<argc && argv[i][0]=='-'; i++){
+        if(strcmp(argv[i],"-i")==0 && i+1<argc) img=argv[++i];
+        else if(strcmp(argv[i],"-b")==0 && i+1<argc) bsz=(uint32_t)atoi(argv[++i]);
+        else if(strcmp(argv[i],"-s")==0 && i+1<argc) size=(uint64_t)atoll(argv[++i])<<20;
+        else if(strcmp(argv[i],"-v")==0) g_verbose=1;
+        else break;
+    }
+    if(i>=argc){ fprintf(stderr, "usage: %s [-i img] [-b block_size] [-s MB] [-v] <trace.json> [mount opts]\n", argv[0]); return 2; }
+    const char* trace=argv[i++];
+    const char* opts = i<argc ? argv[i] : "dev=pread";
+    if(load(trace)){ fprintf(stderr, "replay: cannot read %s\n", trace); return 1; }
+    if(!hcreate((size_t)nops*2+1024)) die("hcreate", -1);
+    plan();
+
+    uint32_t bcap=1u<<20;
+    for(uint32_t k=0;k<nops;k++) if((ops[k].kind==R_READ || ops[k].kind==R_WRITE) && (uint32_t)ops[k].arg>bcap) bcap=(uint32_t)ops[k].arg;
+    uint8_t* buf=(uint8_t*)aligned_alloc(4096, (bcap+4095)&~4095u);
+    if(!buf) die("alloc", -1);
+    for(uint32_t k=0;k<bcap;k++) buf[k]=(uint8_t)(k*7+3);
+
+    int r=mx_format(img, opts, bsz, size, 0, 0, NULL);
+    if(r!=FS_OK) die("format", r);
+    mx_vol_t* v=mx_mount(img, opts, &r);
+    if(!v) die("mount", r);
+    make_seeds(v, buf, bcap);
+    // 预置的内容落盘、缓存清空，重放从冷缓存开始
+    if((r=mx_unmount(v, NULL))!=FS_OK) die("unmount", r);
+    if(!(v=mx_mount(img, opts, &r))) die("mount", r);
+
+    int* fdm=(int*)malloc(sizeof(int)*65536); uint32_t nfdm=65536;     // 录制时的 fd → 重放得到的 fd
+    for(uint32_t k=0;k<nfdm;k++) fdm[k]=-1;
+    #define MAPPED(fd) ((fd)>=0 && (uint32_t)(fd)<nfdm ? fdm[fd] : -1)
+    uint64_t cnt[R_NUM]={0}, tns[R_NUM]={0}, bad[R_NUM]={0};
+    double rec_us[R_NUM]={0};
+    mx_stats_t s0; mx_get_stats(v, &s0);
+    uint64_t t_all=ns();
+    for(uint32_t k=0;k<nops;k++){
+        op_t* o=&ops[k];
+        int fd=MAPPED(o->fd), len=o->arg;
+        if(o->kind==R_WRITE){
+            if(o->res==FS_EBUSY) continue;           // 共享模式停下、随后独占重做的那一半
+            if(o->res>=0) len=o->res;                // 只写了一部分的，剩下的是下一条
+        }
+        uint64_t t0=ns();
+        switch(o->kind){
+        case R_OPEN:   r=mx_open(v, o->path, o->arg ? "w" : "r"); break;
+        case R_CLOSE:  r = fd<0 ? FS_EBADF : mx_close(v, fd); break;
+        case R_READ:   r = fd<0 ? FS_EBADF : mx_read(v, fd, buf, (uint32_t)len); break;
+        case R_WRITE:  r = fd<0 ? FS_EBADF : mx_write(v, fd, buf, (uint32_t)len); break;
+        case R_SEEK:   r = fd<0 ? FS_EBADF : mx_seek(v, fd, o->arg); break;
+        case R_DUP:    r = fd<0 ? FS_EBADF : mx_dup(v, fd, o->arg); break;
+        case R_MKDIR:  r=mx_mkdir(v, o->path); break;
+        case R_UNLINK: r=mx_unlink(v, o->path); break;
+        }
+        tns[o->kind]+=ns()-t0; cnt[o->kind]++; rec_us[o->kind]+=o->dur_us;
+        if(o->kind==R_CLOSE && fd>=0) fdm[o->fd]=-1;
+        if((o->kind==R_OPEN || o->kind==R_DUP) && r>=0){
+            if(o->res>=0 && (uint32_t)o->res<nfdm) fdm[o->res]=r;
+            else mx_close(v, r);
+        }
+        // 失败要错误码相同；成功时 fd 号不必相同，写比的是本条实际要写的长度
+        int same = (r<0 || o->res<0) ? r==o->res : (o->kind==R_OPEN || o->kind==R_DUP) ? 1 : o->kind==R_WRITE ? r==len : r==o->res;
+        if(!same){
+            bad[o->kind]++;
+            if(g_verbose) fprintf(stderr, "replay: #%u %s %s fd=%d arg=%d: recorded %d, got %d\n",
+                                  k, names[o->kind], o->path ? o->path : "", o->fd, o->arg, o->res, r);
+        }
+    }
+    uint64_t total=ns()-t_all;
+    mx_stats_t s1; mx_get_stats(v, &s1);
+
+    uint64_t n=0, nbad=0; double rec_total=0;
+    for(int k=0;k<R_NUM;k++){ n+=cnt[k]; nbad+=bad[k]; rec_total+=rec_us[k]; }
+    printf("trace=%s opts=%s ops=%llu\n", trace, opts, (unsigned long long)n);
+    printf("%-10s %9s %12s %12s %12s %9s\n", "op", "count", "replay(us)", "avg(us)", "recorded(us)", "mismatch");
+    for(int k=0;k<R_NUM;k++){
+        if(!cnt[k]) continue;
+        printf("%-10s %9llu %12.1f %12.2f %12.1f %9llu\n", names[k], (unsigned long long)cnt[k],
+               tns[k]/1e3, tns[k]/1e3/cnt[k], rec_us[k], (unsigned long long)bad[k]);
+    }
+    printf("total: %.3f ms, %.0f ops/s (recorded: %.3f ms), %llu mismatches, host reads=%llu writes=%llu\n",
+           total/1e6, total ? n*1e9/total : 0.0, rec_total/1e3, (unsigned long long)nbad,
+           (unsigned long long)(s1.dev.reads-s0.dev.reads), (unsigned long long)(s1.dev.writes-s0.dev.writes));
+    if(g_verbose) mx_stats_print(stdout, &s1, 0);
+
+    mx_unmount(v, NULL);
+    unlink(img);
+    for(uint32_t k=0;k<nops;k++) free(ops[k].path);
+    free(ops); free(fdm); free(buf);
+    return 0;
+}
@@ -0,0 +1,440 @@
+// tools/stress.c — libminiext2 多线程压力测试与扩展性测量
+//   stress check [线程数] [每线程操作数] [挂载选项]   并发读写 + 名字空间操作，逐字节校验，
+//                                                     重新挂载后再校验，删光后核对空闲计数
+//   stress scale [最大线程数] [挂载选项]              1..N 线程：同一文件读 / 各读各文件 / 各写各文件
+//   stress fds [文件数] [挂载选项]                    同时打开大量文件并 dup，打开期间删除，
+//                                                     全部关闭后核对空闲计数
+//   stress frag [每文件块数] [挂载选项]               512B 块：两个文件交替追加、一个文件乱序填块，
+//                                                     extent 远超一个叶块，校验、重挂载、删除后核对
+// 镜像为当前目录下的 stress.img，结束后删除
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "miniext2.h"
+
+#define IMG       "stress.img"
+#define MAXT      64
+#define FILE_CAP  (1u<<20)          // check：每个写线程的文件上限
+#define SHARED_SZ (256u<<10)
+
+static mx_vol_t* V;
+static int g_fail;
+static pthread_mutex_t g_print = PTHREAD_MUTEX_INITIALIZER;
+
+#define FAIL(...) do{ pthread_mutex_lock(&g_print); if(g_fail++ < 20){ printf("FAIL: " __VA_ARGS__); putchar('\n'); } pthread_mutex_unlock(&g_print); }while(0)
+
+static uint32_t xs(uint32_t* s){ uint32_t x=*s; x^=x<<13; x^=x>>17; x^=x<<5; return *s=x; }
+static uint8_t pat(uint32_t off){ return (uint8_t)((off*2654435761u)>>13); }   // 共享文件内容
+static double now_s(){ struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return t.tv_sec + t.tv_nsec/1e9; }
+
+// 写满 n 字节（短写时接着写）
+static int write_all(int fd, const uint8_t* p, uint32_t n){
+    uint32_t done=0;
+    while(done<n){
+        int w=mx_write(V, fd, p+done, n-done);
+        if(w<=0) return w<0 ? w : -1;
+        done+=(uint32_t)w;
+    }
+    return 0;
+}
+static int read_all(int fd, uint8_t* p, uint32_t n){
+    uint32_t done=0;
+    while(done<n){
+        int r=mx_read(V, fd, p+done, n-done);
+        if(r<0) return r;
+        if(r==0) break;
+        done+=(uint32_t)r;
+    }
+    return (int)done;
+}
+
+// ===== check =====
+typedef struct { int id, iters; uint8_t* shadow; uint32_t size; } wctx_t;
+
+static int verify_file(const char* path, const uint8_t* want, uint32_t size){
+    int fd=mx_open(V, path, "r");
+    if(fd<0){ FAIL("%s: open %d", path, fd); return -1; }
+    uint8_t* got=malloc(size+1);
+    int n=read_all(fd, got, size+1);
+    mx_close(V, fd);
+    int bad = n!=(int)size || memcmp(got, want, size)!=0;
+    if(bad){
+        uint32_t i=0; while(n>0 && i<(uint32_t)n && i<size && got[i]==want[i]) i++;
+        FAIL("%s: read %d of %u bytes, first difference at %u", path, n, size, i);
+    }
+    free(got);
+    return bad ? -1 : 0;
+}
+
+static void* writer(void* arg){
+    wctx_t* c=arg;
+    char path[32]; snprintf(path, sizeof(path), "/w%d", c->id);
+    uint32_t seed=0x9e3779b9u*(uint32_t)(c->id+1), pos=0;
+    uint8_t* buf=malloc(65536);
+    int fd=mx_open(V, path, "w");
+    if(fd<0){ FAIL("%s: open %d", path, fd); return NULL; }
+    for(int it=0; it<c->iters && !g_fail; it++){
+        uint32_t r=xs(&seed)%100;
+        if(r<60){
+            // 一半整块对齐（走直写/延迟分配整块路径），一半任意长度
+            uint32_t len = r<30 ? 4096u*(1+xs(&seed)%16) : 1+xs(&seed)%9000;
+            if(pos+len > FILE_CAP){ pos=0; mx_seek(V, fd, 0); }
+            for(uint32_t i=0;i<len;i++) buf[i]=(uint8_t)xs(&seed);
+            int w=write_all(fd, buf, len);
+            if(w){ FAIL("%s: write %d", path, w); break; }
+            memcpy(c->shadow+pos, buf, len);
+            pos+=len; if(pos>c->size) c->size=pos;
+        }else if(r<75){
+            pos = c->size ? xs(&seed)%c->size : 0;
+            mx_seek(V, fd, (int32_t)pos);
+        }else if(r<85){
+            mx_seek(V, fd, 0);
+            uint8_t* got=malloc(c->size+1);
+            int n=read_all(fd, got, c->size+1);
+            if(n!=(int)c->size || memcmp(got, c->shadow, c->size)) FAIL("%s: readback %d of %u at iter %d", path, n, c->size, it);
+            free(got);
+            mx_seek(V, fd, (int32_t)pos);
+        }else if(r<92){
+            mx_close(V, fd);                // close/open 要独占卷，与别人的读写交错
+            if((fd=mx_open(V, path, "w"))<0){ FAIL("%s: reopen %d", path, fd); break; }
+            pos=0;
+        }else{
+            mx_stat_t st;
+            int e=mx_stat(V, path, &st);
+            if(e || st.size!=c->size) FAIL("%s: stat %d size %u want %u", path, e, st.size, c->size);
+        }
+    }
+    if(fd>=0) mx_close(V, fd);
+    free(buf);
+    return NULL;
+}
+
+static void* reader(void* arg){
+    int id=*(int*)arg, fd=mx_open(V, "/shared", "r");
+    if(fd<0){ FAIL("reader %d: open %d", id, fd); return NULL; }
+    uint32_t seed=0x85ebca6bu*(uint32_t)(id+1);
+    uint8_t* buf=malloc(65536);
+    for(int it=0; it<2000 && !g_fail; it++){
+        uint32_t off=xs(&seed)%SHARED_SZ, len=1+xs(&seed)%65536;
+        if(off+len>SHARED_SZ) len=SHARED_SZ-off;
+        mx_seek(V, fd, (int32_t)off);
+        int n=read_all(fd, buf, len);
+        if(n!=(int)len){ FAIL("reader %d: read %d of %u", id, n, len); break; }
+        for(uint32_t i=0;i<len;i++) if(buf[i]!=pat(off+i)){ FAIL("reader %d: byte %u", id, off+i); break; }
+    }
+    mx_close(V, fd);
+    free(buf);
+    return NULL;
+}
+
+// 名字空间与其它独占操作，与共享模式的读写交错。删除的目录项不收回，根目录保持在
+// 一个块内，最后的空闲计数才能与初始值逐块比较，所以建/删只做少量几轮
+static int count_ent(void* arg, const char* name, int is_dir, const mx_stat_t* st){
+    (void)name; (void)is_dir; (void)st; ++*(int*)arg; return 0;
+}
+static void* nsop(void* arg){
+    (void)arg;
+    char d[32], f[32];
+    for(int it=0; it<2000 && !g_fail; it++){
+        mx_stat_t st; int n=0;
+        if(it%100==0){
+            snprintf(d, sizeof(d), "/ns%d", it); snprintf(f, sizeof(f), "/ns%d.f", it);
+            if(mx_mkdir(V, d)){ FAIL("mkdir %s", d); break; }
+            int fd=mx_open(V, f, "w");
+            if(fd<0 || write_all(fd, (const uint8_t*)f, (uint32_t)strlen(f))){ FAIL("create %s", f); break; }
+            mx_close(V, fd);
+            if(mx_stat(V, f, &st) || st.size!=strlen(f)) FAIL("stat %s", f);
+            if(mx_unlink(V, f) || mx_unlink(V, d)) FAIL("unlink %s / %s", f, d);
+        }
+        switch(it%4){
+        case 0: if(mx_readdir(V, "/", count_ent, &n) || n<3) FAIL("readdir / -> %d entries", n); break;
+        case 1: if(mx_stat(V, "/shared", &st) || st.size!=SHARED_SZ) FAIL("stat /shared"); break;
+        case 2: if(mx_chmod(V, "/shared", it%8==2 ? 0644 : 0664)) FAIL("chmod /shared"); break;
+        case 3: if(it%40==3) mx_sync(V); break;
+        }
+    }
+    return NULL;
+}
+
+static int check(int nt, int iters, const char* opts){
+    int e=mx_format(IMG, opts, 4096, 64u<<20, 0, 0, NULL);
+    if(e){ printf("format failed: %d\n", e); return 1; }
+    if(!(V=mx_mount(IMG, opts, &e))){ printf("mount failed: %d\n", e); return 1; }
+    mx_info_t base; mx_info(V, &base);
+
+    uint8_t* sh=malloc(SHARED_SZ);
+    for(uint32_t i=0;i<SHARED_SZ;i++) sh[i]=pat(i);
+    int fd=mx_open(V, "/shared", "w");
+    if(fd<0 || write_all(fd, sh, SHARED_SZ)){ printf("create /shared failed\n"); return 1; }
+    mx_close(V, fd);
+
+    pthread_t th[2*MAXT+1]; wctx_t wc[MAXT]; int rid[MAXT];
+    double t0=now_s();
+    for(int i=0;i<nt;i++){
+        wc[i]=(wctx_t){ i, iters, calloc(1, FILE_CAP), 0 };
+        rid[i]=i;
+        pthread_create(&th[i], NULL, writer, &wc[i]);
+        pthread_create(&th[nt+i], NULL, reader, &rid[i]);
+    }
+    pthread_create(&th[2*nt], NULL, nsop, NULL);
+    for(int i=0;i<2*nt+1;i++) pthread_join(th[i], NULL);
+    printf("concurrent phase: %d writers + %d readers + 1 namespace thread, %.2fs\n", nt, nt, now_s()-t0);
+
+    // 校验 → 卸载 → 重新挂载（计数按位图重算）→ 再校验
+    char path[32];
+    for(int i=0;i<nt;i++){ snprintf(path, sizeof(path), "/w%d", i); verify_file(path, wc[i].shadow, wc[i].size); }
+    verify_file("/shared", sh, SHARED_SZ);
+    mx_sync(V);                         // 释放推迟到提交的块，计数才与位图一致
+    mx_info_t before; mx_info(V, &before);
+    if((e=mx_unmount(V, NULL))) FAIL("unmount %d", e);
+    if(!(V=mx_mount(IMG, opts, &e))){ printf("remount failed: %d\n", e); return 1; }
+    mx_info_t after; mx_info(V, &after);
+    if(before.free_blocks!=after.free_blocks || before.free_inodes!=after.free_inodes)
+        FAIL("free counters drifted: %u/%u before unmount, %u/%u recounted", before.free_blocks, before.free_inodes, after.free_blocks, after.free_inodes);
+    for(int i=0;i<nt;i++){ snprintf(path, sizeof(path), "/w%d", i); verify_file(path, wc[i].shadow, wc[i].size); }
+    verify_file("/shared", sh, SHARED_SZ);
+
+    // 删光后空闲块/inode 应回到初始值（没有泄漏，也没有重复释放）
+    for(int i=0;i<nt;i++){ snprintf(path, sizeof(path), "/w%d", i); if(mx_unlink(V, path)) FAIL("unlink %s", path); free(wc[i].shadow); }
+    mx_unlink(V, "/shared");
+    mx_sync(V);
+    mx_info(V, &after);
+    if(after.free_blocks!=base.free_blocks || after.free_inodes!=base.free_inodes)
+        FAIL("after deleting everything: free %u/%u, expected %u/%u", after.free_blocks, after.free_inodes, base.free_blocks, base.free_inodes);
+    mx_unmount(V, NULL);
+    free(sh);
+    unlink(IMG);
+    printf(g_fail ? "check: %d failure(s)\n" : "check: ok\n", g_fail);
+    return g_fail ? 1 : 0;
+}
+
+// ===== scale =====
+#define SCALE_FILE (8u<<20)
+#define CHUNK      (64u<<10)
+typedef struct { int id, mode; uint64_t bytes; } sctx_t;
+static pthread_barrier_t g_bar;
+
+static void* scale_worker(void* arg){
+    sctx_t* c=arg;
+    uint8_t* buf=malloc(CHUNK);
+    char path[32];
+    if(c->mode==2) snprintf(path, sizeof(path), "/new%d", c->id);
+    else snprintf(path, sizeof(path), "/r%d", c->mode==0 ? 0 : c->id);
+    memset(buf, c->id, CHUNK);
+    int fd=mx_open(V, path, c->mode==2 ? "w" : "r");
+    pthread_barrier_wait(&g_bar);
+    if(fd<0){ FAIL("%s: open %d", path, fd); free(buf); return NULL; }
+    for(int pass=0; pass<(c->mode==2 ? 1 : 4); pass++){
+        mx_seek(V, fd, 0);
+        for(uint32_t off=0; off<SCALE_FILE; off+=CHUNK){
+            int n = c->mode==2 ? (write_all(fd, buf, CHUNK) ? -1 : (int)CHUNK) : mx_read(V, fd, buf, CHUNK);
+            if(n<=0){ FAIL("%s: io %d", path, n); break; }
+            c->bytes+=(uint64_t)n;
+        }
+    }
+    mx_close(V, fd);
+    free(buf);
+    return NULL;
+}
+
+static double run_scale(int nt, int mode){
+    pthread_t th[MAXT]; sctx_t c[MAXT];
+    pthread_barrier_init(&g_bar, NULL, (unsigned)nt+1);
+    for(int i=0;i<nt;i++){ c[i]=(sctx_t){ i, mode, 0 }; pthread_create(&th[i], NULL, scale_worker, &c[i]); }
+    pthread_barrier_wait(&g_bar);
+    double t0=now_s();
+    uint64_t total=0;
+    for(int i=0;i<nt;i++){ pthread_join(th[i], NULL); total+=c[i].bytes; }
+    if(mode==2) mx_sync(V);             // 写入算到落盘为止
+    double dt=now_s()-t0;
+    pthread_barrier_destroy(&g_bar);
+    if(mode==2){
+        char path[32];
+        for(int i=0;i<nt;i++){ snprintf(path, sizeof(path), "/new%d", i); mx_unlink(V, path); }
+        mx_sync(V);
+    }
+    return total/dt/1048576.0;
+}
+
+static int scale(int maxt, const char* opts){
+    int e=mx_format(IMG, opts, 4096, (uint64_t)(maxt*2+2)*SCALE_FILE, 0, 0, NULL);
+    if(e || !(V=mx_mount(IMG, opts, &e))){ printf("format/mount failed: %d\n", e); return 1; }
+    uint8_t* buf=malloc(CHUNK); char path[32];
+    for(int i=0;i<maxt;i++){
+        snprintf(path, sizeof(path), "/r%d", i);
+        int fd=mx_open(V, path, "w");
+        for(uint32_t off=0; off<SCALE_FILE && fd>=0; off+=CHUNK){ memset(buf, i+off/CHUNK, CHUNK); write_all(fd, buf, CHUNK); }
+        mx_close(V, fd);
+    }
+    free(buf);
+    mx_sync(V);
+    printf("%-8s %14s %14s %14s   (MB/s, %u MB per thread)\n", "threads", "read-same", "read-own", "write-own", SCALE_FILE>>20);
+    for(int nt=1; nt<=maxt && !g_fail; nt++)
+        printf("%-8d %14.1f %14.1f %14.1f\n", nt, run_scale(nt, 0), run_scale(nt, 1), run_scale(nt, 2));
+    mx_unmount(V, NULL);
+    unlink(IMG);
+    return g_fail ? 1 : 0;
+}
+
+// ===== fds =====
+#define FDS_MAX  100000
+static void fill_blk(uint8_t* b, int i){ for(uint32_t k=0;k<4096;k++) b[k]=(uint8_t)(i*131+k*7); }
+
+static int fds(int n, const char* opts){
+    int e=mx_format(IMG, opts, 4096, 128u<<20, (uint32_t)n+1024, 0, NULL);
+    if(e || !(V=mx_mount(IMG, opts, &e))){ printf("format/mount failed: %d\n", e); return 1; }
+    int* fd=malloc(n*sizeof(int)); int* dup=malloc(n*sizeof(int));
+    uint8_t want[4096], got[4096]; char path[32];
+    double t0=now_s();
+
+    // 全部打开并写一块，每个再 dup 一个只读 fd
+    for(int i=0;i<n && !g_fail;i++){
+        snprintf(path, sizeof(path), "/f%d", i);
+        if((fd[i]=mx_open(V, path, "w"))<0){ FAIL("open %s -> %d", path, fd[i]); break; }
+        fill_blk(want, i);
+        if(write_all(fd[i], want, sizeof(want))) FAIL("write %s", path);
+        if((dup[i]=mx_dup(V, fd[i], MX_FD_RDONLY))<0) FAIL("dup %s -> %d", path, dup[i]);
+    }
+    if(g_fail){ mx_unmount(V, NULL); unlink(IMG); return 1; }
+    printf("opened %d files + %d dups in %.2fs\n", n, n, now_s()-t0);
+
+    // dup 共用偏移：前半从 dup 读、后半从原 fd 读；只读 fd 写不进去
+    for(int i=0;i<n;i++){
+        fill_blk(want, i);
+        mx_seek(V, fd[i], 0);
+        if(read_all(dup[i], got, 2048)!=2048 || read_all(fd[i], got+2048, 2048)!=2048 || memcmp(got, want, 4096))
+            FAIL("/f%d: shared offset read mismatch", i);
+        if(mx_write(V, dup[i], want, 1)!=FS_EPERM) FAIL("/f%d: write through read-only dup", i);
+    }
+    if(mx_fdflags(V, dup[0], 0)!=MX_FD_RDONLY || mx_fdflags(V, dup[0], -1)!=0) FAIL("fdflags round trip");
+    mx_seek(V, dup[0], 0); fill_blk(want, 0);
+    if(mx_write(V, dup[0], want, 16)!=16) FAIL("write after clearing MX_FD_RDONLY");
+
+    // 打开期间删除：名字消失，数据照读，空间不动
+    mx_sync(V);
+    mx_info_t full; mx_info(V, &full);
+    for(int i=0;i<n;i++){ snprintf(path, sizeof(path), "/f%d", i); if(mx_unlink(V, path)) FAIL("unlink %s", path); }
+    mx_stat_t st;
+    if(mx_stat(V, "/f0", &st)!=FS_ENOENT) FAIL("/f0 still visible after unlink");
+    for(int i=0;i<n;i+=7){
+        fill_blk(want, i); mx_seek(V, fd[i], 0);
+        if(read_all(dup[i], got, 4096)!=4096 || memcmp(got, want, 4096)) FAIL("/f%d: read after unlink", i);
+    }
+    for(int i=0;i<n;i++) if(mx_close(V, fd[i])) FAIL("close fd %d", fd[i]);
+    mx_sync(V);
+    mx_info_t mid; mx_info(V, &mid);
+    if(mid.free_blocks!=full.free_blocks || mid.free_inodes!=full.free_inodes)
+        FAIL("space released while dups still open: %u/%u, expected %u/%u", mid.free_blocks, mid.free_inodes, full.free_blocks, full.free_inodes);
+
+    // 最后一个 fd 关闭才释放：每个文件一个 inode、一个数据块（根目录增长与索引不退）
+    for(int i=0;i<n;i++) if(mx_close(V, dup[i])) FAIL("close dup %d", dup[i]);
+    mx_sync(V);
+    mx_info_t after; mx_info(V, &after);
+    if(after.free_inodes!=full.free_inodes+(uint32_t)n || after.free_blocks!=full.free_blocks+(uint32_t)n)
+        FAIL("after closing everything: free %u/%u, expected %u/%u", after.free_blocks, after.free_inodes, full.free_blocks+(uint32_t)n, full.free_inodes+(uint32_t)n);
+    if((e=mx_unmount(V, NULL))) FAIL("unmount %d", e);
+    if(!(V=mx_mount(IMG, opts, &e))){ printf("remount failed: %d\n", e); return 1; }
+    mx_info_t re; mx_info(V, &re);
+    if(re.free_blocks!=after.free_blocks || re.free_inodes!=after.free_inodes)
+        FAIL("free counters drifted: %u/%u before unmount, %u/%u recounted", after.free_blocks, after.free_inodes, re.free_blocks, re.free_inodes);
+    mx_unmount(V, NULL);
+    free(fd); free(dup);
+    unlink(IMG);
+    printf(g_fail ? "fds: %d failure(s)\n" : "fds: ok\n", g_fail);
+    return g_fail ? 1 : 0;
+}
+
+// ===== frag =====
+// 交替追加让两个文件的块在盘上互相穿插，每块各成一个 extent；第三个文件按打乱的顺序逐块写，
+// 新 extent 落在树的中间。块内容由 (文件, 块号) 决定
+#define FRAG_BS  512u
+#define FRAG_MAX 20000
+static void frag_blk(uint8_t* b, int f, uint32_t i){ for(uint32_t k=0;k<FRAG_BS;k++) b[k]=(uint8_t)(f*77+i*13+k*7+(i>>8)); }
+
+static void frag_verify(const char* path, int f, uint32_t n){
+    uint8_t want[FRAG_BS], got[FRAG_BS];
+    int fd=mx_open(V, path, "r");
+    if(fd<0){ FAIL("%s: open %d", path, fd); return; }
+    for(uint32_t i=0;i<n;i++){
+        frag_blk(want, f, i);
+        if(read_all(fd, got, FRAG_BS)!=(int)FRAG_BS || memcmp(got, want, FRAG_BS)){ FAIL("%s: block %u mismatch", path, i); break; }
+    }
+    if(read_all(fd, got, 1)!=0) FAIL("%s: data past %u blocks", path, n);
+    mx_close(V, fd);
+}
+
+static int frag(uint32_t n, const char* opts){
+    int e=mx_format(IMG, opts, FRAG_BS, 16u<<20, 0, 0, NULL);
+    if(e || !(V=mx_mount(IMG, opts, &e))){ printf("format/mount failed: %d\n", e); return 1; }
+    mx_info_t base; mx_info(V, &base);
+    static const char* names[3]={ "/a", "/b", "/c" };
+    uint8_t buf[FRAG_BS];
+    int fd[3];
+    double t0=now_s();
+    for(int f=0;f<3;f++) if((fd[f]=mx_open(V, names[f], "w"))<0){ printf("open %s failed: %d\n", names[f], fd[f]); return 1; }
+    for(uint32_t i=0;i<n && !g_fail;i++)
+        for(int f=0;f<2;f++){
+            frag_blk(buf, f, i);
+            if((e=write_all(fd[f], buf, FRAG_BS))) FAIL("%s: append block %u -> %d", names[f], i, e);
+        }
+    uint32_t* perm=malloc(n*sizeof(uint32_t)), seed=12345;
+    for(uint32_t i=0;i<n;i++) perm[i]=i;
+    for(uint32_t i=n;i>1;i--){ uint32_t j=xs(&seed)%i, t=perm[i-1]; perm[i-1]=perm[j]; perm[j]=t; }
+    for(uint32_t i=0;i<n && !g_fail;i++){
+        frag_blk(buf, 2, perm[i]);
+        mx_seek(V, fd[2], (int32_t)(perm[i]*FRAG_BS));
+        if((e=write_all(fd[2], buf, FRAG_BS))) FAIL("%s: block %u -> %d", names[2], perm[i], e);
+    }
+    free(perm);
+    for(int f=0;f<3;f++) mx_close(V, fd[f]);
+    printf("wrote 3 x %u blocks of %u bytes in %.2fs\n", n, FRAG_BS, now_s()-t0);
+
+    for(int f=0;f<3;f++) frag_verify(names[f], f, n);
+    mx_sync(V);
+    mx_info_t before; mx_info(V, &before);
+    if((e=mx_unmount(V, NULL))) FAIL("unmount %d", e);
+    if(!(V=mx_mount(IMG, opts, &e))){ printf("remount failed: %d\n", e); return 1; }
+    mx_info_t after; mx_info(V, &after);
+    if(before.free_blocks!=after.free_blocks) FAIL("free blocks drifted: %u before unmount, %u recounted", before.free_blocks, after.free_blocks);
+    for(int f=0;f<3;f++) frag_verify(names[f], f, n);
+
+    // 删除后数据块与树节点块全部归还
+    for(int f=0;f<3;f++) if(mx_unlink(V, names[f])) FAIL("unlink %s", names[f]);
+    mx_sync(V);
+    mx_info(V, &after);
+    if(after.free_blocks!=base.free_blocks || after.free_inodes!=base.free_inodes)
+        FAIL("after deleting everything: free %u/%u, expected %u/%u", after.free_blocks, after.free_inodes, base.free_blocks, base.free_inodes);
+    mx_unmount(V, NULL);
+    unlink(IMG);
+    printf(g_fail ? "frag: %d failure(s)\n" : "frag: ok\n", g_fail);
+    return g_fail ? 1 : 0;
+}
+
+int main(int argc, char** argv){
+    const char* mode = argc>1 ? argv[1] : "check";
+    if(strcmp(mode, "check")==0){
+        int nt = argc>2 ? atoi(argv[2]) : 4, iters = argc>3 ? atoi(argv[3]) : 2000;
+        if(nt<1 || nt>MAXT) nt=4;
+        return check(nt, iters, argc>4 ? argv[4] : "dev=pread");
+    }
+    if(strcmp(mode, "scale")==0){
+        int nt = argc>2 ? atoi(argv[2]) : 8;
+        if(nt<1 || nt>MAXT) nt=8;
+        return scale(nt, argc>3 ? argv[3] : "dev=pread");
+    }
+    if(strcmp(mode, "fds")==0){
+        int n = argc>2 ? atoi(argv[2]) : 3000;
+        if(n<1 || n>FDS_MAX) n=3000;
+        return fds(n, argc>3 ? argv[3] : "dev=pread");
+    }
+    if(strcmp(mode, "frag")==0){
+        int n = argc>2 ? atoi(argv[2]) : 4000;
+        if(n<1 || n>FRAG_MAX) n=4000;
+        return frag((uint32_t)n, argc>3 ? argv[3] : "extents,nodelalloc");
+    }
+    fprintf(stderr, "usage: %s check [threads] [iters] [opts] | scale [max_threads] [opts] | fds [files] [opts] | frag [blocks] [opts]\n", argv[0]);
+    return 2;
+}